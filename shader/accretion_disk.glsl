@@ -0,0 +1,198 @@
+// Emission of the accretion disk, shared by the ray marcher
+// (blackhole_main.frag) and DiskCache (disk_cache.frag), which bakes it into
+// a texture. Uses the includer's time uniform.
+
+uniform sampler2D colorMap;
+
+uniform float adiskParticle = 1.0;
+uniform float adiskHeight = 0.2;
+uniform float adiskLit = 0.5;
+uniform float adiskDensityV = 1.0;
+uniform float adiskDensityH = 1.0;
+uniform float adiskNoiseScale = 1.0;
+uniform float adiskNoiseLOD = 3.0;
+uniform float adiskSpeed = 0.5;
+// Optical depth per march step for each unit of emitting density; 0 leaves
+// the disk transparent.
+uniform float adiskAbsorption = 0.05;
+
+const float ADISK_INNER_RADIUS = 2.6;
+const float ADISK_OUTER_RADIUS = 12.0;
+// Distance from the axis within which the disk is dark up to a height of 1,
+// where DiskCache's texture starts.
+const float ADISK_CACHE_RADIUS = 2.4;
+
+///----
+/// Simplex 3D Noise
+/// by Ian McEwan, Ashima Arts
+vec4 permute(vec4 x) { return mod(((x * 34.0) + 1.0) * x, 289.0); }
+vec4 taylorInvSqrt(vec4 r) { return 1.79284291400159 - 0.85373472095314 * r; }
+
+float snoise(vec3 v) {
+  const vec2 C = vec2(1.0 / 6.0, 1.0 / 3.0);
+  const vec4 D = vec4(0.0, 0.5, 1.0, 2.0);
+
+  // First corner
+  vec3 i = floor(v + dot(v, C.yyy));
+  vec3 x0 = v - i + dot(i, C.xxx);
+
+  // Other corners
+  vec3 g = step(x0.yzx, x0.xyz);
+  vec3 l = 1.0 - g;
+  vec3 i1 = min(g.xyz, l.zxy);
+  vec3 i2 = max(g.xyz, l.zxy);
+
+  //  x0 = x0 - 0. + 0.0 * C
+  vec3 x1 = x0 - i1 + 1.0 * C.xxx;
+  vec3 x2 = x0 - i2 + 2.0 * C.xxx;
+  vec3 x3 = x0 - 1. + 3.0 * C.xxx;
+
+  // Permutations
+  i = mod(i, 289.0);
+  vec4 p = permute(permute(permute(i.z + vec4(0.0, i1.z, i2.z, 1.0)) + i.y +
+                           vec4(0.0, i1.y, i2.y, 1.0)) +
+                   i.x + vec4(0.0, i1.x, i2.x, 1.0));
+
+  // Gradients
+  // ( N*N points uniformly over a square, mapped onto an octahedron.)
+  float n_ = 1.0 / 7.0; // N=7
+  vec3 ns = n_ * D.wyz - D.xzx;
+
+  vec4 j = p - 49.0 * floor(p * ns.z * ns.z); //  mod(p,N*N)
+
+  vec4 x_ = floor(j * ns.z);
+  vec4 y_ = floor(j - 7.0 * x_); // mod(j,N)
+
+  vec4 x = x_ * ns.x + ns.yyyy;
+  vec4 y = y_ * ns.x + ns.yyyy;
+  vec4 h = 1.0 - abs(x) - abs(y);
+
+  vec4 b0 = vec4(x.xy, y.xy);
+  vec4 b1 = vec4(x.zw, y.zw);
+
+  vec4 s0 = floor(b0) * 2.0 + 1.0;
+  vec4 s1 = floor(b1) * 2.0 + 1.0;
+  vec4 sh = -step(h, vec4(0.0));
+
+  vec4 a0 = b0.xzyw + s0.xzyw * sh.xxyy;
+  vec4 a1 = b1.xzyw + s1.xzyw * sh.zzww;
+
+  vec3 p0 = vec3(a0.xy, h.x);
+  vec3 p1 = vec3(a0.zw, h.y);
+  vec3 p2 = vec3(a1.xy, h.z);
+  vec3 p3 = vec3(a1.zw, h.w);
+
+  // Normalise gradients
+  vec4 norm =
+      taylorInvSqrt(vec4(dot(p0, p0), dot(p1, p1), dot(p2, p2), dot(p3, p3)));
+  p0 *= norm.x;
+  p1 *= norm.y;
+  p2 *= norm.z;
+  p3 *= norm.w;
+
+  // Mix final noise value
+  vec4 m =
+      max(0.6 - vec4(dot(x0, x0), dot(x1, x1), dot(x2, x2), dot(x3, x3)), 0.0);
+  m = m * m;
+  return 42.0 *
+         dot(m * m, vec4(dot(p0, x0), dot(p1, x1), dot(p2, x2), dot(p3, x3)));
+}
+///----
+
+// Convert from Cartesian to spherical coord (rho, phi, theta)
+// https://en.wikipedia.org/wiki/Spherical_coordinate_system
+vec3 toSpherical(vec3 p) {
+  float rho = sqrt((p.x * p.x) + (p.y * p.y) + (p.z * p.z));
+  float theta = atan(p.z, p.x);
+  float phi = asin(p.y / rho);
+  return vec3(rho, theta, phi);
+}
+
+// Angle by which the noise's even octaves have turned at time t; the odd
+// ones stay put.
+float diskRotation(float t) {
+  return t * adiskSpeed / (2.0 * max(adiskNoiseScale, 1e-3));
+}
+
+// Light given off at pos per march step (rgb) and the optical depth of the
+// step (a), both proportional to the density of emitting particles.
+// footprint is the width the sample stands for, a pixel's across the ray or
+// a texel of DiskCache; noise octaves finer than that are faded out.
+vec4 diskEmission(vec3 pos, float footprint) {
+  float innerRadius = ADISK_INNER_RADIUS;
+  float outerRadius = ADISK_OUTER_RADIUS;
+
+  // Fast distance check using squared length to avoid sqrt
+  float posSqLen = dot(pos.xz, pos.xz);
+  if (posSqLen > outerRadius * outerRadius) {
+    return vec4(0.0);
+  }
+
+  // Early height check
+  float absY = abs(pos.y);
+  if (absY > adiskHeight) {
+    return vec4(0.0);
+  }
+
+  float posLen = sqrt(posSqLen + pos.y * pos.y);
+
+  // Density linearly decreases as the distance to the blackhole center
+  // increases.
+  float density = max(0.0, 1.0 - posLen / outerRadius);
+  if (density < 0.005) {
+    return vec4(0.0);
+  }
+
+  density *= pow(1.0 - absY / adiskHeight, adiskDensityV);
+
+  // Set particle density to 0 when radius is below the inner most stable
+  // circular orbit.
+  density *= smoothstep(innerRadius, innerRadius * 1.1, posLen);
+
+  // Avoid the shader computation when density is very small.
+  if (density < 0.005) {
+    return vec4(0.0);
+  }
+
+  vec3 sphericalCoord = toSpherical(pos);
+
+  // Scale the rho and phi so that the particles appear to be at the correct
+  // scale visually.
+  sphericalCoord.y *= 2.0;
+  sphericalCoord.z *= 4.0;
+
+  density *= 1.0 / pow(sphericalCoord.x, adiskDensityH);
+  density *= 16000.0;
+
+  if (adiskParticle < 0.5) {
+    return vec4(vec3(0.0, 1.0, 0.0) * density * 0.02,
+                density * adiskAbsorption);
+  }
+
+  // Optimized noise calculation with fewer iterations
+  float noise = 1.0;
+  int noiseLOD = min(int(adiskNoiseLOD), 4);  // Cap at 4 for performance
+  vec3 noiseCoord = sphericalCoord * adiskNoiseScale;
+  // The footprint in cells of the first octave; the angular coordinates
+  // change 2 / rho and 4 / rho times faster than rho. An octave covering
+  // half a cell or more per sample fades to its mean of 0.5, which keeps the
+  // disk's brightness, and is gone at a whole cell; the finer ones after it
+  // are then skipped.
+  float cells = footprint * adiskNoiseScale * max(1.0, 4.0 / sphericalCoord.x);
+  for (int i = 1; i <= 4; i++) {
+    if (i > noiseLOD) break;
+    float detail = 1.0 - smoothstep(0.5, 1.0, cells * float(i * i));
+    if (detail <= 0.0) {
+      noise *= pow(0.5, float(noiseLOD - i + 1));
+      break;
+    }
+    noise *= 0.5 + 0.5 * detail * snoise(noiseCoord * float(i * i));
+    noiseCoord.y += (i % 2 == 0 ? -1.0 : 1.0) * time * adiskSpeed;
+  }
+
+  vec3 dustColor =
+      texture(colorMap, vec2(sphericalCoord.x / outerRadius, 0.5)).rgb;
+
+  density *= abs(noise);
+  return vec4(density * adiskLit * dustColor, density * adiskAbsorption);
+}
@@ -3,39 +3,50 @@
 const float PI = 3.14159265359;
 const float EPSILON = 0.0001;
 const float INFINITY = 1000000.0;
+// Transmittance below which the rest of a ray, disk and sky behind it, is
+// left out.
+const float MIN_TRANSMITTANCE = 0.01;
 
-out vec4 fragColor;
+layout(location = 0) out vec4 fragColor;
+// Sky tile wanted by this pixel, read back by VirtualSky (zero if none).
+layout(location = 1) out uvec4 skyFeedback;
 
 uniform vec2 resolution; // viewport resolution in pixels
-uniform float mouseX;
-uniform float mouseY;
 
 uniform float time; // time elapsed in seconds
 uniform samplerCube galaxy;
-uniform sampler2D colorMap;
-
-uniform float frontView = 0.0;
-uniform float topView = 0.0;
-uniform float cameraRoll = 0.0;
 
 uniform float gravitationalLensing = 1.0;
 uniform float renderBlackHole = 1.0;
-uniform float mouseControl = 0.0;
-uniform float fovScale = 1.0;
-uniform float useExternalCamera = 0.0;
-uniform vec3 externalCameraPos = vec3(0.0);
-uniform vec3 externalTarget = vec3(0.0);
-uniform float externalFovScale = 1.0;
+// Set while rendering a tile of a poster (see Poster): this draw covers the
+// pixels from tileOffset on of an image of posterResolution. Left at zero,
+// the draw covers the image.
+uniform vec2 tileOffset = vec2(0.0);
+uniform vec2 posterResolution = vec2(0.0);
+// How rays leave the camera; matches Projection in main.cpp. 0: pinhole with
+// the camera's fov scale, 1: equirectangular 360 by 180 degrees, 2: 180 degree fisheye
+// (dome master) looking at the target, 3: the six cube map faces, world
+// aligned, in a 3 by 2 grid.
+uniform float projection = 0.0;
+
+// The camera, written by CameraLatch right before the draw.
+layout(std140) uniform CameraBlock {
+  vec4 latchedPosition;
+  vec4 latchedTarget;
+  vec4 latchedParams; // fovScale, roll in radians
+};
 
 uniform float adiskEnabled = 1.0;
-uniform float adiskParticle = 1.0;
-uniform float adiskHeight = 0.2;
-uniform float adiskLit = 0.5;
-uniform float adiskDensityV = 1.0;
-uniform float adiskDensityH = 1.0;
-uniform float adiskNoiseScale = 1.0;
-uniform float adiskNoiseLOD = 3.0;
-uniform float adiskSpeed = 0.5;
+// Emission from adiskEmission (DiskCache) rather than diskEmission().
+uniform float adiskCache = 0.0;
+uniform sampler3D adiskEmission;
+
+uniform float virtualSky = 0.0;
+
+#include "virtual_sky.glsl"
+#include "accretion_disk.glsl"
+
+uvec4 skyRequest = uvec4(0u);
 
 struct Ring {
   vec3 center;
@@ -45,82 +56,6 @@ struct Ring {
   float rotateSpeed;
 };
 
-///----
-/// Simplex 3D Noise
-/// by Ian McEwan, Ashima Arts
-vec4 permute(vec4 x) { return mod(((x * 34.0) + 1.0) * x, 289.0); }
-vec4 taylorInvSqrt(vec4 r) { return 1.79284291400159 - 0.85373472095314 * r; }
-
-float snoise(vec3 v) {
-  const vec2 C = vec2(1.0 / 6.0, 1.0 / 3.0);
-  const vec4 D = vec4(0.0, 0.5, 1.0, 2.0);
-
-  // First corner
-  vec3 i = floor(v + dot(v, C.yyy));
-  vec3 x0 = v - i + dot(i, C.xxx);
-
-  // Other corners
-  vec3 g = step(x0.yzx, x0.xyz);
-  vec3 l = 1.0 - g;
-  vec3 i1 = min(g.xyz, l.zxy);
-  vec3 i2 = max(g.xyz, l.zxy);
-
-  //  x0 = x0 - 0. + 0.0 * C
-  vec3 x1 = x0 - i1 + 1.0 * C.xxx;
-  vec3 x2 = x0 - i2 + 2.0 * C.xxx;
-  vec3 x3 = x0 - 1. + 3.0 * C.xxx;
-
-  // Permutations
-  i = mod(i, 289.0);
-  vec4 p = permute(permute(permute(i.z + vec4(0.0, i1.z, i2.z, 1.0)) + i.y +
-                           vec4(0.0, i1.y, i2.y, 1.0)) +
-                   i.x + vec4(0.0, i1.x, i2.x, 1.0));
-
-  // Gradients
-  // ( N*N points uniformly over a square, mapped onto an octahedron.)
-  float n_ = 1.0 / 7.0; // N=7
-  vec3 ns = n_ * D.wyz - D.xzx;
-
-  vec4 j = p - 49.0 * floor(p * ns.z * ns.z); //  mod(p,N*N)
-
-  vec4 x_ = floor(j * ns.z);
-  vec4 y_ = floor(j - 7.0 * x_); // mod(j,N)
-
-  vec4 x = x_ * ns.x + ns.yyyy;
-  vec4 y = y_ * ns.x + ns.yyyy;
-  vec4 h = 1.0 - abs(x) - abs(y);
-
-  vec4 b0 = vec4(x.xy, y.xy);
-  vec4 b1 = vec4(x.zw, y.zw);
-
-  vec4 s0 = floor(b0) * 2.0 + 1.0;
-  vec4 s1 = floor(b1) * 2.0 + 1.0;
-  vec4 sh = -step(h, vec4(0.0));
-
-  vec4 a0 = b0.xzyw + s0.xzyw * sh.xxyy;
-  vec4 a1 = b1.xzyw + s1.xzyw * sh.zzww;
-
-  vec3 p0 = vec3(a0.xy, h.x);
-  vec3 p1 = vec3(a0.zw, h.y);
-  vec3 p2 = vec3(a1.xy, h.z);
-  vec3 p3 = vec3(a1.zw, h.w);
-
-  // Normalise gradients
-  vec4 norm =
-      taylorInvSqrt(vec4(dot(p0, p0), dot(p1, p1), dot(p2, p2), dot(p3, p3)));
-  p0 *= norm.x;
-  p1 *= norm.y;
-  p2 *= norm.z;
-  p3 *= norm.w;
-
-  // Mix final noise value
-  vec4 m =
-      max(0.6 - vec4(dot(x0, x0), dot(x1, x1), dot(x2, x2), dot(x3, x3)), 0.0);
-  m = m * m;
-  return 42.0 *
-         dot(m * m, vec4(dot(p0, x0), dot(p1, x1), dot(p2, x2), dot(p3, x3)));
-}
-///----
 
 float ringDistance(vec3 rayOrigin, vec3 rayDir, Ring ring) {
   float denominator = dot(rayDir, ring.normal);
@@ -197,15 +132,6 @@ void cartesianToSpherical(in vec3 xyz, out float rho, out float phi,
   theta = atan(xyz.z, xyz.x);
 }
 
-// Convert from Cartesian to spherical coord (rho, phi, theta)
-// https://en.wikipedia.org/wiki/Spherical_coordinate_system
-vec3 toSpherical(vec3 p) {
-  float rho = sqrt((p.x * p.x) + (p.y * p.y) + (p.z * p.z));
-  float theta = atan(p.z, p.x);
-  float phi = asin(p.y / rho);
-  return vec3(rho, theta, phi);
-}
-
 vec3 toSpherical2(vec3 pos) {
   vec3 radialCoords;
   radialCoords.x = length(pos) * 1.5 + 0.55;
@@ -261,83 +187,84 @@ mat3 lookAt(vec3 origin, vec3 target, float roll) {
 
 float sqrLength(vec3 a) { return dot(a, a); }
 
-void adiskColor(vec3 pos, inout vec3 color, inout float alpha) {
-  float innerRadius = 2.6;
-  float outerRadius = 12.0;
-
+// Adds the disk's light at pos, dimmed by the transmittance alpha of the
+// disk in front of it, and attenuates alpha by the step's optical depth.
+// footprint is the pixel's width at pos, which picks the noise's detail.
+void adiskColor(vec3 pos, float footprint, inout vec3 color,
+                inout float alpha) {
   // Fast distance check using squared length to avoid sqrt
   float posSqLen = dot(pos.xz, pos.xz);
-  if (posSqLen > outerRadius * outerRadius) {
+  if (posSqLen > ADISK_OUTER_RADIUS * ADISK_OUTER_RADIUS) {
     return;
   }
 
   // Early height check
-  float absY = abs(pos.y);
-  if (absY > adiskHeight) {
-    return;
-  }
-
-  float posLen = sqrt(posSqLen + pos.y * pos.y);
-
-  // Density linearly decreases as the distance to the blackhole center
-  // increases.
-  float density = max(0.0, 1.0 - posLen / outerRadius);
-  if (density < 0.005) {
+  if (abs(pos.y) > adiskHeight) {
     return;
   }
 
-  density *= pow(1.0 - absY / adiskHeight, adiskDensityV);
-
-  // Set particle density to 0 when radius is below the inner most stable
-  // circular orbit.
-  density *= smoothstep(innerRadius, innerRadius * 1.1, posLen);
-
-  // Avoid the shader computation when density is very small.
-  if (density < 0.005) {
-    return;
-  }
-
-  vec3 sphericalCoord = toSpherical(pos);
-
-  // Scale the rho and phi so that the particles appear to be at the correct
-  // scale visually.
-  sphericalCoord.y *= 2.0;
-  sphericalCoord.z *= 4.0;
-
-  density *= 1.0 / pow(sphericalCoord.x, adiskDensityH);
-  density *= 16000.0;
-
-  if (adiskParticle < 0.5) {
-    color += vec3(0.0, 1.0, 0.0) * density * 0.02;
-    return;
+  vec4 emission;
+  if (adiskCache > 0.5) {
+    // The cache's azimuth turns with the noise's even octaves.
+    vec3 coord;
+    coord.x = fract((atan(pos.z, pos.x) + diskRotation(time)) / (2.0 * PI) +
+                    0.5);
+    coord.y = (sqrt(posSqLen) - ADISK_CACHE_RADIUS) /
+              (ADISK_OUTER_RADIUS - ADISK_CACHE_RADIUS);
+    coord.z = pos.y / adiskHeight * 0.5 + 0.5;
+    emission = textureLod(adiskEmission, coord, 0.0);
+  } else {
+    emission = diskEmission(pos, footprint);
   }
 
-  // Optimized noise calculation with fewer iterations
-  float noise = 1.0;
-  int noiseLOD = min(int(adiskNoiseLOD), 4);  // Cap at 4 for performance
-  vec3 noiseCoord = sphericalCoord * adiskNoiseScale;
-  for (int i = 1; i <= 4; i++) {
-    if (i > noiseLOD) break;
-    noise *= 0.5 * snoise(noiseCoord * float(i * i)) + 0.5;
-    noiseCoord.y += (i % 2 == 0 ? -1.0 : 1.0) * time * adiskSpeed;
-  }
+  // Emission and absorption held constant over the step: of the light given
+  // off along it, the fraction (1 - e^-tau) / tau gets out of the step.
+  float tau = emission.a;
+  float transmittance = exp(-tau);
+  float escaping = tau > 1e-4 ? (1.0 - transmittance) / tau : 1.0;
+  color += emission.rgb * escaping * alpha;
+  alpha *= transmittance;
+}
 
-  vec3 dustColor =
-      texture(colorMap, vec2(sphericalCoord.x / outerRadius, 0.5)).rgb;
+// Pixel footprint in radians of a sky fetch along dir whose neighbouring
+// pixels' rays differ by dDirX and dDirY (none of them need to be normalized).
+float skyFootprint(vec3 dir, vec3 dDirX, vec3 dDirY) {
+  // Differentials of normalize(dir).
+  float invLen = inversesqrt(dot(dir, dir));
+  vec3 n = dir * invLen;
+  float angleX = length(dDirX - n * dot(n, dDirX)) * invLen;
+  float angleY = length(dDirY - n * dot(n, dDirY)) * invLen;
+  return max(angleX, angleY);
+}
 
-  color += density * adiskLit * dustColor * alpha * abs(noise);
+// LOD on cube faces of faceSize texels, which span 2 units of tangent.
+float skyLod(float footprint, float faceSize) {
+  return log2(max(footprint * faceSize * 0.5, 1e-6));
 }
 
-vec3 traceColor(vec3 pos, vec3 dir) {
+// Traces the ray from pos along dir. dDirX and dDirY are the differentials of
+// dir towards the neighbouring pixels; they are carried through the bending
+// (the rays all start at the camera) to pick the sky mip level and the disk
+// noise's octaves, which keeps the strongly minified sky near the photon ring
+// and the distant disk from aliasing. traceShader() in src/geodesic.cpp
+// repeats the integration on the CPU for geodesic_error.
+vec3 traceColor(vec3 pos, vec3 dir, vec3 dDirX, vec3 dDirY) {
   vec3 color = vec3(0.0);
+  // Transmittance of the disk between the camera and pos.
   float alpha = 1.0;
 
   float STEP_SIZE = 0.15;  // Increased step size for better performance
   dir *= STEP_SIZE;
+  dDirX *= STEP_SIZE;
+  dDirY *= STEP_SIZE;
+  vec3 dPosX = vec3(0.0);
+  vec3 dPosY = vec3(0.0);
 
   // Initial values
   vec3 h = cross(pos, dir);
   float h2 = dot(h, h);
+  float dH2X = 2.0 * dot(h, cross(pos, dDirX));
+  float dH2Y = 2.0 * dot(h, cross(pos, dDirY));
 
   float distSq = dot(pos, pos);
 
@@ -352,6 +279,14 @@ vec3 traceColor(vec3 pos, vec3 dir) {
       if (gravitationalLensing > 0.5) {
         vec3 acc = accel(h2, pos);
         dir += acc;
+
+        // accel() linearized for the neighbouring rays, whose h2 differs too.
+        float r2 = dot(pos, pos);
+        vec3 dPosXr = dPosX - 5.0 * pos * (dot(pos, dPosX) / r2);
+        vec3 dPosYr = dPosY - 5.0 * pos * (dot(pos, dPosY) / r2);
+        float k = -1.5 / pow(r2, 2.5);
+        dDirX += k * (dH2X * pos + h2 * dPosXr);
+        dDirY += k * (dH2Y * pos + h2 * dPosYr);
       }
 
       distSq = dot(pos, pos);
@@ -367,19 +302,98 @@ vec3 traceColor(vec3 pos, vec3 dir) {
       }
 
       if (adiskEnabled > 0.5) {
-        adiskColor(pos, color, alpha);
+        // dPosX and dPosY span the pixel's cone around the ray; they start
+        // at zero at the camera and widen, or narrow, with the bending.
+        float footprint = sqrt(max(dot(dPosX, dPosX), dot(dPosY, dPosY)));
+        adiskColor(pos, footprint, color, alpha);
+        // Nothing behind an opaque stretch of disk shows through.
+        if (alpha < MIN_TRANSMITTANCE) {
+          return color;
+        }
       }
     }
 
     pos += dir;
+    dPosX += dDirX;
+    dPosY += dDirY;
   }
 
-  // Sample skybox color
+  // Sample skybox color. The rotation keeps angles, so the LOD is unchanged.
+  float footprint = skyFootprint(dir, dDirX, dDirY);
   dir = rotateVector(dir, vec3(0.0, 1.0, 0.0), time);
-  color += texture(galaxy, dir).rgb * alpha;
+  if (virtualSky > 0.5) {
+    color += sampleVirtualSky(dir, skyLod(footprint, vtParams.x), skyRequest) *
+             alpha;
+  } else {
+    float lod = skyLod(footprint, float(textureSize(galaxy, 0).x));
+    color += textureLod(galaxy, dir, lod).rgb * alpha;
+  }
   return color;
 }
 
+// ========== PANORAMIC PROJECTIONS ==========
+// World space ray through a pixel of the image. Camera space has +z towards
+// the target, +y up and -x to the right, as for the pinhole camera. Returns
+// false for pixels outside of the fisheye's circle.
+bool panoramaRay(vec2 pixel, vec2 imageSize, mat3 view, out vec3 dir) {
+  vec2 p = pixel / imageSize;
+  if (projection < 1.5) {
+    // Longitude 0 at the centre column, towards the target.
+    float longitude = (p.x - 0.5) * 2.0 * PI;
+    float latitude = (p.y - 0.5) * PI;
+    dir = view * vec3(-sin(longitude) * cos(latitude), sin(latitude),
+                      cos(longitude) * cos(latitude));
+    return true;
+  } else if (projection < 2.5) {
+    // Equidistant: the angle from the target grows linearly to 90 degrees
+    // at the rim of the largest centred circle.
+    vec2 q = (pixel - imageSize * 0.5) / (0.5 * min(imageSize.x, imageSize.y));
+    float r = length(q);
+    float theta = r * 0.5 * PI;
+    float phi = atan(q.y, q.x);
+    dir = view * vec3(-sin(theta) * cos(phi), sin(theta) * sin(phi),
+                      cos(theta));
+    return r <= 1.0;
+  }
+  // Faces +X, -X, +Y along the top row and -Y, +Z, -Z along the bottom, each
+  // with s to the right and t down as a cube map face image is loaded.
+  // Poster tile margins past the grid stay black.
+  vec2 cell = p * vec2(3.0, 2.0);
+  float face = floor(cell.x) + (cell.y < 1.0 ? 3.0 : 0.0);
+  bool inside =
+      all(greaterThanEqual(p, vec2(0.0))) && all(lessThan(p, vec2(1.0)));
+  vec2 st = fract(cell) * 2.0 - 1.0;
+  float s = st.x;
+  float t = -st.y;
+  if (face < 0.5) {
+    dir = vec3(1.0, -t, -s);
+  } else if (face < 1.5) {
+    dir = vec3(-1.0, -t, s);
+  } else if (face < 2.5) {
+    dir = vec3(s, 1.0, t);
+  } else if (face < 3.5) {
+    dir = vec3(s, -1.0, -t);
+  } else if (face < 4.5) {
+    dir = vec3(s, -t, 1.0);
+  } else {
+    dir = vec3(-s, -t, -1.0);
+  }
+  dir = normalize(dir);
+  return inside;
+}
+
+// Change of the ray towards the next pixel along step, taken on the side
+// that does not cross a seam between cube faces or the fisheye's rim.
+vec3 panoramaDifferential(vec2 pixel, vec2 step, vec2 imageSize, mat3 view,
+                          vec3 dir) {
+  vec3 next, previous;
+  panoramaRay(pixel + step, imageSize, view, next);
+  panoramaRay(pixel - step, imageSize, view, previous);
+  vec3 forward = next - dir;
+  vec3 backward = dir - previous;
+  return dot(forward, forward) < dot(backward, backward) ? forward : backward;
+}
+
 // ========== LENS FLARE EFFECT ==========
 vec3 lensFlare(vec2 uv, vec2 lightPos, float intensity) {
     vec2 delta = uv - lightPos;
@@ -416,39 +430,49 @@ float vignette(vec2 uv) {
 }
 
 void main() {
-  mat3 view;
-
-  vec3 cameraPos;
-  vec3 target = vec3(0.0);
-  float fov = fovScale;
-  if (useExternalCamera > 0.5) {
-    cameraPos = externalCameraPos;
-    target = externalTarget;
-    fov = externalFovScale;
-  } else if (mouseControl > 0.5) {
-    vec2 mouse = clamp(vec2(mouseX, mouseY) / resolution.xy, 0.0, 1.0) - 0.5;
-    cameraPos = vec3(-cos(mouse.x * 10.0) * 15.0, mouse.y * 30.0,
-                     sin(mouse.x * 10.0) * 15.0);
-  } else if (frontView > 0.5) {
-    cameraPos = vec3(10.0, 1.0, 10.0);
-  } else if (topView > 0.5) {
-    cameraPos = vec3(15.0, 15.0, 0.0);
-  } else {
-    cameraPos = vec3(-cos(time * 0.1) * 15.0, sin(time * 0.1) * 15.0,
-                     sin(time * 0.1) * 15.0);
+  vec3 cameraPos = latchedPosition.xyz;
+  vec3 target = latchedTarget.xyz;
+  float fov = latchedParams.x;
+  mat3 view = lookAt(cameraPos, target, latchedParams.y);
+
+  vec2 imageSize = posterResolution.x > 0.0 ? posterResolution : resolution;
+  if (projection > 0.5) {
+    // Every direction is traced once, in a single pass over the image;
+    // the ray differentials for the sky's level of detail come from the
+    // neighbouring pixels' rays.
+    vec2 pixel = gl_FragCoord.xy + tileOffset;
+    vec3 dir;
+    bool inside = panoramaRay(pixel, imageSize, view, dir);
+    vec3 color = vec3(0.0);
+    if (inside) {
+      vec3 dDirX =
+          panoramaDifferential(pixel, vec2(1.0, 0.0), imageSize, view, dir);
+      vec3 dDirY =
+          panoramaDifferential(pixel, vec2(0.0, 1.0), imageSize, view, dir);
+      color = traceColor(cameraPos, dir, dDirX, dDirY);
+    }
+    fragColor.rgb = color;
+    skyFeedback = skyRequest;
+    return;
   }
 
-  view = lookAt(cameraPos, target, radians(cameraRoll));
-
-  vec2 uv = gl_FragCoord.xy / resolution.xy - vec2(0.5);
-  float aspect = resolution.x / resolution.y;
+  vec2 uv = (gl_FragCoord.xy + tileOffset) / imageSize - vec2(0.5);
+  float aspect = imageSize.x / imageSize.y;
   uv.x *= aspect;
 
-  vec3 dir = normalize(vec3(-uv.x * fov, uv.y * fov, 1.0));
+  vec3 rayDir = vec3(-uv.x * fov, uv.y * fov, 1.0);
+  vec3 dir = normalize(rayDir);
   vec3 pos = cameraPos;
-  dir = view * dir;
 
-  vec3 color = traceColor(pos, dir);
+  // One pixel moves uv by 1 / imageSize.y on both axes; differentiate the
+  // normalized direction.
+  float pixel = fov / imageSize.y;
+  float invLen = inversesqrt(dot(rayDir, rayDir));
+  vec3 dDirX = (vec3(-pixel, 0.0, 0.0) - dir * (dir.x * -pixel)) * invLen;
+  vec3 dDirY = (vec3(0.0, pixel, 0.0) - dir * (dir.y * pixel)) * invLen;
+
+  dir = view * dir;
+  vec3 color = traceColor(pos, dir, view * dDirX, view * dDirY);
 
   // Apply lens flare from accretion disk (light source at center)
   float distToCenter = length(cameraPos);
@@ -466,4 +490,5 @@ void main() {
   color *= vignette(uv * 0.8);
 
   fragColor.rgb = color;
+  skyFeedback = skyRequest;
 }
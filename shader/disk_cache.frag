@@ -0,0 +1,29 @@
+#version 330 core
+
+// One height layer of DiskCache's emission texture: x is the azimuth in the
+// cache's turning frame, y the distance from the axis across the disk. Holds
+// the emission in rgb and the optical depth in a.
+
+const float PI = 3.14159265359;
+
+in vec2 uv;
+
+out vec4 fragColor;
+
+uniform float time;        // the layer's time
+uniform float layerHeight; // -1 to 1 of adiskHeight
+
+#include "accretion_disk.glsl"
+
+void main() {
+  float azimuth = (uv.x - 0.5) * 2.0 * PI - diskRotation(time);
+  float radius = mix(ADISK_CACHE_RADIUS, ADISK_OUTER_RADIUS, uv.y);
+  vec3 pos = vec3(radius * cos(azimuth), layerHeight * adiskHeight,
+                  radius * sin(azimuth));
+  // A texel's width around and across the disk; the texture cannot hold
+  // finer noise.
+  float footprint =
+      max(abs(dFdx(uv.x)) * 2.0 * PI * radius,
+          abs(dFdy(uv.y)) * (ADISK_OUTER_RADIUS - ADISK_CACHE_RADIUS));
+  fragColor = diskEmission(pos, footprint);
+}
@@ -0,0 +1,54 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aNormal; // w > 0.5 marks the rotating dish parts
+layout (location = 2) in uint aMaterial;
+
+// Per-instance orbit parameters (SatelliteOrbitParams)
+layout (location = 3) in vec4 aOrbit;
+layout (location = 4) in vec4 aOscillation;
+layout (location = 5) in vec4 aAttitude;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float time;
+
+out vec3 vWorldPos;
+out vec3 vNormal;
+out vec3 vLightDir;
+flat out uint vMaterial;
+
+#include "satellite_orbit.glsl"
+
+void main() {
+    vec3 position;
+    vec3 velocity;
+    satelliteOrbit(aOrbit, aOscillation, time, position, velocity);
+    mat4 model = satelliteModel(aAttitude, time, position, velocity);
+
+    vec3 localPos = aPos;
+    vec3 localNormal = aNormal.xyz;
+
+    // Rotate the dish assembly, each probe with its own phase
+    if (aNormal.w > 0.5) {
+        float angle = time * 2.0 + aOscillation.z;
+        float c = cos(angle);
+        float s = sin(angle);
+        mat3 rotY = mat3(
+            c, 0.0, s,
+            0.0, 1.0, 0.0,
+            -s, 0.0, c
+        );
+        localPos = rotY * localPos;
+        localNormal = rotY * localNormal;
+    }
+
+    vec4 worldPos = model * vec4(localPos, 1.0);
+    vWorldPos = worldPos.xyz;
+    // Rotation and uniform scale only, so mat3(model) also transforms normals
+    vNormal = mat3(model) * localNormal;
+    // Lit by the accretion disk at the origin
+    vLightDir = -position;
+    vMaterial = aMaterial;
+
+    gl_Position = projection * view * worldPos;
+}
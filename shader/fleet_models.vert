@@ -0,0 +1,45 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aNormal; // w > 0.5 marks the rotating dish parts
+layout (location = 2) in uint aMaterial;
+
+// Per-instance model matrix from the CPU orbit propagator (orbit.h)
+layout (location = 3) in mat4 aModel;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float time;
+
+out vec3 vWorldPos;
+out vec3 vNormal;
+out vec3 vLightDir;
+flat out uint vMaterial;
+
+void main() {
+    vec3 localPos = aPos;
+    vec3 localNormal = aNormal.xyz;
+
+    // Rotate the dish assembly, each probe with its own phase
+    if (aNormal.w > 0.5) {
+        float angle = time * 2.0 + float(gl_InstanceID) * 1.7;
+        float c = cos(angle);
+        float s = sin(angle);
+        mat3 rotY = mat3(
+            c, 0.0, s,
+            0.0, 1.0, 0.0,
+            -s, 0.0, c
+        );
+        localPos = rotY * localPos;
+        localNormal = rotY * localNormal;
+    }
+
+    vec4 worldPos = aModel * vec4(localPos, 1.0);
+    vWorldPos = worldPos.xyz;
+    // Rotation and uniform scale only, so mat3(aModel) also transforms normals
+    vNormal = mat3(aModel) * localNormal;
+    // Lit by the accretion disk at the origin
+    vLightDir = -aModel[3].xyz;
+    vMaterial = aMaterial;
+
+    gl_Position = projection * view * worldPos;
+}
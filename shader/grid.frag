@@ -2,7 +2,6 @@
 out vec4 FragColor;
 
 in vec3 vWorldPos;
-in vec2 vUV;
 
 void main() {
     // Very dark blue - near black with blue tint
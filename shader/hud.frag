@@ -0,0 +1,11 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 vUV;
+in vec4 vColor;
+
+uniform sampler2D hudTexture;
+
+void main() {
+    FragColor = vColor * texture(hudTexture, vUV);
+}
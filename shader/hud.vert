@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;   // ImDrawVert, in display coordinates
+layout (location = 1) in vec2 aUV;
+layout (location = 2) in vec4 aColor; // normalized from 8-bit RGBA
+
+uniform mat4 projection;
+
+out vec2 vUV;
+out vec4 vColor;
+
+void main() {
+    vUV = aUV;
+    vColor = aColor;
+    gl_Position = projection * vec4(aPos, 0.0, 1.0);
+}
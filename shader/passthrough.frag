@@ -4,8 +4,14 @@ out vec4 fragColor;
 
 uniform vec2 resolution;
 uniform sampler2D texture0;
+uniform sampler2D hudLayer; // premultiplied, at window resolution
+uniform float hudLayerEnabled = 0.0;
 
 void main() {
   vec2 uv = gl_FragCoord.xy / resolution;
   fragColor = texture(texture0, uv);
+  if (hudLayerEnabled > 0.5) {
+    vec4 hud = texelFetch(hudLayer, ivec2(gl_FragCoord.xy), 0);
+    fragColor.rgb = hud.rgb + fragColor.rgb * (1.0 - hud.a);
+  }
 }
\ No newline at end of file
@@ -3,76 +3,52 @@ out vec4 FragColor;
 
 in vec3 vWorldPos;
 in vec3 vNormal;
-in vec3 vLocalPos;
+in vec3 vLightDir; // per instance for the fleet
+flat in uint vMaterial;
 
 uniform vec3 viewPos;
-uniform vec3 lightDir;
 uniform vec3 lightColor;
 uniform vec3 rimColor;
 uniform float rimStrength;
-uniform float time; // For animated effects
 
-// NEW: Environment map for reflections
+// Environment map for reflections
 uniform samplerCube galaxy;
 
-// Material colors
-const vec3 kGoldAlbedo = vec3(1.0, 0.85, 0.4);
-const vec3 kPanelAlbedo = vec3(0.02, 0.025, 0.04);
-const vec3 kPanelFrameAlbedo = vec3(0.6, 0.6, 0.65);
-const vec3 kAntennaAlbedo = vec3(0.85, 0.85, 0.9);
-const vec3 kThrusterAlbedo = vec3(0.15, 0.15, 0.18);
-const vec3 kSensorAlbedo = vec3(0.08, 0.08, 0.1);
+// Material table, indexed by the per-vertex material ID (see SatelliteMaterial
+// in satellite.h): gold body, solar panel, panel frame, antenna, thruster,
+// sensor, antenna beacon, warning light, sensor lens, panel tip.
+const int kMaterialCount = 10;
+
+const vec3 kAlbedo[kMaterialCount] = vec3[](
+    vec3(1.0, 0.85, 0.4), vec3(0.02, 0.025, 0.04), vec3(0.6, 0.6, 0.65),
+    vec3(0.85, 0.85, 0.9), vec3(0.15, 0.15, 0.18), vec3(0.08, 0.08, 0.1),
+    vec3(0.85, 0.85, 0.9), vec3(1.0, 0.85, 0.4), vec3(0.08, 0.08, 0.1),
+    vec3(0.6, 0.6, 0.65));
+
+// x = metallic, y = roughness
+const vec2 kMetallicRoughness[kMaterialCount] = vec2[](
+    vec2(0.95, 0.15), vec2(0.1, 0.5), vec2(0.7, 0.3), vec2(0.9, 0.15),
+    vec2(0.4, 0.6), vec2(0.3, 0.4), vec2(0.9, 0.15), vec2(0.95, 0.15),
+    vec2(0.3, 0.4), vec2(0.7, 0.3));
+
+// Tinted specular sheen, only the solar cells have one (slight blue).
+const vec3 kSheen[kMaterialCount] = vec3[](
+    vec3(0.0), vec3(0.0, 0.02, 0.08), vec3(0.0), vec3(0.0), vec3(0.0),
+    vec3(0.0), vec3(0.0), vec3(0.0), vec3(0.0), vec3(0.0));
+
+// Animated indicator light emission per material, updated once per frame.
+uniform vec3 emission[kMaterialCount];
 
 void main() {
     vec3 n = normalize(vNormal);
-    vec3 l = normalize(lightDir);
+    vec3 l = normalize(vLightDir);
     vec3 v = normalize(viewPos - vWorldPos);
     vec3 h = normalize(l + v);
 
-    // Determine material based on position
-    float absX = abs(vLocalPos.x);
-    float absY = abs(vLocalPos.y);
-    float absZ = abs(vLocalPos.z);
-
-    // Material classification
-    bool isSolarPanel = absX > 0.6 && absY < 0.08;
-    bool isPanelFrame = absX > 0.6 && absY >= 0.08 && absY < 0.15;
-    bool isAntenna = absY > 0.4 || (absY > 0.25 && (absX < 0.2 || absZ > 0.15));
-    bool isThruster = vLocalPos.y < -0.25;
-    bool isSensor = absZ > 0.35;
-    bool isMainBody = absX < 0.4 && absY < 0.3 && absZ < 0.35;
-
     // Select material properties
-    vec3 baseColor;
-    float metallic;
-    float roughness;
-
-    if (isSolarPanel) {
-        baseColor = kPanelAlbedo;
-        metallic = 0.1;
-        roughness = 0.5;
-    } else if (isPanelFrame) {
-        baseColor = kPanelFrameAlbedo;
-        metallic = 0.7;
-        roughness = 0.3;
-    } else if (isThruster) {
-        baseColor = kThrusterAlbedo;
-        metallic = 0.4;
-        roughness = 0.6;
-    } else if (isSensor) {
-        baseColor = kSensorAlbedo;
-        metallic = 0.3;
-        roughness = 0.4;
-    } else if (isAntenna) {
-        baseColor = kAntennaAlbedo;
-        metallic = 0.9;
-        roughness = 0.15;
-    } else {
-        // Main body - gold foil
-        baseColor = kGoldAlbedo;
-        metallic = 0.95; // Increased metallic for better reflections
-        roughness = 0.15; // Smoother for better reflections
-    }
+    vec3 baseColor = kAlbedo[vMaterial];
+    float metallic = kMetallicRoughness[vMaterial].x;
+    float roughness = kMetallicRoughness[vMaterial].y;
 
     // Lighting calculations
     float NdotL = max(dot(n, l), 0.0);
@@ -94,10 +70,7 @@ void main() {
     rim *= smoothstep(-0.2, 0.5, NdotL);
 
     // Solar panel special effect - slight blue reflection
-    if (isSolarPanel) {
-        float panelReflect = pow(NdotH, 32.0) * 0.3;
-        baseColor += vec3(0.0, 0.02, 0.08) * panelReflect;
-    }
+    baseColor += kSheen[vMaterial] * pow(NdotH, 32.0) * 0.3;
 
     // Environment Reflection
     vec3 reflectionDir = reflect(-v, n);
@@ -117,9 +90,6 @@ void main() {
     vec3 diffusePortion = baseColor * diff * kD;
     vec3 specularPortion = (envColor * kS) + (lightColor * spec); // simplified IBL + analytic spec
 
-    // Add rim
-    // rim should be additive
-
     vec3 color = diffusePortion + specularPortion;
     color += rimColor * rim * (0.5 + metallic * 0.5);
     color *= lightColor;
@@ -127,39 +97,8 @@ void main() {
     // Ambient (simplified IBL ambient)
     color += baseColor * 0.02 * envColor;
 
-    // ========== ANIMATED INDICATOR LIGHTS ==========
-
-    // Blue beacon light on antenna tips (fast blink)
-    if (isAntenna && absY > 0.45) {
-        float blueBlink = smoothstep(0.4, 0.6, sin(time * 6.0) * 0.5 + 0.5);
-        color += vec3(0.3, 0.7, 1.0) * 3.0 * blueBlink;
-    }
-
-    // Red warning light on body corners (slow pulse)
-    bool isCorner = absX > 0.25 && absZ > 0.25 && absY < 0.1 && absY > -0.1;
-    if (isCorner) {
-        float redPulse = smoothstep(0.3, 0.7, sin(time * 2.0) * 0.5 + 0.5);
-        color += vec3(1.0, 0.1, 0.05) * 2.5 * redPulse;
-    }
-
-    // Green status light on sensor package (steady with occasional flicker)
-    if (isSensor && absZ > 0.4) {
-        float greenFlicker = 0.7 + 0.3 * sin(time * 15.0 + sin(time * 3.0) * 5.0);
-        color += vec3(0.1, 1.0, 0.3) * 1.5 * greenFlicker;
-    }
-
-    // White strobe on solar panel tips (very fast strobe)
-    bool isPanelTip = absX > 1.8 && absY < 0.05;
-    if (isPanelTip) {
-        float strobe = step(0.9, fract(time * 4.0));
-        color += vec3(1.0, 1.0, 1.0) * 4.0 * strobe;
-    }
-
-    // Thruster glow (orange pulsing when active)
-    if (isThruster && vLocalPos.y < -0.28) {
-        float thrusterGlow = 0.3 + 0.7 * (sin(time * 8.0) * 0.5 + 0.5);
-        color += vec3(1.0, 0.5, 0.1) * 2.0 * thrusterGlow;
-    }
+    // Animated indicator lights
+    color += emission[vMaterial];
 
     FragColor = vec4(color, 1.0);
 }
@@ -1,23 +1,26 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in vec4 aNormal; // w > 0.5 marks the rotating dish parts
+layout (location = 2) in uint aMaterial;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform mat3 normalMatrix; // transpose(inverse(mat3(model))), computed on the CPU
 uniform float dishRotation;
+uniform vec3 lightDir;
 
 out vec3 vWorldPos;
 out vec3 vNormal;
-out vec3 vLocalPos;
+out vec3 vLightDir;
+flat out uint vMaterial;
 
 void main() {
     vec3 localPos = aPos;
-    vec3 localNormal = aNormal;
-    
-    // Rotate dish locally if it is the top part (y > 0.3)
-    // The dish parts are generally above 0.25 in local Y
-    if (aPos.y > 0.25) {
+    vec3 localNormal = aNormal.xyz;
+
+    // Rotate the dish assembly locally around the body axis
+    if (aNormal.w > 0.5) {
         float angle = dishRotation;
         float c = cos(angle);
         float s = sin(angle);
@@ -32,10 +35,9 @@ void main() {
 
     vec4 worldPos = model * vec4(localPos, 1.0);
     vWorldPos = worldPos.xyz;
-    vLocalPos = localPos; // Pass transformed local pos to frag for correct material masking if needed, though mostly material is static relative to parts
-
-    mat3 normalMatrix = mat3(transpose(inverse(model)));
     vNormal = normalMatrix * localNormal;
+    vLightDir = lightDir;
+    vMaterial = aMaterial;
 
     gl_Position = projection * view * worldPos;
 }
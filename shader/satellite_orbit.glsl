@@ -0,0 +1,66 @@
+// Orbit and attitude of one satellite instance, mirroring
+// computeSatelliteOrbit() and computeSatelliteModel() in satellite.cpp.
+// Parameters are packed as in SatelliteOrbitParams (fleet.h), angles in
+// radians:
+//   orbit       = (semi-major axis, eccentricity, inclination, angular speed)
+//   oscillation = (vertical amplitude, vertical frequency, phase, node longitude)
+//   attitude    = (self-spin speed, wobble amplitude, wobble speed, scale)
+
+void satelliteOrbit(vec4 orbit, vec4 oscillation, float time,
+                    out vec3 position, out vec3 velocity) {
+  float e = orbit.y;
+  float angle = time * orbit.w + oscillation.z;
+  float cosA = cos(angle);
+  float sinA = sin(angle);
+
+  // Ellipse r = a(1-e^2) / (1 + e*cos(angle)) and its derivative.
+  float p = orbit.x * (1.0 - e * e);
+  float denom = 1.0 + e * cosA;
+  float r = p / denom;
+  float drdA = p * e * sinA / (denom * denom);
+
+  vec2 planar = r * vec2(cosA, sinA);
+  vec2 dPlanar = (drdA * vec2(cosA, sinA) + r * vec2(-sinA, cosA)) * orbit.w;
+
+  // Inclined plane plus a slow vertical oscillation.
+  float sinI = sin(orbit.z);
+  float cosI = cos(orbit.z);
+  float vt = time * oscillation.y + oscillation.z;
+  vec3 pos = vec3(planar.x, planar.y * sinI + oscillation.x * sin(vt),
+                  planar.y * cosI);
+  vec3 vel = vec3(dPlanar.x,
+                  dPlanar.y * sinI + oscillation.x * oscillation.y * cos(vt),
+                  dPlanar.y * cosI);
+
+  // Rotate the orbital plane around the y axis by the node longitude.
+  float cosN = cos(oscillation.w);
+  float sinN = sin(oscillation.w);
+  mat3 node = mat3(cosN, 0.0, -sinN, 0.0, 1.0, 0.0, sinN, 0.0, cosN);
+  position = node * pos;
+  velocity = node * vel;
+}
+
+mat4 satelliteModel(vec4 attitude, float time, vec3 position, vec3 velocity) {
+  // Face the direction of motion.
+  vec3 forward = normalize(velocity);
+  vec3 right = normalize(cross(vec3(0.0, 1.0, 0.0), forward));
+  vec3 up = cross(forward, right);
+  mat3 orientation = mat3(right, up, forward);
+
+  // Slight wobble around x and z, then self-spin around y.
+  float wobble = attitude.y * sin(time * attitude.z);
+  float cx = cos(wobble);
+  float sx = sin(wobble);
+  mat3 wobbleX = mat3(1.0, 0.0, 0.0, 0.0, cx, sx, 0.0, -sx, cx);
+  float cz = cos(wobble * 0.7);
+  float sz = sin(wobble * 0.7);
+  mat3 wobbleZ = mat3(cz, sz, 0.0, -sz, cz, 0.0, 0.0, 0.0, 1.0);
+  float spin = time * attitude.x;
+  float cy = cos(spin);
+  float sy = sin(spin);
+  mat3 spinY = mat3(cy, 0.0, -sy, 0.0, 1.0, 0.0, sy, 0.0, cy);
+
+  mat3 r = orientation * wobbleX * wobbleZ * spinY * attitude.w;
+  return mat4(vec4(r[0], 0.0), vec4(r[1], 0.0), vec4(r[2], 0.0),
+              vec4(position, 1.0));
+}
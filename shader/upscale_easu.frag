@@ -0,0 +1,146 @@
+#version 330 core
+
+// Edge-adaptive spatial upsampling, after AMD FidelityFX Super Resolution 1.0
+// "EASU". A 12-tap filter around the output pixel analyses the luma gradient
+// to estimate the local edge direction and strength, then reconstructs with a
+// Lanczos-like kernel stretched along the edge. The result is clamped to the
+// nearest 2x2 input texels to avoid ringing.
+//
+//        b c
+//      e f g h
+//      i j k l
+//        n o
+
+out vec4 fragColor;
+
+uniform vec2 resolution; // output resolution in pixels
+uniform sampler2D texture0; // tonemapped LDR input at render resolution
+
+vec3 fetch(ivec2 p, ivec2 maxCoord) {
+  return texelFetch(texture0, clamp(p, ivec2(0), maxCoord), 0).rgb;
+}
+
+// Approximate luma, scaled by 2 as in the reference implementation.
+float luma(vec3 c) { return c.g + 0.5 * (c.r + c.b); }
+
+// Accumulate direction and edge length for one of the four bilinear corners.
+//
+//      a
+//    b c d
+//      e
+void easuSet(inout vec2 dir, inout float len, float w, float lA, float lB,
+             float lC, float lD, float lE) {
+  float dc = lD - lC;
+  float cb = lC - lB;
+  float lenX = max(abs(dc), abs(cb));
+  float dirX = lD - lB;
+  lenX = clamp(abs(dirX) / max(lenX, 1.0e-5), 0.0, 1.0);
+  lenX *= lenX;
+
+  float ec = lE - lC;
+  float ca = lC - lA;
+  float lenY = max(abs(ec), abs(ca));
+  float dirY = lE - lA;
+  lenY = clamp(abs(dirY) / max(lenY, 1.0e-5), 0.0, 1.0);
+  lenY *= lenY;
+
+  dir += vec2(dirX, dirY) * w;
+  len += (lenX + lenY) * w;
+}
+
+void easuTap(inout vec3 aC, inout float aW, vec2 off, vec2 dir, vec2 len,
+             float lob, float clp, vec3 c) {
+  // Rotate the offset into the edge-aligned frame and apply anisotropy.
+  vec2 v = vec2(dot(off, dir), dot(off, vec2(-dir.y, dir.x))) * len;
+  float d2 = min(dot(v, v), clp);
+
+  // Polynomial approximation of a windowed Lanczos2 kernel.
+  float wB = 0.4 * d2 - 1.0;
+  float wA = lob * d2 - 1.0;
+  wB *= wB;
+  wA *= wA;
+  wB = 1.5625 * wB - 0.5625;
+  float w = wB * wA;
+
+  aC += c * w;
+  aW += w;
+}
+
+void main() {
+  ivec2 inputSize = textureSize(texture0, 0);
+  ivec2 maxCoord = inputSize - ivec2(1);
+
+  // Position of the output pixel center in input texel space.
+  vec2 pp = gl_FragCoord.xy * (vec2(inputSize) / resolution) - vec2(0.5);
+  vec2 fp = floor(pp);
+  pp -= fp;
+  ivec2 f0 = ivec2(fp);
+
+  vec3 bC = fetch(f0 + ivec2(0, -1), maxCoord);
+  vec3 cC = fetch(f0 + ivec2(1, -1), maxCoord);
+  vec3 eC = fetch(f0 + ivec2(-1, 0), maxCoord);
+  vec3 fC = fetch(f0 + ivec2(0, 0), maxCoord);
+  vec3 gC = fetch(f0 + ivec2(1, 0), maxCoord);
+  vec3 hC = fetch(f0 + ivec2(2, 0), maxCoord);
+  vec3 iC = fetch(f0 + ivec2(-1, 1), maxCoord);
+  vec3 jC = fetch(f0 + ivec2(0, 1), maxCoord);
+  vec3 kC = fetch(f0 + ivec2(1, 1), maxCoord);
+  vec3 lC = fetch(f0 + ivec2(2, 1), maxCoord);
+  vec3 nC = fetch(f0 + ivec2(0, 2), maxCoord);
+  vec3 oC = fetch(f0 + ivec2(1, 2), maxCoord);
+
+  float bL = luma(bC);
+  float cL = luma(cC);
+  float eL = luma(eC);
+  float fL = luma(fC);
+  float gL = luma(gC);
+  float hL = luma(hC);
+  float iL = luma(iC);
+  float jL = luma(jC);
+  float kL = luma(kC);
+  float lL = luma(lC);
+  float nL = luma(nC);
+  float oL = luma(oC);
+
+  // Edge direction and length, bilinearly weighted over the 2x2 quad.
+  vec2 dir = vec2(0.0);
+  float len = 0.0;
+  easuSet(dir, len, (1.0 - pp.x) * (1.0 - pp.y), bL, eL, fL, gL, jL);
+  easuSet(dir, len, pp.x * (1.0 - pp.y), cL, fL, gL, hL, kL);
+  easuSet(dir, len, (1.0 - pp.x) * pp.y, fL, iL, jL, kL, nL);
+  easuSet(dir, len, pp.x * pp.y, gL, jL, kL, lL, oL);
+
+  // Normalize the direction, falling back to the x axis on flat regions.
+  float dirR = dot(dir, dir);
+  bool zro = dirR < 1.0 / 32768.0;
+  dir = zro ? vec2(1.0, 0.0) : dir * inversesqrt(dirR);
+
+  // Shape the kernel: stretch along the edge, shrink across it, and sharpen
+  // the negative lobe on strong edges.
+  len = len * 0.5;
+  len *= len;
+  float stretch = dot(dir, dir) / max(abs(dir.x), abs(dir.y));
+  vec2 len2 = vec2(1.0 + (stretch - 1.0) * len, 1.0 - 0.5 * len);
+  float lob = 0.5 + ((1.0 / 4.0 - 0.04) - 0.5) * len;
+  float clp = 1.0 / lob;
+
+  vec3 aC = vec3(0.0);
+  float aW = 0.0;
+  easuTap(aC, aW, vec2(0.0, -1.0) - pp, dir, len2, lob, clp, bC);
+  easuTap(aC, aW, vec2(1.0, -1.0) - pp, dir, len2, lob, clp, cC);
+  easuTap(aC, aW, vec2(-1.0, 1.0) - pp, dir, len2, lob, clp, iC);
+  easuTap(aC, aW, vec2(0.0, 1.0) - pp, dir, len2, lob, clp, jC);
+  easuTap(aC, aW, vec2(0.0, 0.0) - pp, dir, len2, lob, clp, fC);
+  easuTap(aC, aW, vec2(-1.0, 0.0) - pp, dir, len2, lob, clp, eC);
+  easuTap(aC, aW, vec2(1.0, 1.0) - pp, dir, len2, lob, clp, kC);
+  easuTap(aC, aW, vec2(2.0, 1.0) - pp, dir, len2, lob, clp, lC);
+  easuTap(aC, aW, vec2(2.0, 0.0) - pp, dir, len2, lob, clp, hC);
+  easuTap(aC, aW, vec2(1.0, 0.0) - pp, dir, len2, lob, clp, gC);
+  easuTap(aC, aW, vec2(1.0, 2.0) - pp, dir, len2, lob, clp, oC);
+  easuTap(aC, aW, vec2(0.0, 2.0) - pp, dir, len2, lob, clp, nC);
+
+  // Deringing: clamp to the range of the nearest 2x2 input texels.
+  vec3 min4 = min(min(fC, gC), min(jC, kC));
+  vec3 max4 = max(max(fC, gC), max(jC, kC));
+  fragColor = vec4(clamp(aC / aW, min4, max4), 1.0);
+}
@@ -0,0 +1,51 @@
+#version 330 core
+
+// Robust contrast-adaptive sharpening, after AMD FidelityFX Super Resolution
+// 1.0 "RCAS". Applies a 5-tap cross sharpening lobe whose strength is limited
+// per pixel so that the result never leaves the local min/max, which keeps the
+// upscaled image crisp without halos.
+//
+//      b
+//    d e f
+//      h
+
+out vec4 fragColor;
+
+uniform vec2 resolution;
+uniform sampler2D texture0; // EASU output at window resolution
+uniform float sharpness = 0.2; // in stops, 0.0 is the strongest
+uniform sampler2D hudLayer; // premultiplied, composited after sharpening
+uniform float hudLayerEnabled = 0.0;
+
+// Upper bound of the sharpening lobe, 0.25 - 1/16 as in the reference.
+const float RCAS_LIMIT = 0.1875;
+
+void main() {
+  ivec2 maxCoord = textureSize(texture0, 0) - ivec2(1);
+  ivec2 sp = ivec2(gl_FragCoord.xy);
+
+  vec3 b = texelFetch(texture0, clamp(sp + ivec2(0, -1), ivec2(0), maxCoord), 0).rgb;
+  vec3 d = texelFetch(texture0, clamp(sp + ivec2(-1, 0), ivec2(0), maxCoord), 0).rgb;
+  vec3 e = texelFetch(texture0, clamp(sp, ivec2(0), maxCoord), 0).rgb;
+  vec3 f = texelFetch(texture0, clamp(sp + ivec2(1, 0), ivec2(0), maxCoord), 0).rgb;
+  vec3 h = texelFetch(texture0, clamp(sp + ivec2(0, 1), ivec2(0), maxCoord), 0).rgb;
+
+  vec3 mn4 = min(min(b, d), min(f, h));
+  vec3 mx4 = max(max(b, d), max(f, h));
+
+  // Largest negative lobe that keeps the output inside [0, 1] given the ring.
+  vec3 hitMin = min(mn4, e) / (4.0 * mx4 + 1.0e-5);
+  vec3 hitMax = (1.0 - max(mx4, e)) / (4.0 * mn4 - 4.0 - 1.0e-5);
+  vec3 lobeRGB = max(-hitMin, hitMax);
+  float lobe = max(-RCAS_LIMIT,
+                   min(max(lobeRGB.r, max(lobeRGB.g, lobeRGB.b)), 0.0)) *
+               exp2(-sharpness);
+
+  vec3 c = (lobe * (b + d + f + h) + e) / (4.0 * lobe + 1.0);
+  c = clamp(c, 0.0, 1.0);
+  if (hudLayerEnabled > 0.5) {
+    vec4 hud = texelFetch(hudLayer, sp, 0);
+    c = hud.rgb + c * (1.0 - hud.a);
+  }
+  fragColor = vec4(c, 1.0);
+}
@@ -0,0 +1,51 @@
+// Virtual-textured sky streamed by VirtualSky (virtual_sky.cpp). The six cube
+// faces are a pyramid of tiles. vtIndirection has one layer per face and one
+// mip level per pyramid level; each texel names the cache slot of the finest
+// resident tile covering that tile (x, y = slot, z = the tile's level).
+// vtCache holds the resident tiles, each with a filtering border.
+
+uniform usampler2DArray vtIndirection;
+uniform sampler2D vtCache;
+uniform vec4 vtParams; // faceSize, tileSize, border, levelCount
+
+// Face and face coordinates as picked by a cubemap lookup, so that the tiles
+// line up with the faces loadCubemap() would upload (t = 0 on the first row).
+vec2 cubeFaceCoord(vec3 dir, out int face) {
+  vec3 a = abs(dir);
+  vec2 sc;
+  float ma;
+  if (a.x >= a.y && a.x >= a.z) {
+    face = dir.x > 0.0 ? 0 : 1;
+    ma = a.x;
+    sc = vec2(dir.x > 0.0 ? -dir.z : dir.z, -dir.y);
+  } else if (a.y >= a.z) {
+    face = dir.y > 0.0 ? 2 : 3;
+    ma = a.y;
+    sc = vec2(dir.x, dir.y > 0.0 ? dir.z : -dir.z);
+  } else {
+    face = dir.z > 0.0 ? 4 : 5;
+    ma = a.z;
+    sc = vec2(dir.z > 0.0 ? dir.x : -dir.x, -dir.y);
+  }
+  return clamp(0.5 * sc / ma + 0.5, 0.0, 0.99999);
+}
+
+// Samples the sky at lod (log2 of the footprint in level 0 texels) from the
+// finest resident tile and returns the tile it wanted in request, encoded for
+// the feedback buffer as (x, y, face | level << 3, 1).
+vec3 sampleVirtualSky(vec3 dir, float lod, out uvec4 request) {
+  int levelCount = int(vtParams.w);
+  int face;
+  vec2 st = cubeFaceCoord(dir, face);
+  int level = clamp(int(lod + 0.5), 0, levelCount - 1);
+  ivec2 tile = ivec2(st * float(1 << (levelCount - 1 - level)));
+  request = uvec4(uvec2(tile), uint(face | (level << 3)), 1u);
+
+  uvec4 entry = texelFetch(vtIndirection, ivec3(tile, face), level);
+  float tileSize = vtParams.y;
+  float border = vtParams.z;
+  vec2 inTile = fract(st * float(1 << (levelCount - 1 - int(entry.z))));
+  vec2 texel = vec2(entry.xy) * (tileSize + 2.0 * border) + border +
+               inTile * tileSize;
+  return textureLod(vtCache, texel / vec2(textureSize(vtCache, 0)), 0.0).rgb;
+}
@@ -0,0 +1,387 @@
+#include "asset_loader.h"
+#include "texture.h"
+
+#include <cstring>
+#include <stdio.h>
+
+#include <stb_image.h>
+
+namespace {
+
+const char *const kCubemapFaces[6] = {"right",  "left",  "top",
+                                      "bottom", "front", "back"};
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void setTextureParameters(GLenum target, bool repeat, bool mipmaps) {
+  GLint wrap = repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+  if (target == GL_TEXTURE_CUBE_MAP) {
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, wrap);
+  }
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER,
+                  mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+} // namespace
+
+AssetLoader::Image::~Image() { stbi_image_free(pixels); }
+
+AssetLoader::AssetLoader(const AssetLoaderCreateInfo &info, ThreadPool &pool)
+    : info(info), pool(pool), shared(std::make_shared<Shared>()) {}
+
+AssetLoader::~AssetLoader() { shutdown(); }
+
+void AssetLoader::shutdown() {
+  std::deque<std::shared_ptr<Image>> copied;
+  {
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->copiesDone.wait(lock,
+                            [this] { return shared->copiesInFlight == 0; });
+    copied.swap(shared->copied);
+    shared->decoded.clear();
+  }
+
+  // Buffers filled but not uploaded yet are still mapped.
+  for (const std::shared_ptr<Image> &image : copied) {
+    if (image->pbo == 0) {
+      continue;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image->pbo);
+    if (image->mapped) {
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      image->mapped = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &image->pbo);
+    image->pbo = 0;
+    mappedBytes -= image->bytes;
+  }
+
+  for (Asset &asset : assets) {
+    if (asset.texture != 0) {
+      glDeleteTextures(1, &asset.texture);
+      asset.texture = 0;
+    }
+    if (asset.placeholder != 0) {
+      glDeleteTextures(1, &asset.placeholder);
+      asset.placeholder = 0;
+    }
+  }
+}
+
+int AssetLoader::addAsset(const std::string &name, GLenum target, bool repeat,
+                          const glm::vec3 &placeholder) {
+  Asset asset;
+  asset.name = name;
+  asset.target = target;
+  asset.repeat = repeat;
+  asset.requested = Clock::now();
+
+  unsigned char texel[3];
+  for (int c = 0; c < 3; c++) {
+    texel[c] = (unsigned char)(glm::clamp(placeholder[c], 0.0f, 1.0f) * 255.0f +
+                               0.5f);
+  }
+  glGenTextures(1, &asset.placeholder);
+  glBindTexture(target, asset.placeholder);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (target == GL_TEXTURE_CUBE_MAP) {
+    for (GLenum face = 0; face < 6; face++) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_SRGB, 1, 1, 0,
+                   GL_RGB, GL_UNSIGNED_BYTE, texel);
+    }
+  } else {
+    glTexImage2D(target, 0, GL_SRGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, texel);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  setTextureParameters(target, repeat, false);
+  glBindTexture(target, 0);
+
+  assets.push_back(asset);
+  return (int)assets.size() - 1;
+}
+
+void AssetLoader::startDecode(const std::shared_ptr<Image> &image) {
+  std::shared_ptr<Shared> s = shared;
+  pool.submit([s, image] {
+    Clock::time_point start = Clock::now();
+    int comp = 0;
+    image->pixels = stbi_load(image->file.c_str(), &image->width,
+                              &image->height, &comp, 0);
+    if (image->pixels &&
+        getImageFormat(comp, image->format, image->internalFormat)) {
+      image->source = image->pixels;
+      image->bytes = (size_t)image->width * image->height * comp;
+    }
+    image->decodeMs = millisecondsSince(start);
+
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->decoded.push_back(image);
+  });
+}
+
+// Queues every image of the packed container for the asset straight for
+// upload. Only maps the file and reads the header on this thread; the pages
+// are faulted in by the pool copies.
+bool AssetLoader::requestPacked(int id) {
+  Asset &asset = assets[id];
+  PackedTexture packed;
+  if (!readPackedTexture(packedTexturePath(asset.name), packed)) {
+    return false;
+  }
+  // A 2D texture needs one face and a cubemap six, and upload() sends
+  // uncompressed images as GL_UNSIGNED_BYTE.
+  uint32_t faceCount = asset.target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+  uint32_t type = packed.compressed() ? 0 : GL_UNSIGNED_BYTE;
+  if (packed.header.faceCount != faceCount || packed.header.type != type ||
+      !isPackedTextureSupported(packed)) {
+    printf("WARNING: Unusable packed texture for %s, decoding the source "
+           "instead\n",
+           asset.name.c_str());
+    return false;
+  }
+
+  asset.packed = true;
+  asset.levelCount = (int)packed.header.levelCount;
+  asset.imageCount = (int)(packed.header.levelCount * faceCount);
+  GLenum faceTarget = asset.target == GL_TEXTURE_CUBE_MAP
+                          ? GL_TEXTURE_CUBE_MAP_POSITIVE_X
+                          : asset.target;
+
+  std::lock_guard<std::mutex> lock(shared->mutex);
+  for (int level = 0; level < asset.levelCount; level++) {
+    for (int face = 0; face < (int)faceCount; face++) {
+      auto image = std::make_shared<Image>();
+      image->asset = id;
+      image->target = faceTarget + face;
+      image->level = level;
+      image->file = packedTexturePath(asset.name);
+      image->width = packed.levelWidth(level);
+      image->height = packed.levelHeight(level);
+      image->internalFormat = packed.header.internalFormat;
+      image->format = packed.header.format;
+      image->mapping = packed.file;
+      image->source = packed.imageData(face, level);
+      image->bytes = (size_t)packed.image(face, level).size;
+      shared->decoded.push_back(image);
+    }
+  }
+  return true;
+}
+
+int AssetLoader::requestTexture2D(const std::string &file, bool repeat,
+                                  const glm::vec3 &placeholder) {
+  int id = addAsset(file, GL_TEXTURE_2D, repeat, placeholder);
+  if (requestPacked(id)) {
+    return id;
+  }
+  assets[id].imageCount = 1;
+
+  auto image = std::make_shared<Image>();
+  image->asset = id;
+  image->target = GL_TEXTURE_2D;
+  image->file = file;
+  startDecode(image);
+  return id;
+}
+
+int AssetLoader::requestCubemap(const std::string &cubemapDir,
+                                const glm::vec3 &placeholder) {
+  int id = addAsset(cubemapDir, GL_TEXTURE_CUBE_MAP, false, placeholder);
+  if (requestPacked(id)) {
+    return id;
+  }
+  assets[id].imageCount = 6;
+
+  for (GLenum face = 0; face < 6; face++) {
+    auto image = std::make_shared<Image>();
+    image->asset = id;
+    image->target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+    image->file = cubemapDir + "/" + kCubemapFaces[face] + ".png";
+    startDecode(image);
+  }
+  return id;
+}
+
+GLuint AssetLoader::texture(int asset) const {
+  const Asset &a = assets[asset];
+  return a.ready ? a.texture : a.placeholder;
+}
+
+bool AssetLoader::ready(int asset) const { return assets[asset].ready; }
+
+bool AssetLoader::idle() const {
+  for (const Asset &asset : assets) {
+    if (asset.uploaded < asset.imageCount) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void AssetLoader::update() {
+  std::vector<std::shared_ptr<Image>> toMap;
+  std::vector<std::shared_ptr<Image>> toUpload;
+  {
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    toUpload.assign(shared->copied.begin(), shared->copied.end());
+    shared->copied.clear();
+  }
+
+  // Upload first, which unmaps buffers and frees room in the budget.
+  for (const std::shared_ptr<Image> &image : toUpload) {
+    upload(*image);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    while (!shared->decoded.empty()) {
+      size_t bytes = shared->decoded.front()->bytes;
+      if (mappedBytes > 0 && mappedBytes + bytes > info.maxMappedBytes) {
+        break;
+      }
+      mappedBytes += bytes;
+      toMap.push_back(shared->decoded.front());
+      shared->decoded.pop_front();
+    }
+  }
+
+  for (const std::shared_ptr<Image> &image : toMap) {
+    if (!image->source) {
+      printf("ERROR: Failed to load texture at: %s\n", image->file.c_str());
+      assets[image->asset].failed = true;
+      mappedBytes -= image->bytes;
+      upload(*image);
+      continue;
+    }
+
+    glGenBuffers(1, &image->pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image->pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, image->bytes, nullptr,
+                 GL_STREAM_DRAW);
+    image->mapped = glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, image->bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!image->mapped) {
+      // Let the driver copy instead.
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image->pbo);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, image->bytes, image->source,
+                   GL_STREAM_DRAW);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      upload(*image);
+      continue;
+    }
+
+    // The copy into the mapped buffer runs on the pool; no GL calls there.
+    std::shared_ptr<Shared> s = shared;
+    {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->copiesInFlight++;
+    }
+    pool.submit([s, image] {
+      Clock::time_point start = Clock::now();
+      memcpy(image->mapped, image->source, image->bytes);
+      image->copyMs = millisecondsSince(start);
+      stbi_image_free(image->pixels);
+      image->pixels = nullptr;
+      image->mapping.reset();
+      image->source = nullptr;
+
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->copied.push_back(image);
+      if (--s->copiesInFlight == 0) {
+        s->copiesDone.notify_all();
+      }
+    });
+  }
+}
+
+void AssetLoader::upload(Image &image) {
+  Asset &asset = assets[image.asset];
+  Clock::time_point start = Clock::now();
+
+  if (image.pbo) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image.pbo);
+    if (image.mapped && glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+      // The buffer contents were lost (e.g. a display mode change).
+      printf("ERROR: Lost pixel buffer while uploading: %s\n",
+             image.file.c_str());
+      asset.failed = true;
+    }
+    image.mapped = nullptr;
+
+    if (!asset.failed) {
+      if (asset.texture == 0) {
+        glGenTextures(1, &asset.texture);
+      }
+      // Sources the pixels from the bound unpack buffer, so the call returns
+      // without waiting for the transfer.
+      glBindTexture(asset.target, asset.texture);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      if (image.format == 0) {
+        glCompressedTexImage2D(image.target, image.level, image.internalFormat,
+                               image.width, image.height, 0,
+                               (GLsizei)image.bytes, (void *)0);
+      } else {
+        glTexImage2D(image.target, image.level, image.internalFormat,
+                     image.width, image.height, 0, image.format,
+                     GL_UNSIGNED_BYTE, (void *)0);
+      }
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+      glBindTexture(asset.target, 0);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &image.pbo);
+    image.pbo = 0;
+    mappedBytes -= image.bytes;
+  }
+
+  asset.decodeMs += image.decodeMs;
+  asset.copyMs += image.copyMs;
+  asset.uploadMs += millisecondsSince(start);
+  if (++asset.uploaded == asset.imageCount) {
+    finish(asset);
+  }
+}
+
+void AssetLoader::finish(Asset &asset) {
+  if (asset.failed) {
+    // Keep drawing with the placeholder.
+    glDeleteTextures(1, &asset.texture);
+    asset.texture = 0;
+    return;
+  }
+
+  Clock::time_point start = Clock::now();
+  // Every texture gets a mip chain: packed ones bring theirs, PNGs, the sky
+  // cubemap included, have one generated here. The ray marcher reads the
+  // sky's levels explicitly where lensing minifies it.
+  bool mipmaps = !asset.packed || asset.levelCount > 1;
+  glBindTexture(asset.target, asset.texture);
+  setTextureParameters(asset.target, asset.repeat, mipmaps);
+  if (asset.packed) {
+    glTexParameteri(asset.target, GL_TEXTURE_MAX_LEVEL, asset.levelCount - 1);
+  } else if (mipmaps) {
+    glGenerateMipmap(asset.target);
+  }
+  glBindTexture(asset.target, 0);
+  asset.uploadMs += millisecondsSince(start);
+
+  glDeleteTextures(1, &asset.placeholder);
+  asset.placeholder = 0;
+  asset.ready = true;
+
+  printf("Loaded %s%s: decode %.1f ms, copy %.1f ms (pool, %d images), "
+         "upload %.1f ms (GL thread), ready %.1f ms after request\n",
+         asset.name.c_str(), asset.packed ? " (packed)" : "", asset.decodeMs,
+         asset.copyMs, asset.imageCount, asset.uploadMs,
+         millisecondsSince(asset.requested));
+}
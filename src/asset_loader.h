@@ -0,0 +1,129 @@
+
+
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "parallel.h"
+#include "texture_pack.h"
+
+struct AssetLoaderCreateInfo {
+  // Upper bound on pixel-unpack buffer memory mapped at any one time.
+  size_t maxMappedBytes = (size_t)256 << 20;
+};
+
+// Streams textures in without stalling the render thread. Images are decoded
+// with stb_image on the thread pool, copied by the pool into mapped
+// pixel-unpack buffers and handed to GL from there, so the render thread only
+// maps, unmaps and issues asynchronous texture uploads. Until every image of
+// an asset is uploaded, texture() returns a 1x1 placeholder.
+//
+// When a packed container (texture_pack.h) sits next to the source, its
+// faces and mip levels are copied straight from the memory-mapped file and
+// nothing is decoded.
+class AssetLoader {
+public:
+  explicit AssetLoader(
+      const AssetLoaderCreateInfo &info = AssetLoaderCreateInfo(),
+      ThreadPool &pool = ThreadPool::shared());
+  ~AssetLoader();
+
+  AssetLoader(const AssetLoader &) = delete;
+  AssetLoader &operator=(const AssetLoader &) = delete;
+
+  // Start loading and return an asset ID. The placeholder is an sRGB color.
+  int requestTexture2D(const std::string &file, bool repeat = true,
+                       const glm::vec3 &placeholder = glm::vec3(0.5f));
+  int requestCubemap(const std::string &cubemapDir,
+                     const glm::vec3 &placeholder = glm::vec3(0.0f));
+
+  // The asset's texture, or its placeholder while loading (or on failure).
+  GLuint texture(int asset) const;
+  bool ready(int asset) const;
+  bool idle() const;
+
+  // Advances the uploads. Call once per frame on the GL thread.
+  void update();
+
+  // Waits for copies into mapped buffers still running on the pool, then
+  // releases the buffers not uploaded yet, the textures and the
+  // placeholders. Call before the GL context is destroyed; also run by the
+  // destructor.
+  void shutdown();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Image {
+    int asset = 0;
+    GLenum target = GL_TEXTURE_2D;
+    int level = 0;
+    std::string file;
+    int width = 0;
+    int height = 0;
+    GLenum internalFormat = 0;
+    GLenum format = 0; // 0 for compressed data
+    unsigned char *pixels = nullptr; // owned, from stbi_load
+    std::shared_ptr<MappedFile> mapping; // keeps a packed source mapped
+    const unsigned char *source = nullptr; // pixels or into mapping
+    double decodeMs = 0.0;
+    double copyMs = 0.0;
+    GLuint pbo = 0;
+    void *mapped = nullptr;
+    size_t bytes = 0;
+    ~Image();
+  };
+
+  struct Asset {
+    std::string name;
+    GLenum target = GL_TEXTURE_2D;
+    bool repeat = true;
+    GLuint placeholder = 0;
+    GLuint texture = 0; // real texture, created on the first upload
+    int imageCount = 0;
+    int uploaded = 0;
+    int levelCount = 1;
+    bool packed = false;
+    bool failed = false;
+    bool ready = false;
+    double decodeMs = 0.0;
+    double copyMs = 0.0;
+    double uploadMs = 0.0;
+    Clock::time_point requested;
+  };
+
+  // State shared with pool tasks, which may outlive a frame.
+  struct Shared {
+    std::mutex mutex;
+    std::condition_variable copiesDone;
+    std::deque<std::shared_ptr<Image>> decoded;
+    std::deque<std::shared_ptr<Image>> copied;
+    int copiesInFlight = 0;
+  };
+
+  int addAsset(const std::string &name, GLenum target, bool repeat,
+               const glm::vec3 &placeholder);
+  bool requestPacked(int asset);
+  void startDecode(const std::shared_ptr<Image> &image);
+  void upload(Image &image);
+  void finish(Asset &asset);
+
+  AssetLoaderCreateInfo info;
+  ThreadPool &pool;
+  std::shared_ptr<Shared> shared;
+  std::vector<Asset> assets;
+  size_t mappedBytes = 0;
+};
+
+#endif /* ASSET_LOADER_H */
@@ -0,0 +1,116 @@
+#include "camera_latch.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const GLuint64 kFenceTimeoutNs = 1000000000; // re-checked until signaled
+
+// Matches CameraBlock in blackhole_main.frag (std140).
+struct CameraBlock {
+  glm::vec4 position;
+  glm::vec4 target;
+  glm::vec4 params; // fovScale, roll in radians
+};
+
+} // namespace
+
+CameraLatch::CameraLatch(const CameraLatchCreateInfo &info) : info(info) {
+  this->info.slots = std::max(this->info.slots, 1);
+
+  GLint alignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  alignment = std::max(alignment, 1);
+  stride = (sizeof(CameraBlock) + alignment - 1) / alignment * alignment;
+  GLsizeiptr size = stride * this->info.slots;
+
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+    // Coherent, so that writes are seen by the next draw without a flush.
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+    mapped = (uint8_t *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+    if (mapped == nullptr) {
+      printf("WARNING: Failed to map the camera buffer, falling back to "
+             "glBufferSubData\n");
+      glDeleteBuffers(1, &buffer);
+      glGenBuffers(1, &buffer);
+      glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    }
+  }
+  if (mapped == nullptr) {
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  fences.assign(this->info.slots, 0);
+}
+
+CameraLatch::~CameraLatch() { shutdown(); }
+
+bool CameraLatch::attach(GLuint program) const {
+  GLuint index = glGetUniformBlockIndex(program, "CameraBlock");
+  if (index == GL_INVALID_INDEX) {
+    return false;
+  }
+  glUniformBlockBinding(program, index, info.binding);
+  return true;
+}
+
+void CameraLatch::latch(const CameraState &camera) {
+  if (buffer == 0) {
+    return;
+  }
+  slot = (slot + 1) % info.slots;
+
+  CameraBlock block;
+  block.position = glm::vec4(camera.pos, 1.0f);
+  block.target = glm::vec4(camera.target, 0.0f);
+  block.params = glm::vec4(camera.fovScale, camera.rollRadians, 0.0f, 0.0f);
+
+  if (mapped != nullptr) {
+    // Normally long signaled: the slot was last read info.slots frames ago.
+    if (fences[slot] != 0) {
+      while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT,
+                              kFenceTimeoutNs) == GL_TIMEOUT_EXPIRED) {
+      }
+      glDeleteSync(fences[slot]);
+      fences[slot] = 0;
+    }
+    memcpy(mapped + slot * stride, &block, sizeof(block));
+  } else {
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, slot * stride, sizeof(block), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+  glBindBufferRange(GL_UNIFORM_BUFFER, info.binding, buffer, slot * stride,
+                    sizeof(block));
+}
+
+void CameraLatch::release() {
+  if (mapped != nullptr) {
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+}
+
+void CameraLatch::shutdown() {
+  for (GLsync &fence : fences) {
+    if (fence != 0) {
+      glDeleteSync(fence);
+      fence = 0;
+    }
+  }
+  if (buffer != 0) {
+    if (mapped != nullptr) {
+      glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+      glUnmapBuffer(GL_UNIFORM_BUFFER);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      mapped = nullptr;
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+  }
+}
@@ -0,0 +1,60 @@
+
+
+#ifndef CAMERA_LATCH_H
+#define CAMERA_LATCH_H
+
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "simulation.h"
+
+struct CameraLatchCreateInfo {
+  // Slots the uniform buffer is split into. A slot is written again only once
+  // the GPU has finished the draw that read it, so this should exceed the
+  // frames in flight.
+  int slots = 4;
+  GLuint binding = 0; // uniform buffer binding point of CameraBlock
+};
+
+// Feeds the camera to the ray marcher through a uniform block that is written
+// immediately before the draw, instead of through uniforms set early in the
+// frame, so that the pose can be taken from the freshest input. With OpenGL
+// 4.4 or ARB_buffer_storage the buffer is persistently mapped and written
+// directly; otherwise each slot is updated with glBufferSubData().
+class CameraLatch {
+public:
+  explicit CameraLatch(
+      const CameraLatchCreateInfo &info = CameraLatchCreateInfo());
+  ~CameraLatch();
+
+  CameraLatch(const CameraLatch &) = delete;
+  CameraLatch &operator=(const CameraLatch &) = delete;
+
+  // Points the program's CameraBlock at the binding point. Returns false if
+  // the program has no such block.
+  bool attach(GLuint program) const;
+
+  // Writes the camera into the next free slot and binds it. Call right
+  // before the draw.
+  void latch(const CameraState &camera);
+  // Call right after the draw, so that the slot is not overwritten while the
+  // GPU is still reading it.
+  void release();
+
+  bool persistent() const { return mapped != nullptr; }
+
+  // Unmaps and deletes the buffer; also run by the destructor.
+  void shutdown();
+
+private:
+  CameraLatchCreateInfo info;
+  GLuint buffer = 0;
+  GLsizeiptr stride = 0;
+  uint8_t *mapped = nullptr;
+  std::vector<GLsync> fences; // per slot, persistent mapping only
+  int slot = 0;
+};
+
+#endif /* CAMERA_LATCH_H */
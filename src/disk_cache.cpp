@@ -0,0 +1,140 @@
+#include "disk_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "render.h"
+#include "shader.h"
+
+namespace {
+
+// A jump in time larger than this, such as the autopilot restarting or the
+// cache being switched back on, regenerates every layer.
+const double kMaxTimeStep = 1.0;
+
+bool isDiskUniform(const std::string &name) {
+  return name.compare(0, 5, "adisk") == 0;
+}
+
+} // namespace
+
+DiskCache::DiskCache(const DiskCacheCreateInfo &info) : info(info) {
+  this->info.azimuthSize = std::max(this->info.azimuthSize, 1);
+  this->info.radiusSize = std::max(this->info.radiusSize, 1);
+  this->info.heightSize = std::max(this->info.heightSize, 1);
+  setLayersPerFrame(info.layersPerFrame);
+  layerTimes.assign(this->info.heightSize, 0.0);
+
+  glGenTextures(1, &emissionTexture);
+  glBindTexture(GL_TEXTURE_3D, emissionTexture);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, this->info.azimuthSize,
+               this->info.radiusSize, this->info.heightSize, 0, GL_RGBA,
+               GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // Around the disk it wraps; across and through it the edges are dark.
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_3D, 0);
+
+  glGenFramebuffers(1, &framebuffer);
+  program = createShaderProgram("shader/simple.vert", "shader/disk_cache.frag");
+  quadVAO = createQuadVAO();
+}
+
+DiskCache::~DiskCache() { shutdown(); }
+
+void DiskCache::setLayersPerFrame(int layers) {
+  info.layersPerFrame = std::clamp(layers, 1, info.heightSize);
+}
+
+double DiskCache::maxAge(double time) const {
+  if (!valid) {
+    return 0.0;
+  }
+  return time - *std::min_element(layerTimes.begin(), layerTimes.end());
+}
+
+void DiskCache::update(const std::map<std::string, float> &floatUniforms,
+                       GLuint colorMap, double time, bool complete) {
+  std::map<std::string, float> diskUniforms;
+  for (auto const &[name, val] : floatUniforms) {
+    if (isDiskUniform(name)) {
+      diskUniforms[name] = val;
+    }
+  }
+
+  bool stale = !valid || diskUniforms != params || colorMap != paramsColorMap ||
+               time < lastTime || time - lastTime > kMaxTimeStep;
+  if (complete) {
+    for (double layerTime : layerTimes) {
+      stale |= layerTime != time;
+    }
+  }
+  params = diskUniforms;
+  paramsColorMap = colorMap;
+  lastTime = time;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, info.azimuthSize, info.radiusSize);
+  glDisable(GL_DEPTH_TEST);
+  glUseProgram(program);
+  glBindVertexArray(quadVAO);
+  for (auto const &[name, val] : params) {
+    GLint loc = glGetUniformLocation(program, name.c_str());
+    if (loc != -1) {
+      glUniform1f(loc, val);
+    }
+  }
+  glUniform1i(glGetUniformLocation(program, "colorMap"), 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, colorMap);
+
+  int count = stale ? info.heightSize : info.layersPerFrame;
+  for (int i = 0; i < count; ++i) {
+    generateLayer(nextLayer, time);
+    nextLayer = (nextLayer + 1) % info.heightSize;
+  }
+  valid = true;
+  glUseProgram(0);
+}
+
+void DiskCache::generateLayer(int layer, double time) {
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            emissionTexture, 0, layer);
+  glUniform1f(glGetUniformLocation(program, "time"), (float)time);
+  // The layer's texel centre, from -1 at the bottom of the disk to 1 at the
+  // top.
+  glUniform1f(glGetUniformLocation(program, "layerHeight"),
+              (layer + 0.5f) / info.heightSize * 2.0f - 1.0f);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  layerTimes[layer] = time;
+}
+
+void DiskCache::shutdown() {
+  if (emissionTexture != 0) {
+    glDeleteTextures(1, &emissionTexture);
+    emissionTexture = 0;
+  }
+  if (framebuffer != 0) {
+    glDeleteFramebuffers(1, &framebuffer);
+    framebuffer = 0;
+  }
+  if (quadVAO != 0) {
+    // createQuadVAO() leaves its vertex buffer to the vertex array.
+    GLint vertexBuffer = 0;
+    glBindVertexArray(quadVAO);
+    glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING,
+                        &vertexBuffer);
+    glBindVertexArray(0);
+    GLuint buffer = (GLuint)vertexBuffer;
+    glDeleteBuffers(1, &buffer);
+    glDeleteVertexArrays(1, &quadVAO);
+    quadVAO = 0;
+  }
+  if (program != 0) {
+    glDeleteProgram(program);
+    program = 0;
+  }
+}
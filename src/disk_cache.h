@@ -0,0 +1,75 @@
+
+
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+struct DiskCacheCreateInfo {
+  // Texels around, across and through the disk, 32 MB in RGBA16F.
+  // Fewer height layers band the noise near the inner edge, where it
+  // changes fastest with height.
+  int azimuthSize = 1024;
+  int radiusSize = 256;
+  int heightSize = 16;
+  // Height layers regenerated a frame; every layer is renewed each
+  // heightSize / layersPerFrame frames.
+  int layersPerFrame = 2;
+};
+
+// Bakes diskEmission() (accretion_disk.glsl), the emission and optical depth
+// of a march step, into a 3D texture of azimuth, distance from the axis and
+// height, so that each ray march step through the disk is a single fetch.
+// The noise's even octaves turn with time and its odd ones stay put; the
+// texture's azimuth turns with the even ones (diskRotation()), and the odd
+// ones, which drift backwards in it, are caught up by regenerating a few
+// layers every frame.
+class DiskCache {
+public:
+  explicit DiskCache(const DiskCacheCreateInfo &info = DiskCacheCreateInfo());
+  ~DiskCache();
+
+  DiskCache(const DiskCache &) = delete;
+  DiskCache &operator=(const DiskCache &) = delete;
+
+  // Regenerates the next layersPerFrame layers at time. Every layer is
+  // regenerated when an adisk* uniform or the color map changed, when time
+  // jumped, or, with complete set, when any layer shows another time, so
+  // that the tiles of a poster or a job all see the same disk. Leaves the
+  // cache's framebuffer bound.
+  void update(const std::map<std::string, float> &floatUniforms,
+              GLuint colorMap, double time, bool complete = false);
+
+  GLuint texture() const { return emissionTexture; }
+  int layers() const { return info.heightSize; }
+  int layersPerFrame() const { return info.layersPerFrame; }
+  void setLayersPerFrame(int layers);
+  // Time since the oldest layer was generated.
+  double maxAge(double time) const;
+
+  // Deletes the texture, framebuffer and program; also run by the
+  // destructor.
+  void shutdown();
+
+private:
+  void generateLayer(int layer, double time);
+
+  DiskCacheCreateInfo info;
+  GLuint emissionTexture = 0;
+  GLuint framebuffer = 0;
+  GLuint program = 0;
+  GLuint quadVAO = 0;
+
+  std::map<std::string, float> params; // the adisk* uniforms baked in
+  GLuint paramsColorMap = 0;
+  std::vector<double> layerTimes;
+  int nextLayer = 0;
+  double lastTime = 0.0;
+  bool valid = false;
+};
+
+#endif /* DISK_CACHE_H */
@@ -0,0 +1,309 @@
+#include "fleet.h"
+#include "satellite.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+
+// Bounding sphere of the satellite mesh in model units (panel tips included).
+const float kSatelliteBoundingRadius = 2.0f;
+
+const GLuint kCullGroupSize = 64;
+
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+// Normalized frustum planes (Gribb & Hartmann) of a view-projection matrix,
+// pointing inwards.
+void extractFrustumPlanes(const glm::mat4 &viewProjection,
+                          glm::vec4 planes[6]) {
+  glm::mat4 m = glm::transpose(viewProjection);
+  planes[0] = m[3] + m[0]; // left
+  planes[1] = m[3] - m[0]; // right
+  planes[2] = m[3] + m[1]; // bottom
+  planes[3] = m[3] - m[1]; // top
+  planes[4] = m[3] + m[2]; // near
+  planes[5] = m[3] - m[2]; // far
+  for (int i = 0; i < 6; i++) {
+    planes[i] /= glm::length(glm::vec3(planes[i]));
+  }
+}
+
+// Per-instance attributes 3-5 read one SatelliteOrbitParams per instance from
+// the bound GL_ARRAY_BUFFER.
+void setOrbitInstanceFormat() {
+  for (GLuint i = 0; i < 3; i++) {
+    glEnableVertexAttribArray(3 + i);
+    glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE,
+                          sizeof(SatelliteOrbitParams),
+                          (void *)(i * sizeof(glm::vec4)));
+    glVertexAttribDivisor(3 + i, 1);
+  }
+}
+
+// Per-instance attributes 3-6 read one column-major model matrix per instance
+// from the bound GL_ARRAY_BUFFER.
+void setModelInstanceFormat() {
+  for (GLuint i = 0; i < 4; i++) {
+    glEnableVertexAttribArray(3 + i);
+    glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                          (void *)(i * sizeof(glm::vec4)));
+    glVertexAttribDivisor(3 + i, 1);
+  }
+}
+
+SatelliteFleetDrawUniforms getDrawUniforms(GLuint program) {
+  SatelliteFleetDrawUniforms u;
+  u.view = glGetUniformLocation(program, "view");
+  u.projection = glGetUniformLocation(program, "projection");
+  u.time = glGetUniformLocation(program, "time");
+  u.viewPos = glGetUniformLocation(program, "viewPos");
+  u.lightColor = glGetUniformLocation(program, "lightColor");
+  u.rimColor = glGetUniformLocation(program, "rimColor");
+  u.rimStrength = glGetUniformLocation(program, "rimStrength");
+  u.emission = glGetUniformLocation(program, "emission");
+  u.galaxy = glGetUniformLocation(program, "galaxy");
+  return u;
+}
+
+void useDrawProgram(GLuint program, const SatelliteFleetDrawUniforms &u,
+                    const SatelliteFleetRenderInfo &info) {
+  glUseProgram(program);
+  glUniformMatrix4fv(u.view, 1, GL_FALSE, glm::value_ptr(info.view));
+  glUniformMatrix4fv(u.projection, 1, GL_FALSE,
+                     glm::value_ptr(info.projection));
+  glUniform1f(u.time, info.time);
+  glUniform3fv(u.viewPos, 1, glm::value_ptr(info.cameraPos));
+  glUniform3f(u.lightColor, 1.0f, 0.95f, 0.85f);
+  glUniform3f(u.rimColor, 1.4f, 1.2f, 0.95f);
+  glUniform1f(u.rimStrength, 1.35f);
+
+  glm::vec3 emission[kSatMatCount];
+  computeSatelliteEmission(info.time, emission);
+  glUniform3fv(u.emission, kSatMatCount, glm::value_ptr(emission[0]));
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, info.galaxyCubemap);
+  glUniform1i(u.galaxy, 0);
+}
+
+bool gpuCullingSupported() {
+  return (GLEW_VERSION_4_3 ||
+          (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object)) &&
+         GLEW_ARB_draw_indirect;
+}
+
+} // namespace
+
+std::vector<SatelliteOrbitParams> generateSatelliteOrbits(int count,
+                                                          unsigned seed) {
+  std::mt19937 rng(seed);
+  auto uniform = [&rng](float lo, float hi) {
+    return std::uniform_real_distribution<float>(lo, hi)(rng);
+  };
+  const float twoPi = 6.28318531f;
+
+  std::vector<SatelliteOrbitParams> orbits(std::max(count, 0));
+  for (SatelliteOrbitParams &o : orbits) {
+    float a = uniform(4.0f, 24.0f);
+    // Keep the periapsis a(1 - e) at r >= 3, well clear of the photon sphere.
+    float e = std::min(uniform(0.0f, 0.35f), 1.0f - 3.0f / a);
+    float inclination = uniform(-0.5f, 0.5f);
+    // Kepler's third law, scaled so that a = 5.5 matches the hero satellite.
+    float speed = 0.15f * std::pow(5.5f / a, 1.5f);
+    if (uniform(0.0f, 1.0f) < 0.2f) {
+      speed = -speed; // a few retrograde orbits
+    }
+    o.orbit = glm::vec4(a, e, inclination, speed);
+    o.oscillation = glm::vec4(uniform(0.0f, 0.8f), uniform(0.2f, 0.6f),
+                              uniform(0.0f, twoPi), uniform(0.0f, twoPi));
+    o.attitude = glm::vec4(uniform(0.5f, 2.0f), uniform(0.03f, 0.14f),
+                           uniform(1.0f, 3.0f), uniform(0.06f, 0.14f));
+  }
+  return orbits;
+}
+
+void submitSatelliteFleetShaders(ShaderManager &shaders) {
+  if (gpuCullingSupported()) {
+    shaders.submitCompute("shader/fleet_cull.comp");
+  }
+  shaders.submit("shader/fleet.vert", "shader/satellite.frag");
+  shaders.submit("shader/fleet_models.vert", "shader/satellite.frag");
+}
+
+SatelliteFleet createSatelliteFleet(const SatelliteFleetCreateInfo &info,
+                                    const Mesh &satelliteMesh) {
+  SatelliteFleet fleet;
+  fleet.capacity = info.capacity;
+  fleet.indexCount = satelliteMesh.indexCount;
+  fleet.indexType = satelliteMesh.indexType;
+
+  std::vector<SatelliteOrbitParams> orbits =
+      generateSatelliteOrbits(info.capacity, info.seed);
+  GLsizeiptr orbitBytes = orbits.size() * sizeof(SatelliteOrbitParams);
+
+  glGenBuffers(1, &fleet.orbitBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, fleet.orbitBuffer);
+  glBufferData(GL_ARRAY_BUFFER, orbitBytes, orbits.data(), GL_STATIC_DRAW);
+
+  if (gpuCullingSupported()) {
+    try {
+      fleet.cullProgram = createComputeProgram("shader/fleet_cull.comp");
+    } catch (const std::runtime_error &e) {
+      std::cout << "WARNING: " << e.what()
+                << ", drawing the satellite fleet without culling"
+                << std::endl;
+    }
+  }
+
+  // Instances are read from the compacted visible buffer when culling on the
+  // GPU, straight from the orbit buffer otherwise.
+  GLuint instanceBuffer = fleet.orbitBuffer;
+  if (fleet.cullProgram) {
+    glGenBuffers(1, &fleet.visibleBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, fleet.visibleBuffer);
+    glBufferData(GL_ARRAY_BUFFER, orbitBytes, nullptr, GL_DYNAMIC_COPY);
+    instanceBuffer = fleet.visibleBuffer;
+
+    glGenBuffers(1, &fleet.commandBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, fleet.commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand),
+                 nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    GLuint p = fleet.cullProgram;
+    fleet.cullUniforms.satelliteCount =
+        glGetUniformLocation(p, "satelliteCount");
+    fleet.cullUniforms.time = glGetUniformLocation(p, "time");
+    fleet.cullUniforms.frustumPlanes = glGetUniformLocation(p, "frustumPlanes");
+    fleet.cullUniforms.cameraPos = glGetUniformLocation(p, "cameraPos");
+    fleet.cullUniforms.maxDistance = glGetUniformLocation(p, "maxDistance");
+    fleet.cullUniforms.boundingRadius =
+        glGetUniformLocation(p, "boundingRadius");
+  }
+
+  glGenVertexArrays(1, &fleet.vao);
+  glBindVertexArray(fleet.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, satelliteMesh.vertexBuffer);
+  setSatelliteVertexFormat();
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  setOrbitInstanceFormat();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, satelliteMesh.indexBuffer);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  fleet.drawProgram =
+      createShaderProgram("shader/fleet.vert", "shader/satellite.frag");
+  fleet.drawUniforms = getDrawUniforms(fleet.drawProgram);
+
+  glGenBuffers(1, &fleet.modelBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, fleet.modelBuffer);
+  glBufferData(GL_ARRAY_BUFFER, info.capacity * sizeof(glm::mat4), nullptr,
+               GL_STREAM_DRAW);
+
+  glGenVertexArrays(1, &fleet.modelVao);
+  glBindVertexArray(fleet.modelVao);
+  glBindBuffer(GL_ARRAY_BUFFER, satelliteMesh.vertexBuffer);
+  setSatelliteVertexFormat();
+  glBindBuffer(GL_ARRAY_BUFFER, fleet.modelBuffer);
+  setModelInstanceFormat();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, satelliteMesh.indexBuffer);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  fleet.modelProgram = createShaderProgram("shader/fleet_models.vert",
+                                           "shader/satellite.frag");
+  fleet.modelUniforms = getDrawUniforms(fleet.modelProgram);
+
+  return fleet;
+}
+
+void renderSatelliteFleet(const SatelliteFleet &fleet,
+                          const SatelliteFleetRenderInfo &info) {
+  GLuint count = (GLuint)std::clamp(info.count, 0, fleet.capacity);
+  if (count == 0) {
+    return;
+  }
+
+  if (fleet.cullProgram) {
+    // Reset the instance count; the cull pass appends to it.
+    DrawElementsIndirectCommand command = {(GLuint)fleet.indexCount, 0, 0, 0,
+                                           0};
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, fleet.commandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), &command);
+
+    glm::vec4 planes[6];
+    extractFrustumPlanes(info.projection * info.view, planes);
+
+    glUseProgram(fleet.cullProgram);
+    glUniform1ui(fleet.cullUniforms.satelliteCount, count);
+    glUniform1f(fleet.cullUniforms.time, info.time);
+    glUniform4fv(fleet.cullUniforms.frustumPlanes, 6,
+                 glm::value_ptr(planes[0]));
+    glUniform3fv(fleet.cullUniforms.cameraPos, 1,
+                 glm::value_ptr(info.cameraPos));
+    glUniform1f(fleet.cullUniforms.maxDistance, info.maxDistance);
+    glUniform1f(fleet.cullUniforms.boundingRadius, kSatelliteBoundingRadius);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, fleet.orbitBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, fleet.visibleBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, fleet.commandBuffer);
+    glDispatchCompute((count + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+
+    // The draw sources the compacted instances as vertex attributes and its
+    // instance count from the command buffer.
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                    GL_COMMAND_BARRIER_BIT);
+  }
+
+  useDrawProgram(fleet.drawProgram, fleet.drawUniforms, info);
+
+  glBindVertexArray(fleet.vao);
+  if (fleet.cullProgram) {
+    glDrawElementsIndirect(GL_TRIANGLES, fleet.indexType, (void *)0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  } else {
+    glDrawElementsInstanced(GL_TRIANGLES, fleet.indexCount, fleet.indexType,
+                            (void *)0, (GLsizei)count);
+  }
+  glBindVertexArray(0);
+
+  glUseProgram(0);
+}
+
+void renderSatelliteFleetModels(const SatelliteFleet &fleet,
+                                const glm::mat4 *models,
+                                const SatelliteFleetRenderInfo &info) {
+  GLsizei count = std::clamp(info.count, 0, fleet.capacity);
+  if (count == 0) {
+    return;
+  }
+
+  // Orphan the previous frame's matrices instead of waiting for its draw.
+  glBindBuffer(GL_ARRAY_BUFFER, fleet.modelBuffer);
+  glBufferData(GL_ARRAY_BUFFER, fleet.capacity * sizeof(glm::mat4), nullptr,
+               GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), models);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  useDrawProgram(fleet.modelProgram, fleet.modelUniforms, info);
+
+  glBindVertexArray(fleet.modelVao);
+  glDrawElementsInstanced(GL_TRIANGLES, fleet.indexCount, fleet.indexType,
+                          (void *)0, count);
+  glBindVertexArray(0);
+
+  glUseProgram(0);
+}
@@ -0,0 +1,86 @@
+
+
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "satellite.h"
+#include "shader.h"
+
+struct SatelliteFleetCreateInfo {
+  int capacity = 10000;
+  unsigned seed = 1;
+};
+
+struct SatelliteFleetDrawUniforms {
+  GLint view, projection, time, viewPos, lightColor, rimColor, rimStrength,
+      emission, galaxy;
+};
+
+// Instanced satellite swarm sharing the hero satellite's mesh. With compute
+// shaders, SSBOs and indirect draws (OpenGL 4.3) the visible instances are
+// culled and compacted on the GPU; otherwise every instance is drawn.
+//
+// Bodies propagated on the CPU (orbit.h) are drawn through a second vertex
+// array that sources one model matrix per instance from modelBuffer.
+struct SatelliteFleet {
+  int capacity = 0;
+  GLuint vao = 0;
+  GLsizei indexCount = 0;
+  GLenum indexType = GL_UNSIGNED_SHORT;
+
+  GLuint drawProgram = 0;
+  GLuint cullProgram = 0; // 0 when GPU culling is unavailable
+  GLuint orbitBuffer = 0;
+  GLuint visibleBuffer = 0;
+  GLuint commandBuffer = 0;
+
+  GLuint modelVao = 0;
+  GLuint modelProgram = 0;
+  GLuint modelBuffer = 0;
+
+  SatelliteFleetDrawUniforms drawUniforms = {};
+  SatelliteFleetDrawUniforms modelUniforms = {};
+  struct {
+    GLint satelliteCount, time, frustumPlanes, cameraPos, maxDistance,
+        boundingRadius;
+  } cullUniforms = {};
+};
+
+// Random, stable orbits around the black hole, all with their periapsis
+// outside r = 3.
+std::vector<SatelliteOrbitParams> generateSatelliteOrbits(int count,
+                                                          unsigned seed);
+
+// Queues the fleet's programs for compilation ahead of createSatelliteFleet().
+void submitSatelliteFleetShaders(ShaderManager &shaders);
+
+// satelliteMesh must come from createSatelliteMesh().
+SatelliteFleet createSatelliteFleet(const SatelliteFleetCreateInfo &info,
+                                    const Mesh &satelliteMesh);
+
+struct SatelliteFleetRenderInfo {
+  int count = 0; // clamped to the fleet capacity
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::vec3 cameraPos;
+  GLuint galaxyCubemap = 0;
+  float time = 0.0f;
+  float maxDistance = 60.0f; // instances further away are culled
+};
+
+void renderSatelliteFleet(const SatelliteFleet &fleet,
+                          const SatelliteFleetRenderInfo &info);
+
+// Draws info.count instances (clamped to the fleet capacity) with the given
+// model matrices, uploaded into modelBuffer. No culling.
+void renderSatelliteFleetModels(const SatelliteFleet &fleet,
+                                const glm::mat4 *models,
+                                const SatelliteFleetRenderInfo &info);
+
+#endif /* FLEET_H */
@@ -0,0 +1,376 @@
+#include "frame_capture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+
+#include <stb_image_write.h>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace {
+
+const GLuint64 kFenceTimeoutNs = 1000000000; // re-checked until signaled
+
+// BT.709, limited range, in 8.8 fixed point.
+uint8_t lumaOf(int r, int g, int b) {
+  return (uint8_t)(16 + ((47 * r + 157 * g + 16 * b + 128) >> 8));
+}
+uint8_t blueChromaOf(int r, int g, int b) {
+  return (uint8_t)(128 + ((-26 * r - 87 * g + 112 * b + 128) >> 8));
+}
+uint8_t redChromaOf(int r, int g, int b) {
+  return (uint8_t)(128 + ((112 * r - 102 * g - 10 * b + 128) >> 8));
+}
+
+} // namespace
+
+FrameCapture::FrameCapture(const FrameCaptureCreateInfo &info) : info(info) {
+  this->info.ringSize = std::max(this->info.ringSize, 2);
+  this->info.fps = std::max(this->info.fps, 1.0f);
+  int encoderCount =
+      info.format == kCaptureY4m ? 1 : std::max(this->info.encoderThreads, 1);
+
+  if (info.format == kCaptureY4m) {
+    if (!info.path.empty() && info.path[0] == '|') {
+#ifndef _WIN32
+      // A pipe whose reader exits must not kill the renderer.
+      signal(SIGPIPE, SIG_IGN);
+#endif
+      output = popen(info.path.c_str() + 1, "w");
+      outputIsPipe = true;
+    } else {
+      output = fopen(info.path.c_str(), "wb");
+    }
+    if (output == nullptr) {
+      printf("ERROR: Failed to open %s for the capture\n", info.path.c_str());
+      opened = false;
+    }
+  } else {
+    std::error_code error;
+    std::filesystem::create_directories(info.path, error);
+    if (error) {
+      printf("ERROR: Failed to create capture directory %s: %s\n",
+             info.path.c_str(), error.message().c_str());
+      opened = false;
+    }
+    // Encoding time decides whether the encoders keep up; size matters
+    // less for a capture that is re-encoded anyway.
+    stbi_write_png_compression_level = 1;
+  }
+
+  glGenFramebuffers(1, &framebuffer);
+  ring.resize(this->info.ringSize);
+  for (Readback &readback : ring) {
+    glGenBuffers(1, &readback.buffer);
+  }
+
+  for (int i = 0; i < encoderCount; ++i) {
+    encoders.emplace_back(&FrameCapture::encoderLoop, this);
+  }
+}
+
+FrameCapture::~FrameCapture() { shutdown(); }
+
+void FrameCapture::capture(GLuint texture, int width, int height,
+                           double timeSeconds) {
+  if (framebuffer == 0 || !ok()) {
+    return;
+  }
+  if (nextCaptureTime < 0.0) {
+    nextCaptureTime = timeSeconds;
+  }
+  if (timeSeconds < nextCaptureTime) {
+    return;
+  }
+  // Capture clock ticks that passed without a frame are covered by this one.
+  double interval = 1.0 / info.fps;
+  int missed = (int)std::floor((timeSeconds - nextCaptureTime) / interval);
+  lateCount += missed;
+  nextCaptureTime += (missed + 1) * interval;
+
+  if (this->width == 0) {
+    this->width = width;
+    this->height = height;
+  } else if (info.format == kCaptureY4m &&
+             (width != this->width || height != this->height)) {
+    std::lock_guard<std::mutex> lock(mutex);
+    droppedCount++;
+    // The next frame written covers this one's time.
+    pendingRepeat += missed + 1;
+    return;
+  }
+
+  // Hand over finished readbacks oldest first, so that frames reach the
+  // encoders in order, then make room in the ring.
+  for (int i = 0; i < (int)ring.size(); ++i) {
+    Readback &readback = ring[(next + i) % ring.size()];
+    if (readback.fence == 0) {
+      continue;
+    }
+    GLenum status = glClientWaitSync(readback.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    retire(readback, false);
+  }
+  Readback &readback = ring[next];
+  if (readback.fence != 0) {
+    stallCount++;
+    retire(readback, true);
+  }
+
+  if (texture != attachedTexture) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, texture, 0);
+    attachedTexture = texture;
+  } else {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  }
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  if (readback.width != width || readback.height != height) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, nullptr,
+                 GL_STREAM_READ);
+    readback.width = width;
+    readback.height = height;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+  readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  readback.repeat = missed + 1;
+  next = (next + 1) % ring.size();
+  capturedCount++;
+}
+
+void FrameCapture::retire(Readback &readback, bool wait) {
+  if (wait) {
+    while (glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                            kFenceTimeoutNs) == GL_TIMEOUT_EXPIRED) {
+    }
+  }
+  glDeleteSync(readback.fence);
+  readback.fence = 0;
+
+  // A frame that is not written leaves its time to the next one that is.
+  pendingRepeat += readback.repeat;
+
+  Frame frame;
+  frame.width = readback.width;
+  frame.height = readback.height;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if ((int)frames.size() >= info.maxQueuedFrames) {
+      droppedCount++;
+      return;
+    }
+    if (!freeBuffers.empty()) {
+      frame.pixels = std::move(freeBuffers.back());
+      freeBuffers.pop_back();
+    }
+  }
+
+  // Flip to top row first while copying out of the mapping.
+  size_t rowBytes = (size_t)frame.width * 4;
+  frame.pixels.resize(rowBytes * frame.height);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  const uint8_t *src = (const uint8_t *)glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)frame.pixels.size(),
+      GL_MAP_READ_BIT);
+  if (src != nullptr) {
+    for (int y = 0; y < frame.height; ++y) {
+      memcpy(frame.pixels.data() + rowBytes * y,
+             src + rowBytes * (frame.height - 1 - y), rowBytes);
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (src == nullptr) {
+    printf("WARNING: Failed to map capture frame %d\n", frameIndex);
+    return;
+  }
+  // Numbered by capture clock tick, without gaps, as image sequence readers
+  // expect.
+  frame.index = frameIndex;
+  frame.repeat = pendingRepeat;
+  frameIndex += pendingRepeat;
+  pendingRepeat = 0;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    frames.push_back(std::move(frame));
+  }
+  frameAvailable.notify_one();
+}
+
+void FrameCapture::encoderLoop() {
+  while (true) {
+    Frame frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      frameAvailable.wait(lock, [&] { return stopping || !frames.empty(); });
+      if (frames.empty()) {
+        return; // stopping, and everything is written
+      }
+      frame = std::move(frames.front());
+      frames.pop_front();
+    }
+
+    if (info.format == kCaptureY4m) {
+      writeY4m(frame);
+    } else {
+      writePng(frame);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    freeBuffers.push_back(std::move(frame.pixels));
+  }
+}
+
+void FrameCapture::writePng(const Frame &frame) {
+  std::vector<uint8_t> rgb((size_t)frame.width * frame.height * 3);
+  for (size_t i = 0, n = (size_t)frame.width * frame.height; i < n; ++i) {
+    memcpy(&rgb[i * 3], &frame.pixels[i * 4], 3);
+  }
+  auto path = [&](int index) {
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%06d.png", index);
+    return (std::filesystem::path(info.path) / name).string();
+  };
+  std::string file = path(frame.index);
+  if (!stbi_write_png(file.c_str(), frame.width, frame.height, 3, rgb.data(),
+                      frame.width * 3)) {
+    printf("WARNING: Failed to write %s\n", file.c_str());
+    return;
+  }
+
+  // The ticks the frame covers after its own get the same image, linked to
+  // the file where the file system allows it, so that the sequence keeps
+  // the capture rate.
+  for (int i = 1; i < frame.repeat; ++i) {
+    std::string repeat = path(frame.index + i);
+    std::error_code error;
+    std::filesystem::remove(repeat, error);
+    std::filesystem::create_hard_link(file, repeat, error);
+    if (error) {
+      std::filesystem::copy_file(file, repeat, error);
+    }
+    if (error) {
+      printf("WARNING: Failed to write %s\n", repeat.c_str());
+    }
+  }
+}
+
+void FrameCapture::writeY4m(const Frame &frame) {
+  if (output == nullptr) {
+    return;
+  }
+  int w = frame.width;
+  int h = frame.height;
+  int cw = (w + 1) / 2;
+  int ch = (h + 1) / 2;
+  if (!headerWritten) {
+    // Whole frame rates are written exactly, others to a thousandth.
+    int num = (int)std::lround(info.fps * 1000.0f);
+    int den = 1000;
+    if (num % 1000 == 0) {
+      num /= 1000;
+      den = 1;
+    }
+    fprintf(output, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n", w, h, num,
+            den);
+    headerWritten = true;
+  }
+
+  planes.resize((size_t)w * h + (size_t)cw * ch * 2);
+  uint8_t *lumaPlane = planes.data();
+  uint8_t *blueChroma = lumaPlane + (size_t)w * h;
+  uint8_t *redChroma = blueChroma + (size_t)cw * ch;
+  const uint8_t *rgba = frame.pixels.data();
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      const uint8_t *p = rgba + ((size_t)y * w + x) * 4;
+      lumaPlane[(size_t)y * w + x] = lumaOf(p[0], p[1], p[2]);
+    }
+  }
+  // Chroma from the average of each 2x2 block.
+  for (int cy = 0; cy < ch; ++cy) {
+    for (int cx = 0; cx < cw; ++cx) {
+      int r = 0, g = 0, b = 0, n = 0;
+      for (int y = cy * 2; y < std::min(cy * 2 + 2, h); ++y) {
+        for (int x = cx * 2; x < std::min(cx * 2 + 2, w); ++x) {
+          const uint8_t *p = rgba + ((size_t)y * w + x) * 4;
+          r += p[0];
+          g += p[1];
+          b += p[2];
+          n++;
+        }
+      }
+      blueChroma[(size_t)cy * cw + cx] = blueChromaOf(r / n, g / n, b / n);
+      redChroma[(size_t)cy * cw + cx] = redChromaOf(r / n, g / n, b / n);
+    }
+  }
+
+  for (int i = 0; i < frame.repeat; ++i) {
+    fputs("FRAME\n", output);
+    if (fwrite(planes.data(), 1, planes.size(), output) != planes.size()) {
+      printf("ERROR: Failed to write the capture to %s, stopping\n",
+             info.path.c_str());
+      outputIsPipe ? pclose(output) : fclose(output);
+      output = nullptr;
+      return;
+    }
+  }
+}
+
+int FrameCapture::dropped() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return droppedCount;
+}
+
+int FrameCapture::queued() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return (int)frames.size();
+}
+
+void FrameCapture::shutdown() {
+  if (framebuffer == 0) {
+    return;
+  }
+  for (int i = 0; i < (int)ring.size(); ++i) {
+    Readback &readback = ring[(next + i) % ring.size()];
+    if (readback.fence != 0) {
+      retire(readback, true);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  frameAvailable.notify_all();
+  for (std::thread &encoder : encoders) {
+    encoder.join();
+  }
+  encoders.clear();
+
+  if (output != nullptr) {
+    outputIsPipe ? pclose(output) : fclose(output);
+    output = nullptr;
+  }
+  for (Readback &readback : ring) {
+    glDeleteBuffers(1, &readback.buffer);
+  }
+  ring.clear();
+  glDeleteFramebuffers(1, &framebuffer);
+  framebuffer = 0;
+}
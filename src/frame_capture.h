@@ -0,0 +1,129 @@
+
+
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+enum CaptureFormat {
+  kCapturePng = 0, // numbered PNG files in a directory
+  kCaptureY4m = 1  // raw YUV 4:2:0 video in a YUV4MPEG2 stream
+};
+
+struct FrameCaptureCreateInfo {
+  int format = kCapturePng;
+  // PNG: directory for frame_000000.png onwards. Y4M: output file, or a
+  // command to pipe the stream into when it starts with '|', for example
+  // "|ffmpeg -y -i - -c:v libx264 flythrough.mp4".
+  std::string path = "capture";
+  // Frames a second of the recording. Frames are taken on this clock;
+  // rendering slower than it makes frames late, and the last frame is
+  // repeated to keep time (for PNG, as links to its file).
+  float fps = 60.0f;
+  // Pixel-pack buffers. A readback is mapped ringSize - 1 captures after it
+  // was issued, by when the GPU has long finished it.
+  int ringSize = 4;
+  // PNG encoders; Y4M frames are converted and written by one thread, in
+  // order.
+  int encoderThreads = 3;
+  // Frames waiting for the encoders beyond which new frames are dropped
+  // rather than let memory grow.
+  int maxQueuedFrames = 16;
+};
+
+// Records rendered frames without stalling the render loop: each captured
+// frame is read back into the next pixel-pack buffer of a ring with
+// glReadPixels(), which returns at once, and mapped a few frames later once
+// its fence has signaled. The pixels are then handed to encoder threads.
+class FrameCapture {
+public:
+  explicit FrameCapture(
+      const FrameCaptureCreateInfo &info = FrameCaptureCreateInfo());
+  ~FrameCapture();
+
+  FrameCapture(const FrameCapture &) = delete;
+  FrameCapture &operator=(const FrameCapture &) = delete;
+
+  // Call once per frame with the frame to record; reads it back when the
+  // capture clock says a frame is due. timeSeconds is glfwGetTime().
+  void capture(GLuint texture, int width, int height, double timeSeconds);
+
+  // Whether the output could be opened.
+  bool ok() const { return opened; }
+  int captured() const { return capturedCount; }
+  // Capture clock ticks that no rendered frame fell into.
+  int late() const { return lateCount; }
+  // Frames dropped because the encoders fell behind.
+  int dropped() const;
+  // Readbacks the render thread had to wait for.
+  int stalls() const { return stallCount; }
+  int queued() const;
+
+  // Maps the remaining readbacks, drains the encoders and closes the
+  // output; also run by the destructor.
+  void shutdown();
+
+private:
+  struct Readback {
+    GLuint buffer = 0;
+    GLsync fence = 0; // 0 when the slot is free
+    int repeat = 1;   // capture clock ticks the frame covers
+    int width = 0;
+    int height = 0;
+  };
+
+  struct Frame {
+    int index = 0;  // first capture clock tick covered (PNG name)
+    int repeat = 1; // capture clock ticks covered
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels; // RGBA, top row first
+  };
+
+  void retire(Readback &readback, bool wait);
+  void encoderLoop();
+  void writePng(const Frame &frame);
+  void writeY4m(const Frame &frame);
+
+  FrameCaptureCreateInfo info;
+  GLuint framebuffer = 0;
+  GLuint attachedTexture = 0;
+  std::vector<Readback> ring;
+  int next = 0;
+
+  double nextCaptureTime = -1.0;
+  int frameIndex = 0; // next capture clock tick handed to the encoders
+  // Capture clock ticks not written yet: those of dropped frames, which the
+  // next frame written repeats for.
+  int pendingRepeat = 0;
+  int width = 0; // of the first frame; Y4M cannot change size
+  int height = 0;
+  int capturedCount = 0;
+  int lateCount = 0;
+  int stallCount = 0;
+
+  bool opened = true;
+  FILE *output = nullptr; // Y4M; closed by the encoder if writing fails
+  bool outputIsPipe = false;
+  bool headerWritten = false;
+  std::vector<uint8_t> planes; // Y4M encoder's scratch
+
+  std::vector<std::thread> encoders;
+  mutable std::mutex mutex;
+  std::condition_variable frameAvailable;
+  std::deque<Frame> frames;
+  std::vector<std::vector<uint8_t>> freeBuffers;
+  int droppedCount = 0;
+  bool stopping = false;
+};
+
+#endif /* FRAME_CAPTURE_H */
@@ -0,0 +1,193 @@
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+namespace {
+
+const GLuint64 kFenceTimeoutNs = 1000000000; // re-checked until signaled
+
+float millisecondsBetween(std::chrono::steady_clock::time_point start,
+                          std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+} // namespace
+
+FramePacer::FramePacer(const FramePacerCreateInfo &info) : info(info) {
+  fencesSupported = GLEW_VERSION_3_2 || GLEW_ARB_sync;
+  timerQueriesSupported =
+      fencesSupported && (GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+  tearSupported = glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+                  glfwExtensionSupported("GLX_EXT_swap_control_tear");
+  if (!fencesSupported) {
+    printf("WARNING: No fence sync objects, frames in flight are left to the "
+           "driver\n");
+  }
+  latency.values.assign(std::max(this->info.historySize, 1), 0.0f);
+  inputLatency.values.assign(latency.values.size(), 0.0f);
+  setFramesInFlight(this->info.framesInFlight);
+  setPresentMode(this->info.presentMode);
+  nextFrameStart = Clock::now();
+}
+
+FramePacer::~FramePacer() { shutdown(); }
+
+void FramePacer::setPresentMode(int mode) {
+  info.presentMode = std::clamp(mode, (int)kPresentVsync, (int)kPresentAdaptive);
+  applySwapInterval();
+}
+
+void FramePacer::setFramesInFlight(int frames) {
+  info.framesInFlight = std::clamp(frames, 1, 3);
+}
+
+void FramePacer::applySwapInterval() {
+  switch (info.presentMode) {
+  case kPresentUncapped:
+  case kPresentLimited:
+    glfwSwapInterval(0);
+    break;
+  case kPresentAdaptive:
+    glfwSwapInterval(tearSupported ? -1 : 1);
+    break;
+  default:
+    glfwSwapInterval(1);
+    break;
+  }
+}
+
+void FramePacer::beginFrame() {
+  Clock::time_point start = Clock::now();
+
+  // Retire the frames that have completed, then wait for the oldest ones
+  // until there is room for this one.
+  while (!inFlight.empty()) {
+    GLenum status = glClientWaitSync(inFlight.front().fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    retire(inFlight.front());
+    inFlight.pop_front();
+  }
+  while ((int)inFlight.size() >= info.framesInFlight) {
+    GLenum status = glClientWaitSync(inFlight.front().fence,
+                                     GL_SYNC_FLUSH_COMMANDS_BIT,
+                                     kFenceTimeoutNs);
+    if (status == GL_TIMEOUT_EXPIRED) {
+      continue;
+    }
+    retire(inFlight.front());
+    inFlight.pop_front();
+  }
+  Clock::time_point fenced = Clock::now();
+  lastFenceWaitMs = millisecondsBetween(start, fenced);
+
+  lastLimiterWaitMs = 0.0f;
+  if (info.presentMode == kPresentLimited && info.targetFps > 0.0f) {
+    auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / info.targetFps));
+    // Sleep through most of the gap and spin the rest, as sleeps overshoot
+    // by up to a scheduler tick.
+    if (fenced < nextFrameStart) {
+      std::this_thread::sleep_until(nextFrameStart -
+                                    std::chrono::milliseconds(1));
+      while (Clock::now() < nextFrameStart) {
+        std::this_thread::yield();
+      }
+    }
+    Clock::time_point now = Clock::now();
+    lastLimiterWaitMs = millisecondsBetween(fenced, now);
+    // After a long frame, pace from now instead of catching up.
+    if (now - nextFrameStart > period) {
+      nextFrameStart = now;
+    }
+    nextFrameStart += period;
+  }
+}
+
+void FramePacer::endFrame(float inputAgeMs) {
+  if (!fencesSupported) {
+    return;
+  }
+  Frame frame;
+  frame.submitted = Clock::now();
+  frame.inputAgeMs = inputAgeMs;
+  if (timerQueriesSupported) {
+    if (freeQueries.empty()) {
+      GLuint query;
+      glGenQueries(1, &query);
+      freeQueries.push_back(query);
+    }
+    frame.query = freeQueries.back();
+    freeQueries.pop_back();
+    // The GPU clock now, and once everything submitted so far has run.
+    glGetInteger64v(GL_TIMESTAMP, &frame.gpuSubmitted);
+    glQueryCounter(frame.query, GL_TIMESTAMP);
+  }
+  frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  // Make sure the fence reaches the GPU even if nothing else is submitted
+  // before the next wait.
+  glFlush();
+  inFlight.push_back(frame);
+}
+
+void FramePacer::retire(const Frame &frame) {
+  float latencyMs;
+  if (frame.query != 0) {
+    GLint64 completed = 0;
+    glGetQueryObjecti64v(frame.query, GL_QUERY_RESULT, &completed);
+    latencyMs = (float)((completed - frame.gpuSubmitted) / 1.0e6);
+    freeQueries.push_back(frame.query);
+  } else {
+    latencyMs = millisecondsBetween(frame.submitted, Clock::now());
+  }
+  glDeleteSync(frame.fence);
+  latency.record(latencyMs);
+  if (frame.inputAgeMs >= 0.0f) {
+    inputLatency.record(frame.inputAgeMs + latencyMs);
+  }
+}
+
+void FramePacer::History::record(float value) {
+  last = value;
+  values[next] = value;
+  next = (next + 1) % values.size();
+  count = std::min(count + 1, values.size());
+}
+
+float FramePacer::History::average() const {
+  // Unrecorded entries are 0 and add nothing.
+  float sum = 0.0f;
+  for (float value : values) {
+    sum += value;
+  }
+  return count > 0 ? sum / count : 0.0f;
+}
+
+float FramePacer::History::max() const {
+  return *std::max_element(values.begin(), values.end());
+}
+
+std::vector<float> FramePacer::History::ordered() const {
+  std::vector<float> result(values.begin() + next, values.end());
+  result.insert(result.end(), values.begin(), values.begin() + next);
+  return result;
+}
+
+void FramePacer::shutdown() {
+  for (const Frame &frame : inFlight) {
+    glDeleteSync(frame.fence);
+    if (frame.query != 0) {
+      freeQueries.push_back(frame.query);
+    }
+  }
+  inFlight.clear();
+  if (!freeQueries.empty()) {
+    glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+    freeQueries.clear();
+  }
+}
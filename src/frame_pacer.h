@@ -0,0 +1,125 @@
+
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Vsync: wait for vertical blank (swap interval 1).
+// Uncapped: present immediately, for benchmarking (swap interval 0).
+// Limited: present immediately, but start frames at most targetFps times a
+// second.
+// Adaptive: wait for vertical blank unless the frame is late, then present
+// at once and tear (EXT_swap_control_tear; plain vsync without it).
+enum PresentMode {
+  kPresentVsync = 0,
+  kPresentUncapped = 1,
+  kPresentLimited = 2,
+  kPresentAdaptive = 3
+};
+
+struct FramePacerCreateInfo {
+  int presentMode = kPresentVsync;
+  // Frames the CPU may run ahead of the GPU, 1 to 3. Fewer lowers latency,
+  // more lets the CPU and the GPU overlap.
+  int framesInFlight = 2;
+  float targetFps = 60.0f;
+  int historySize = 240; // frames of latency history
+};
+
+// Paces the render loop with fences instead of leaving the queue depth to the
+// driver. Every frame is fenced after its swap; beginFrame() waits until fewer
+// than framesInFlight frames are still on the GPU. The latency of each frame,
+// from the CPU submitting it to the GPU completing it, is measured with
+// timestamp queries (ARB_timer_query) or, without them, from when the fence
+// is seen signaled. Needs OpenGL 3.2 or ARB_sync; otherwise only the present
+// modes apply.
+class FramePacer {
+public:
+  // Sets the swap interval of the current context.
+  explicit FramePacer(const FramePacerCreateInfo &info = FramePacerCreateInfo());
+  ~FramePacer();
+
+  FramePacer(const FramePacer &) = delete;
+  FramePacer &operator=(const FramePacer &) = delete;
+
+  // Call at the top of each frame, before polling input, so that the frame
+  // starts as late as the pacing allows.
+  void beginFrame();
+  // Call right after glfwSwapBuffers(). inputAgeMs is how long before now
+  // the input the frame was rendered from was sampled, or negative if the
+  // frame does not depend on input.
+  void endFrame(float inputAgeMs = -1.0f);
+
+  void setPresentMode(int mode);
+  void setFramesInFlight(int frames);
+  void setTargetFps(float fps) { info.targetFps = fps; }
+  int presentMode() const { return info.presentMode; }
+  int framesInFlight() const { return info.framesInFlight; }
+  bool adaptiveSupported() const { return tearSupported; }
+
+  // Submit-to-complete latency of the most recent completed frame, and over
+  // the history.
+  float latencyMs() const { return latency.last; }
+  float averageLatencyMs() const { return latency.average(); }
+  float maxLatencyMs() const { return latency.max(); }
+  // Oldest first, for ImGui::PlotLines().
+  std::vector<float> latencyHistory() const { return latency.ordered(); }
+  // From sampling the input to the GPU completing the frame, for frames
+  // submitted with an input age. Scanout adds up to one refresh interval.
+  float inputLatencyMs() const { return inputLatency.last; }
+  float averageInputLatencyMs() const { return inputLatency.average(); }
+  float maxInputLatencyMs() const { return inputLatency.max(); }
+  // CPU time beginFrame() spent blocked on fences and on the rate limit.
+  float fenceWaitMs() const { return lastFenceWaitMs; }
+  float limiterWaitMs() const { return lastLimiterWaitMs; }
+
+  // Deletes the fences and queries; also run by the destructor.
+  void shutdown();
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Frame {
+    GLsync fence = 0;
+    GLuint query = 0; // GL_TIMESTAMP at completion, 0 without timer queries
+    Clock::time_point submitted;
+    GLint64 gpuSubmitted = 0; // GPU clock when submitted
+    float inputAgeMs = -1.0f;
+  };
+
+  struct History {
+    std::vector<float> values; // ring buffer
+    size_t next = 0;
+    size_t count = 0;
+    float last = 0.0f;
+
+    void record(float value);
+    float average() const;
+    float max() const;
+    std::vector<float> ordered() const;
+  };
+
+  void applySwapInterval();
+  void retire(const Frame &frame);
+
+  FramePacerCreateInfo info;
+  bool fencesSupported = false;
+  bool timerQueriesSupported = false;
+  bool tearSupported = false;
+
+  std::deque<Frame> inFlight;
+  std::vector<GLuint> freeQueries;
+  Clock::time_point nextFrameStart;
+
+  History latency;
+  History inputLatency;
+  float lastFenceWaitMs = 0.0f;
+  float lastLimiterWaitMs = 0.0f;
+};
+
+#endif /* FRAME_PACER_H */
@@ -0,0 +1,181 @@
+#include "geodesic.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct RayState {
+  glm::dvec3 x;
+  glm::dvec3 v;
+};
+
+RayState derivative(const RayState &s, double h2) {
+  double r2 = glm::dot(s.x, s.x);
+  return {s.v, -1.5 * h2 * s.x / (r2 * r2 * std::sqrt(r2))};
+}
+
+RayState axpy(const RayState &s, double h, const RayState &k) {
+  return {s.x + h * k.x, s.v + h * k.v};
+}
+
+// One Dormand-Prince 5(4) step of size h. The fifth-order solution goes to
+// out, the difference to the embedded fourth-order one to error.
+void dormandPrinceStep(const RayState &s, double h2, double h, RayState &out,
+                       RayState *error = nullptr) {
+  RayState k1 = derivative(s, h2);
+  RayState k2 = derivative(axpy(s, h * (1.0 / 5.0), k1), h2);
+  RayState y = axpy(s, h * (3.0 / 40.0), k1);
+  y = axpy(y, h * (9.0 / 40.0), k2);
+  RayState k3 = derivative(y, h2);
+  y = axpy(s, h * (44.0 / 45.0), k1);
+  y = axpy(y, h * (-56.0 / 15.0), k2);
+  y = axpy(y, h * (32.0 / 9.0), k3);
+  RayState k4 = derivative(y, h2);
+  y = axpy(s, h * (19372.0 / 6561.0), k1);
+  y = axpy(y, h * (-25360.0 / 2187.0), k2);
+  y = axpy(y, h * (64448.0 / 6561.0), k3);
+  y = axpy(y, h * (-212.0 / 729.0), k4);
+  RayState k5 = derivative(y, h2);
+  y = axpy(s, h * (9017.0 / 3168.0), k1);
+  y = axpy(y, h * (-355.0 / 33.0), k2);
+  y = axpy(y, h * (46732.0 / 5247.0), k3);
+  y = axpy(y, h * (49.0 / 176.0), k4);
+  y = axpy(y, h * (-5103.0 / 18656.0), k5);
+  RayState k6 = derivative(y, h2);
+  out = axpy(s, h * (35.0 / 384.0), k1);
+  out = axpy(out, h * (500.0 / 1113.0), k3);
+  out = axpy(out, h * (125.0 / 192.0), k4);
+  out = axpy(out, h * (-2187.0 / 6784.0), k5);
+  out = axpy(out, h * (11.0 / 84.0), k6);
+  if (error == nullptr) {
+    return;
+  }
+  RayState k7 = derivative(out, h2);
+  *error = {glm::dvec3(0.0), glm::dvec3(0.0)};
+  *error = axpy(*error, h * (71.0 / 57600.0), k1);
+  *error = axpy(*error, h * (-71.0 / 16695.0), k3);
+  *error = axpy(*error, h * (71.0 / 1920.0), k4);
+  *error = axpy(*error, h * (-17253.0 / 339200.0), k5);
+  *error = axpy(*error, h * (22.0 / 525.0), k6);
+  *error = axpy(*error, h * (-1.0 / 40.0), k7);
+}
+
+double errorNorm(const RayState &error, const RayState &a, const RayState &b,
+                 double tolerance) {
+  double norm = 0.0;
+  for (int i = 0; i < 3; i++) {
+    double sx = tolerance * (1.0 + std::max(std::abs(a.x[i]), std::abs(b.x[i])));
+    double sv = tolerance * (1.0 + std::max(std::abs(a.v[i]), std::abs(b.v[i])));
+    norm = std::max({norm, std::abs(error.x[i]) / sx,
+                     std::abs(error.v[i]) / sv});
+  }
+  return norm;
+}
+
+bool inDisk(double radius) {
+  return radius >= kDiskInnerRadius && radius <= kDiskOuterRadius;
+}
+
+} // namespace
+
+GeodesicResult traceReference(const glm::dvec3 &pos, const glm::dvec3 &dir,
+                              const ReferenceTraceInfo &info) {
+  GeodesicResult result;
+  RayState s = {pos, glm::normalize(dir)};
+  glm::dvec3 h = glm::cross(s.x, s.v);
+  double h2 = glm::dot(h, h);
+
+  double step = 0.01;
+  while (result.steps < info.maxSteps) {
+    double r = glm::length(s.x);
+    if (r < 1.0) {
+      result.fate = kGeodesicCaptured;
+      return result;
+    }
+    if (r > info.escapeRadius && glm::dot(s.x, s.v) > 0.0) {
+      result.fate = kGeodesicEscaped;
+      result.direction = glm::normalize(s.v);
+      return result;
+    }
+
+    // Never more than a tenth of the way to the centre, so that nearly
+    // radial rays, whose error estimate stays small, cannot step over the
+    // horizon; far out this still grows the step geometrically.
+    step = std::min(step, 0.1 * r / glm::length(s.v));
+    RayState next, error;
+    dormandPrinceStep(s, h2, step, next, &error);
+    result.steps++;
+    double norm = errorNorm(error, s, next, info.tolerance);
+    if (norm > 1.0) {
+      step *= std::max(0.2, 0.9 * std::pow(norm, -0.2));
+      continue;
+    }
+
+    if (result.diskRadius < 0.0 && s.x.y != 0.0 &&
+        (s.x.y > 0.0) != (next.x.y > 0.0)) {
+      // Newton iteration on the size of a step from s that ends on the
+      // plane, starting from the linear guess.
+      double t = step * s.x.y / (s.x.y - next.x.y);
+      RayState crossing = next;
+      for (int i = 0; i < 8; i++) {
+        dormandPrinceStep(s, h2, t, crossing);
+        if (std::abs(crossing.x.y) < info.tolerance ||
+            crossing.v.y == 0.0) {
+          break;
+        }
+        t -= crossing.x.y / crossing.v.y;
+      }
+      double radius = glm::length(crossing.x);
+      if (inDisk(radius)) {
+        result.diskRadius = radius;
+      }
+    }
+
+    s = next;
+    step *= std::min(5.0, 0.9 * std::pow(std::max(norm, 1e-10), -0.2));
+  }
+  return result;
+}
+
+GeodesicResult traceShader(const glm::vec3 &pos, const glm::vec3 &dir,
+                           const ShaderTraceInfo &info) {
+  GeodesicResult result;
+  glm::vec3 p = pos;
+  glm::vec3 d = glm::normalize(dir) * info.stepSize;
+  glm::vec3 h = glm::cross(p, d);
+  float h2 = glm::dot(h, h);
+
+  float distSq = glm::dot(p, p);
+  int maxIter = info.maxIterations > 0
+                    ? info.maxIterations
+                    : (distSq > 400.0f ? 80 : (distSq > 100.0f ? 120 : 150));
+  for (int i = 0; i < maxIter; i++) {
+    float r2 = glm::dot(p, p);
+    d += -1.5f * h2 * p / std::pow(r2, 2.5f);
+    result.steps++;
+
+    distSq = glm::dot(p, p);
+    if (distSq < 1.0f) {
+      result.fate = kGeodesicCaptured;
+      return result;
+    }
+    if (distSq > 900.0f && glm::dot(p, d) > 0.0f) {
+      result.fate = kGeodesicEscaped;
+      break;
+    }
+
+    glm::vec3 next = p + d;
+    if (result.diskRadius < 0.0 && p.y != 0.0f &&
+        (p.y > 0.0f) != (next.y > 0.0f)) {
+      float radius = glm::length(p + d * (p.y / (p.y - next.y)));
+      if (inDisk(radius)) {
+        result.diskRadius = radius;
+      }
+    }
+    p = next;
+  }
+  // Truncated rays still look up the sky in this direction.
+  result.direction = glm::normalize(glm::dvec3(d));
+  return result;
+}
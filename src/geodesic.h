@@ -0,0 +1,64 @@
+
+
+#ifndef GEODESIC_H
+#define GEODESIC_H
+
+#include <glm/glm.hpp>
+
+// Light rays around the black hole in the ray marcher's units: the horizon
+// at r = 1 and photons following
+//   x'' = -1.5 h^2 x / |x|^5,  h = |x × x'|,
+// whose orbits r(phi) are exactly the Schwarzschild null geodesics.
+
+enum GeodesicFate {
+  kGeodesicEscaped = 0,
+  kGeodesicCaptured = 1,
+  // Ran out of steps or iterations before either.
+  kGeodesicTruncated = 2
+};
+
+// The accretion disk's extent in the y = 0 plane (adiskColor() in
+// blackhole_main.frag).
+const double kDiskInnerRadius = 2.6;
+const double kDiskOuterRadius = 12.0;
+
+struct GeodesicResult {
+  int fate = kGeodesicTruncated;
+  // Unit direction the ray leaves in; only meaningful when it escaped.
+  glm::dvec3 direction = glm::dvec3(0.0);
+  // Distance from the centre at which the ray first crosses the disk, or -1
+  // if it never does.
+  double diskRadius = -1.0;
+  int steps = 0;
+};
+
+struct ReferenceTraceInfo {
+  // Error allowed per step, relative to the state's size (with an absolute
+  // floor of the same value).
+  double tolerance = 1e-10;
+  // The bending still to come beyond this radius is about 1 / escapeRadius
+  // radians.
+  double escapeRadius = 1e6;
+  int maxSteps = 1000000;
+};
+
+// Double-precision reference: Dormand-Prince 5(4) with adaptive steps, and
+// disk crossings located to the tolerance by Newton iteration on the step.
+GeodesicResult traceReference(const glm::dvec3 &pos, const glm::dvec3 &dir,
+                              const ReferenceTraceInfo &info =
+                                  ReferenceTraceInfo());
+
+struct ShaderTraceInfo {
+  float stepSize = 0.15f;
+  // 0 for the shader's own limit of 80 to 150 by the camera's distance.
+  int maxIterations = 0;
+};
+
+// traceColor()'s integration in single precision, step for step: fixed-step
+// semi-implicit Euler, stopped at the horizon, beyond r = 30 when moving
+// outward, or after the iteration limit. Disk crossings are interpolated
+// linearly within a step.
+GeodesicResult traceShader(const glm::vec3 &pos, const glm::vec3 &dir,
+                           const ShaderTraceInfo &info = ShaderTraceInfo());
+
+#endif /* GEODESIC_H */
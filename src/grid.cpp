@@ -0,0 +1,192 @@
+#include "grid.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Resolution of the coarse evaluation used to estimate line density.
+const int kDensitySamples = 64;
+
+void bernstein(float t, float b[4]) {
+  float s = 1.0f - t;
+  b[0] = s * s * s;
+  b[1] = 3.0f * t * s * s;
+  b[2] = 3.0f * t * t * s;
+  b[3] = t * t * t;
+}
+
+// Places steps + 1 parameter values over [0, 1] so that their spacing is
+// inversely proportional to the density, sampled uniformly over [0, 1].
+std::vector<float> placeLines(int steps, const std::vector<float> &density) {
+  int n = (int)density.size();
+  std::vector<float> cdf(n, 0.0f);
+  for (int k = 1; k < n; k++) {
+    cdf[k] = cdf[k - 1] + 0.5f * (density[k - 1] + density[k]);
+  }
+
+  std::vector<float> params(steps + 1);
+  int k = 0;
+  for (int i = 0; i <= steps; i++) {
+    float target = cdf[n - 1] * (float)i / (float)steps;
+    while (k < n - 2 && cdf[k + 1] < target) {
+      k++;
+    }
+    float span = cdf[k + 1] - cdf[k];
+    float f = span > 0.0f ? (target - cdf[k]) / span : 0.0f;
+    params[i] = ((float)k + std::clamp(f, 0.0f, 1.0f)) / (float)(n - 1);
+  }
+  params[0] = 0.0f;
+  params[steps] = 1.0f;
+  return params;
+}
+
+} // namespace
+
+void evaluateBezierSurface(const glm::vec3 controlPoints[16],
+                           const std::vector<float> &uParams,
+                           const std::vector<float> &vParams,
+                           std::vector<glm::vec3> &positions) {
+  size_t uCount = uParams.size();
+  size_t vCount = vParams.size();
+  positions.resize(uCount * vCount);
+
+  // The v basis is shared by every row.
+  std::vector<float> bv(vCount * 4);
+  for (size_t j = 0; j < vCount; j++) {
+    bernstein(vParams[j], &bv[j * 4]);
+  }
+
+  ThreadPool::shared().parallelFor(uCount, 16, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      float bu[4];
+      bernstein(uParams[i], bu);
+
+      // Collapse the u direction first, leaving one cubic curve per row.
+      glm::vec3 row[4];
+      for (int c = 0; c < 4; c++) {
+        row[c] = controlPoints[c] * bu[0] + controlPoints[4 + c] * bu[1] +
+                 controlPoints[8 + c] * bu[2] + controlPoints[12 + c] * bu[3];
+      }
+
+      for (size_t j = 0; j < vCount; j++) {
+        const float *b = &bv[j * 4];
+        positions[i * vCount + j] =
+            row[0] * b[0] + row[1] * b[1] + row[2] * b[2] + row[3] * b[3];
+      }
+    }
+  });
+}
+
+BezierGrid createBezierGrid(const BezierGridCreateInfo &info) {
+  BezierGrid grid;
+  grid.info = info;
+
+  size_t uCount = (size_t)info.uSteps + 1;
+  size_t vCount = (size_t)info.vSteps + 1;
+  size_t vertexCount = uCount * vCount;
+
+  // Each edge between neighbouring grid vertices appears exactly once.
+  std::vector<uint32_t> indices;
+  indices.reserve((info.uSteps * vCount + uCount * info.vSteps) * 2);
+  for (size_t i = 0; i < uCount; i++) {
+    for (size_t j = 0; j < vCount; j++) {
+      uint32_t index = (uint32_t)(i * vCount + j);
+      if (i + 1 < uCount) {
+        indices.push_back(index);
+        indices.push_back(index + (uint32_t)vCount);
+      }
+      if (j + 1 < vCount) {
+        indices.push_back(index);
+        indices.push_back(index + 1);
+      }
+    }
+  }
+
+  GLuint vao, ebo;
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &grid.vbo);
+  glGenBuffers(1, &ebo);
+
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, grid.vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(glm::vec3), nullptr,
+               GL_DYNAMIC_DRAW);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  if (vertexCount <= 65536) {
+    std::vector<uint16_t> indices16(indices.begin(), indices.end());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices16.size() * sizeof(uint16_t),
+                 indices16.data(), GL_STATIC_DRAW);
+    grid.mesh.indexType = GL_UNSIGNED_SHORT;
+  } else {
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t),
+                 indices.data(), GL_STATIC_DRAW);
+    grid.mesh.indexType = GL_UNSIGNED_INT;
+  }
+
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+
+  glBindVertexArray(0);
+
+  grid.mesh.vao = vao;
+  grid.mesh.vertexCount = (GLsizei)vertexCount;
+  grid.mesh.indexCount = (GLsizei)indices.size();
+  return grid;
+}
+
+bool updateBezierGrid(BezierGrid &grid, const glm::vec3 controlPoints[16]) {
+  if (grid.evaluated &&
+      std::equal(controlPoints, controlPoints + 16, grid.controlPoints)) {
+    return false;
+  }
+
+  // Estimate how far the surface deviates from the plane of its corners,
+  // which interpolate the four corner control points.
+  std::vector<float> uniform(kDensitySamples);
+  for (int k = 0; k < kDensitySamples; k++) {
+    uniform[k] = (float)k / (float)(kDensitySamples - 1);
+  }
+  std::vector<glm::vec3> coarse;
+  evaluateBezierSurface(controlPoints, uniform, uniform, coarse);
+
+  float rimHeight = 0.25f * (controlPoints[0].y + controlPoints[3].y +
+                             controlPoints[12].y + controlPoints[15].y);
+  float maxDeviation = 0.0f;
+  for (const glm::vec3 &p : coarse) {
+    maxDeviation = std::max(maxDeviation, std::abs(p.y - rimHeight));
+  }
+
+  // Line density along u (and v) follows the deepest point of the surface
+  // crossed by that parameter line.
+  std::vector<float> uDensity(kDensitySamples, 1.0f);
+  std::vector<float> vDensity(kDensitySamples, 1.0f);
+  if (grid.info.adaptivity > 0.0f && maxDeviation > 1e-6f) {
+    for (int i = 0; i < kDensitySamples; i++) {
+      for (int j = 0; j < kDensitySamples; j++) {
+        float d = std::abs(coarse[i * kDensitySamples + j].y - rimHeight) /
+                  maxDeviation;
+        float density = 1.0f + grid.info.adaptivity * d;
+        uDensity[i] = std::max(uDensity[i], density);
+        vDensity[j] = std::max(vDensity[j], density);
+      }
+    }
+  }
+
+  std::vector<float> uParams = placeLines(grid.info.uSteps, uDensity);
+  std::vector<float> vParams = placeLines(grid.info.vSteps, vDensity);
+
+  std::vector<glm::vec3> positions;
+  evaluateBezierSurface(controlPoints, uParams, vParams, positions);
+
+  glBindBuffer(GL_ARRAY_BUFFER, grid.vbo);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, positions.size() * sizeof(glm::vec3),
+                  positions.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  std::copy(controlPoints, controlPoints + 16, grid.controlPoints);
+  grid.evaluated = true;
+  return true;
+}
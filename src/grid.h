@@ -0,0 +1,45 @@
+
+
+#ifndef GRID_H
+#define GRID_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+// Spacetime curvature grid: a bicubic Bezier surface evaluated on the CPU and
+// drawn as an indexed GL_LINES mesh with every edge stored once.
+struct BezierGridCreateInfo {
+  // Number of segments along u and v; there are uSteps + 1 lines of constant
+  // u and vSteps + 1 lines of constant v.
+  int uSteps = 80;
+  int vSteps = 80;
+  // Extra line density at the deepest point of the well relative to the flat
+  // rim. 0 gives uniformly spaced parameter lines.
+  float adaptivity = 3.0f;
+};
+
+struct BezierGrid {
+  BezierGridCreateInfo info;
+  Mesh mesh;
+  GLuint vbo = 0;
+  glm::vec3 controlPoints[16] = {};
+  bool evaluated = false;
+};
+
+BezierGrid createBezierGrid(const BezierGridCreateInfo &info);
+
+// Re-evaluates the surface into the vertex buffer when the 4x4 control points
+// differ from the last evaluation. Returns true if the buffer was updated.
+bool updateBezierGrid(BezierGrid &grid, const glm::vec3 controlPoints[16]);
+
+// Evaluates the surface at every (u, v) parameter pair, row-major in u.
+void evaluateBezierSurface(const glm::vec3 controlPoints[16],
+                           const std::vector<float> &uParams,
+                           const std::vector<float> &vParams,
+                           std::vector<glm::vec3> &positions);
+
+#endif /* GRID_H */
@@ -0,0 +1,118 @@
+#include "hud_layer.h"
+
+#include <cstring>
+
+#include "render.h"
+
+namespace {
+
+// FNV-1a over 32-bit words rather than bytes: the draw data is tens of
+// thousands of vertices, and the hash only has to tell frames apart.
+const uint64_t kFnvOffset = 14695981039346656037ull;
+const uint64_t kFnvPrime = 1099511628211ull;
+
+void hashWords(uint64_t &hash, const void *data, size_t bytes) {
+  const uint8_t *p = (const uint8_t *)data;
+  size_t words = bytes / 4;
+  for (size_t i = 0; i < words; ++i) {
+    uint32_t word;
+    memcpy(&word, p + i * 4, 4);
+    hash = (hash ^ word) * kFnvPrime;
+  }
+  for (size_t i = words * 4; i < bytes; ++i) {
+    hash = (hash ^ p[i]) * kFnvPrime;
+  }
+}
+
+uint64_t hashDrawData(const ImDrawData *drawData) {
+  uint64_t hash = kFnvOffset;
+  hashWords(hash, &drawData->DisplaySize, sizeof(drawData->DisplaySize));
+  for (int n = 0; n < drawData->CmdListsCount; ++n) {
+    const ImDrawList *list = drawData->CmdLists[n];
+    hashWords(hash, list->VtxBuffer.Data,
+              list->VtxBuffer.Size * sizeof(ImDrawVert));
+    hashWords(hash, list->IdxBuffer.Data,
+              list->IdxBuffer.Size * sizeof(ImDrawIdx));
+    for (const ImDrawCmd &cmd : list->CmdBuffer) {
+      hashWords(hash, &cmd.ClipRect, sizeof(cmd.ClipRect));
+      hashWords(hash, &cmd.TextureId, sizeof(cmd.TextureId));
+      hashWords(hash, &cmd.VtxOffset, sizeof(cmd.VtxOffset));
+      hashWords(hash, &cmd.IdxOffset, sizeof(cmd.IdxOffset));
+      hashWords(hash, &cmd.ElemCount, sizeof(cmd.ElemCount));
+    }
+  }
+  return hash;
+}
+
+} // namespace
+
+HudLayer::HudLayer(const HudLayerCreateInfo &info) : info(info) {}
+
+HudLayer::~HudLayer() { shutdown(); }
+
+bool HudLayer::needsUpdate(const ImDrawData *drawData, int width, int height,
+                           double timeSeconds, bool interactive) {
+  if (timeSeconds - countStart >= 1.0) {
+    lastUpdateCount = updateCount;
+    updateCount = 0;
+    countStart = timeSeconds;
+  }
+
+  if (width != this->width || height != this->height) {
+    shutdown();
+    this->width = width;
+    this->height = height;
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    FramebufferCreateInfo framebufferInfo;
+    framebufferInfo.colorTexture = colorTexture;
+    framebufferInfo.width = width;
+    framebufferInfo.height = height;
+    framebuffer = createFramebuffer(framebufferInfo);
+    valid = false;
+  }
+
+  bool due = interactive || info.refreshRate <= 0.0f ||
+             timeSeconds - lastUpdate >= 1.0 / info.refreshRate;
+  if (valid && !due) {
+    return false;
+  }
+  uint64_t hash = hashDrawData(drawData);
+  if (valid && hash == contentHash) {
+    return false;
+  }
+
+  contentHash = hash;
+  valid = true;
+  lastUpdate = timeSeconds;
+  updateCount++;
+  return true;
+}
+
+void HudLayer::begin() {
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, width, height);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void HudLayer::end() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+
+void HudLayer::shutdown() {
+  if (framebuffer != 0) {
+    glDeleteFramebuffers(1, &framebuffer);
+    framebuffer = 0;
+  }
+  if (colorTexture != 0) {
+    glDeleteTextures(1, &colorTexture);
+    colorTexture = 0;
+  }
+  width = 0;
+  height = 0;
+  valid = false;
+}
@@ -0,0 +1,64 @@
+
+
+#ifndef HUD_LAYER_H
+#define HUD_LAYER_H
+
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <imgui.h>
+
+struct HudLayerCreateInfo {
+  // Times a second the layer follows changing content, such as telemetry
+  // values, while the HUD is not being interacted with.
+  float refreshRate = 10.0f;
+};
+
+// Caches the rasterized HUD in a window-sized texture with premultiplied
+// alpha, which the final pass composites over the scene. The layer is drawn
+// again only when the content of the draw data has changed, and then no more
+// than refreshRate times a second unless the HUD is being interacted with, so
+// that hovering and dragging respond at once.
+class HudLayer {
+public:
+  explicit HudLayer(const HudLayerCreateInfo &info = HudLayerCreateInfo());
+  ~HudLayer();
+
+  HudLayer(const HudLayer &) = delete;
+  HudLayer &operator=(const HudLayer &) = delete;
+
+  // Whether the HUD has to be drawn into the layer this frame. Resizes the
+  // layer to the window; the content is hashed only when an update is due.
+  bool needsUpdate(const ImDrawData *drawData, int width, int height,
+                   double timeSeconds, bool interactive);
+  // Binds and clears the layer for drawing the HUD into; end() binds the
+  // window's framebuffer again.
+  void begin();
+  void end();
+
+  GLuint texture() const { return colorTexture; }
+  void setRefreshRate(float hz) { info.refreshRate = hz; }
+  float refreshRate() const { return info.refreshRate; }
+  // Updates over the last second.
+  int updatesPerSecond() const { return lastUpdateCount; }
+
+  // Deletes the texture and framebuffer; also run by the destructor.
+  void shutdown();
+
+private:
+  HudLayerCreateInfo info;
+  GLuint colorTexture = 0;
+  GLuint framebuffer = 0;
+  int width = 0;
+  int height = 0;
+
+  uint64_t contentHash = 0;
+  bool valid = false;
+  double lastUpdate = 0.0;
+
+  double countStart = 0.0;
+  int updateCount = 0;
+  int lastUpdateCount = 0;
+};
+
+#endif /* HUD_LAYER_H */
@@ -0,0 +1,351 @@
+#include "hud_renderer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "shader.h"
+
+namespace {
+
+const GLuint64 kFenceTimeoutNs = 1000000000; // re-checked until signaled
+
+size_t alignUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+float millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<float, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void setCapability(GLenum cap, bool &shadow, bool enabled) {
+  if (shadow != enabled) {
+    if (enabled) {
+      glEnable(cap);
+    } else {
+      glDisable(cap);
+    }
+    shadow = enabled;
+  }
+}
+
+} // namespace
+
+HudRenderer::HudRenderer(const HudRendererCreateInfo &info) : info(info) {
+  this->info.segments = std::max(this->info.segments, 1);
+
+  program = createShaderProgram("shader/hud.vert", "shader/hud.frag");
+  projectionLocation = glGetUniformLocation(program, "projection");
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "hudTexture"), 0);
+  glUseProgram(0);
+
+  createBuffer(this->info.segmentSize);
+
+  timerQueriesSupported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+  if (timerQueriesSupported) {
+    queries.resize(this->info.segments);
+    glGenQueries((GLsizei)queries.size(), queries.data());
+    queryPending.assign(queries.size(), false);
+  }
+}
+
+HudRenderer::~HudRenderer() { shutdown(); }
+
+void HudRenderer::createBuffer(size_t segmentBytes) {
+  bool storage = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+  int segments = storage ? info.segments : 1;
+  info.segmentSize = alignUp(segmentBytes, 256);
+  GLsizeiptr size = (GLsizeiptr)(info.segmentSize * segments);
+
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  if (storage) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+    mapped = (uint8_t *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    if (mapped == nullptr) {
+      printf("WARNING: Failed to map the HUD buffer, falling back to "
+             "glBufferSubData\n");
+      glDeleteBuffers(1, &buffer);
+      glGenBuffers(1, &buffer);
+      glBindBuffer(GL_ARRAY_BUFFER, buffer);
+      segments = 1;
+      size = (GLsizeiptr)info.segmentSize;
+    }
+  }
+  if (mapped == nullptr) {
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    staging.resize(info.segmentSize);
+  }
+
+  // The element array binding is part of the vertex array; both point into
+  // the same buffer.
+  vertexArrays.resize(segments);
+  glGenVertexArrays(segments, vertexArrays.data());
+  for (int i = 0; i < segments; ++i) {
+    size_t base = info.segmentSize * i;
+    glBindVertexArray(vertexArrays[i]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert),
+                          (void *)(base + offsetof(ImDrawVert, pos)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert),
+                          (void *)(base + offsetof(ImDrawVert, uv)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert),
+                          (void *)(base + offsetof(ImDrawVert, col)));
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  fences.assign(segments, 0);
+  segment = 0;
+}
+
+void HudRenderer::destroyBuffer() {
+  for (GLsync &fence : fences) {
+    if (fence != 0) {
+      glDeleteSync(fence);
+      fence = 0;
+    }
+  }
+  if (!vertexArrays.empty()) {
+    glDeleteVertexArrays((GLsizei)vertexArrays.size(), vertexArrays.data());
+    vertexArrays.clear();
+  }
+  if (buffer != 0) {
+    if (mapped != nullptr) {
+      glBindBuffer(GL_ARRAY_BUFFER, buffer);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      mapped = nullptr;
+    }
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+  }
+}
+
+void HudRenderer::render(const ImDrawData *drawData, const HudGlState &state) {
+  auto start = std::chrono::steady_clock::now();
+  lastDrawCalls = 0;
+
+  int fbWidth = (int)(drawData->DisplaySize.x * drawData->FramebufferScale.x);
+  int fbHeight = (int)(drawData->DisplaySize.y * drawData->FramebufferScale.y);
+  if (fbWidth <= 0 || fbHeight <= 0 || drawData->TotalVtxCount == 0 ||
+      buffer == 0) {
+    lastCpuMs = millisecondsSince(start);
+    return;
+  }
+
+  size_t vertexBytes =
+      alignUp(drawData->TotalVtxCount * sizeof(ImDrawVert), sizeof(GLuint));
+  size_t needed = vertexBytes + drawData->TotalIdxCount * sizeof(GLuint);
+  if (needed > info.segmentSize) {
+    size_t grown = std::max(needed, info.segmentSize * 2);
+    destroyBuffer();
+    createBuffer(grown);
+  }
+
+  // Claim the next segment once the GPU is done with what it last held.
+  segment = (segment + 1) % (int)vertexArrays.size();
+  uint8_t *dst;
+  if (mapped != nullptr) {
+    if (fences[segment] != 0) {
+      while (glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT,
+                              kFenceTimeoutNs) == GL_TIMEOUT_EXPIRED) {
+      }
+      glDeleteSync(fences[segment]);
+      fences[segment] = 0;
+    }
+    dst = mapped + info.segmentSize * segment;
+  } else {
+    dst = staging.data();
+  }
+
+  // All vertices first, then the indices of every list as 32-bit indices
+  // rebased onto them, so that any run of commands is one contiguous range.
+  ImDrawVert *vertices = (ImDrawVert *)dst;
+  GLuint *indices = (GLuint *)(dst + vertexBytes);
+  ImVec2 clipOffset = drawData->DisplayPos;
+  ImVec2 clipScale = drawData->FramebufferScale;
+  batches.clear();
+  size_t vertexBase = 0;
+  size_t indexCount = 0;
+  for (int n = 0; n < drawData->CmdListsCount; ++n) {
+    const ImDrawList *list = drawData->CmdLists[n];
+    memcpy(vertices + vertexBase, list->VtxBuffer.Data,
+           list->VtxBuffer.Size * sizeof(ImDrawVert));
+
+    for (const ImDrawCmd &cmd : list->CmdBuffer) {
+      // The HUD registers no callbacks, so none are run.
+      if (cmd.UserCallback != nullptr || cmd.ElemCount == 0) {
+        continue;
+      }
+      ImVec4 clip = cmd.ClipRect;
+      if (clip.z <= clip.x || clip.w <= clip.y) {
+        continue;
+      }
+
+      // Rebase the indices and see whether the command stays inside its
+      // clip rectangle, in which case it needs no scissor.
+      bool inside = true;
+      // Positions are read from ImGui's copy: the mapping is write-only.
+      const ImDrawIdx *src = list->IdxBuffer.Data + cmd.IdxOffset;
+      const ImDrawVert *listVertices = list->VtxBuffer.Data + cmd.VtxOffset;
+      size_t base = vertexBase + cmd.VtxOffset;
+      for (unsigned i = 0; i < cmd.ElemCount; ++i) {
+        indices[indexCount + i] = (GLuint)(base + src[i]);
+        const ImVec2 &p = listVertices[src[i]].pos;
+        inside = inside && p.x >= clip.x && p.x <= clip.z && p.y >= clip.y &&
+                 p.y <= clip.w;
+      }
+
+      Batch batch;
+      batch.texture = (GLuint)(intptr_t)cmd.TextureId;
+      batch.scissor = !inside;
+      int x0 = (int)((clip.x - clipOffset.x) * clipScale.x);
+      int y0 = (int)((clip.y - clipOffset.y) * clipScale.y);
+      int x1 = (int)((clip.z - clipOffset.x) * clipScale.x);
+      int y1 = (int)((clip.w - clipOffset.y) * clipScale.y);
+      batch.clip[0] = x0;
+      batch.clip[1] = fbHeight - y1; // Y is inverted in OpenGL
+      batch.clip[2] = x1 - x0;
+      batch.clip[3] = y1 - y0;
+      batch.firstIndex = indexCount;
+      batch.indexCount = cmd.ElemCount;
+      indexCount += cmd.ElemCount;
+
+      if (!batches.empty()) {
+        Batch &last = batches.back();
+        bool sameClip = !batch.scissor ||
+                        memcmp(last.clip, batch.clip, sizeof(batch.clip)) == 0;
+        if (last.texture == batch.texture && last.scissor == batch.scissor &&
+            sameClip) {
+          last.indexCount += batch.indexCount;
+          continue;
+        }
+      }
+      batches.push_back(batch);
+    }
+    vertexBase += list->VtxBuffer.Size;
+  }
+
+  if (mapped == nullptr) {
+    // Orphan the storage so that the upload does not wait for last frame.
+    size_t used = vertexBytes + indexCount * sizeof(GLuint);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)info.segmentSize, nullptr,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)used, staging.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  // Time on the GPU, read back once the query of a few frames ago is done.
+  GLuint query = 0;
+  if (timerQueriesSupported) {
+    size_t slot = queryFrame++ % queries.size();
+    if (queryPending[slot]) {
+      GLint available = 0;
+      glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available) {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+        lastGpuMs = (float)(elapsed / 1.0e6);
+        queryPending[slot] = false;
+      }
+    }
+    if (!queryPending[slot]) {
+      query = queries[slot];
+      glBeginQuery(GL_TIME_ELAPSED, query);
+      queryPending[slot] = true;
+    }
+  }
+
+  HudGlState current = state;
+  setCapability(GL_BLEND, current.blend, true);
+  setCapability(GL_CULL_FACE, current.cullFace, false);
+  setCapability(GL_DEPTH_TEST, current.depthTest, false);
+  setCapability(GL_STENCIL_TEST, current.stencilTest, false);
+  glBlendEquation(GL_FUNC_ADD);
+  glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE,
+                      GL_ONE_MINUS_SRC_ALPHA);
+  glViewport(0, 0, fbWidth, fbHeight);
+
+  glm::mat4 projection =
+      glm::ortho(clipOffset.x, clipOffset.x + drawData->DisplaySize.x,
+                 clipOffset.y + drawData->DisplaySize.y, clipOffset.y);
+  glUseProgram(program);
+  current.program = program;
+  glUniformMatrix4fv(projectionLocation, 1, GL_FALSE,
+                     glm::value_ptr(projection));
+  glBindVertexArray(vertexArrays[segment]);
+  current.vertexArray = vertexArrays[segment];
+  glActiveTexture(GL_TEXTURE0);
+
+  const GLint *scissorBox = nullptr;
+  size_t indexBase = info.segmentSize * segment + vertexBytes;
+  for (const Batch &batch : batches) {
+    setCapability(GL_SCISSOR_TEST, current.scissorTest, batch.scissor);
+    if (batch.scissor &&
+        (scissorBox == nullptr ||
+         memcmp(scissorBox, batch.clip, sizeof(batch.clip)) != 0)) {
+      glScissor(batch.clip[0], batch.clip[1], batch.clip[2], batch.clip[3]);
+      scissorBox = batch.clip;
+    }
+    if (current.texture != batch.texture) {
+      glBindTexture(GL_TEXTURE_2D, batch.texture);
+      current.texture = batch.texture;
+    }
+    glDrawElements(GL_TRIANGLES, (GLsizei)batch.indexCount, GL_UNSIGNED_INT,
+                   (void *)(indexBase + batch.firstIndex * sizeof(GLuint)));
+    lastDrawCalls++;
+  }
+
+  if (query != 0) {
+    glEndQuery(GL_TIME_ELAPSED);
+  }
+  if (mapped != nullptr) {
+    fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  // Put back only what differs from the state the HUD was drawn over.
+  setCapability(GL_BLEND, current.blend, state.blend);
+  setCapability(GL_CULL_FACE, current.cullFace, state.cullFace);
+  setCapability(GL_DEPTH_TEST, current.depthTest, state.depthTest);
+  setCapability(GL_STENCIL_TEST, current.stencilTest, state.stencilTest);
+  setCapability(GL_SCISSOR_TEST, current.scissorTest, state.scissorTest);
+  if (current.texture != state.texture) {
+    glBindTexture(GL_TEXTURE_2D, state.texture);
+  }
+  if (current.vertexArray != state.vertexArray) {
+    glBindVertexArray(state.vertexArray);
+  }
+  if (current.program != state.program) {
+    glUseProgram(state.program);
+  }
+
+  lastCpuMs = millisecondsSince(start);
+}
+
+void HudRenderer::shutdown() {
+  destroyBuffer();
+  if (!queries.empty()) {
+    glDeleteQueries((GLsizei)queries.size(), queries.data());
+    queries.clear();
+    queryPending.clear();
+  }
+  if (program != 0) {
+    glDeleteProgram(program);
+    program = 0;
+  }
+}
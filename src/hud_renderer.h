@@ -0,0 +1,101 @@
+
+
+#ifndef HUD_RENDERER_H
+#define HUD_RENDERER_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <imgui.h>
+
+// GL state the HUD is drawn over. The renderer changes only what differs
+// from it and puts back what it changed, instead of querying and restoring
+// every piece of state with glGet*, which forces some drivers to
+// synchronize. Blend functions, the viewport and the scissor box are left as
+// the HUD set them; the passes of the next frame set their own.
+struct HudGlState {
+  bool blend = false;
+  bool cullFace = false;
+  bool depthTest = false;
+  bool stencilTest = false;
+  bool scissorTest = false;
+  GLuint program = 0;
+  GLuint vertexArray = 0;
+  GLuint texture = 0; // bound to GL_TEXTURE_2D of texture unit 0
+};
+
+struct HudRendererCreateInfo {
+  // Frames of vertex and index data the ring holds, each fenced, so that the
+  // CPU never writes into data the GPU may still read.
+  int segments = 3;
+  // Initial bytes per segment; grown when a frame needs more.
+  size_t segmentSize = 512 * 1024;
+};
+
+// Draws ImGui's draw data in place of ImGui_ImplOpenGL3_RenderDrawData().
+// Vertices and indices of every window are streamed into one persistently
+// mapped ring buffer (OpenGL 4.4 or ARB_buffer_storage; one orphaned upload
+// per frame otherwise), and consecutive commands with the same texture are
+// merged into one draw wherever their vertices lie within their clip
+// rectangles, so that the scissor test is not needed for them. The font
+// texture is still created by ImGui_ImplOpenGL3_NewFrame().
+class HudRenderer {
+public:
+  explicit HudRenderer(
+      const HudRendererCreateInfo &info = HudRendererCreateInfo());
+  ~HudRenderer();
+
+  HudRenderer(const HudRenderer &) = delete;
+  HudRenderer &operator=(const HudRenderer &) = delete;
+
+  void render(const ImDrawData *drawData,
+              const HudGlState &state = HudGlState());
+
+  // Cost of the last frame: draws issued, CPU time in render(), and GPU time
+  // from a timer query (ARB_timer_query) a few frames old.
+  int drawCalls() const { return lastDrawCalls; }
+  float cpuMs() const { return lastCpuMs; }
+  float gpuMs() const { return lastGpuMs; }
+  bool persistent() const { return mapped != nullptr; }
+
+  // Deletes the buffer, fences and queries; also run by the destructor.
+  void shutdown();
+
+private:
+  // A run of indices drawn with one call.
+  struct Batch {
+    GLuint texture;
+    bool scissor;
+    GLint clip[4]; // x, y, width, height in framebuffer pixels
+    size_t firstIndex;
+    size_t indexCount;
+  };
+
+  void createBuffer(size_t segmentBytes);
+  void destroyBuffer();
+
+  HudRendererCreateInfo info;
+  GLuint program = 0;
+  GLint projectionLocation = -1;
+  GLuint buffer = 0;
+  uint8_t *mapped = nullptr;
+  std::vector<uint8_t> staging; // without persistent mapping
+  std::vector<GLuint> vertexArrays; // one per segment, at its offset
+  std::vector<GLsync> fences;
+  int segment = 0;
+
+  std::vector<Batch> batches;
+
+  bool timerQueriesSupported = false;
+  std::vector<GLuint> queries;
+  std::vector<bool> queryPending;
+  size_t queryFrame = 0;
+
+  int lastDrawCalls = 0;
+  float lastCpuMs = 0.0f;
+  float lastGpuMs = 0.0f;
+};
+
+#endif /* HUD_RENDERER_H */
@@ -1,9 +1,13 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <float.h>
 #include <filesystem>
 #include <map>
+#include <memory>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string>
 #include <vector>
 
 #include <cstddef>
@@ -17,11 +21,25 @@
 #include <imgui.h>
 
 #include "GLDebugMessageCallback.h"
+#include "asset_loader.h"
+#include "camera_latch.h"
+#include "disk_cache.h"
+#include "fleet.h"
+#include "frame_capture.h"
+#include "frame_pacer.h"
+#include "grid.h"
+#include "hud_layer.h"
+#include "hud_renderer.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "mesh.h"
+#include "poster.h"
 #include "render.h"
+#include "render_farm.h"
+#include "satellite.h"
 #include "shader.h"
-#include "texture.h"
+#include "simulation.h"
+#include "virtual_sky.h"
 
 static int SCR_WIDTH = 1920;
 static int SCR_HEIGHT = 1080;
@@ -30,8 +48,29 @@ static float mouseX, mouseY;
 
 static const bool kEnableImGui = true;
 static const int kMaxBloomIter = 5;
-static const float kRenderScale =
-    0.75f; // Render at 75% resolution for performance
+// Resolution presets for the ray marching pass, selectable in the HUD.
+static const float kRenderScales[] = {1.0f, 0.75f, 0.67f, 0.5f};
+static const int kDefaultRenderScale = 1; // Render at 75% for performance
+
+enum Upscaler { kUpscalerBilinear = 0, kUpscalerEASU = 1 };
+
+// Kepler: analytic orbits evaluated and culled on the GPU.
+// Schwarzschild: orbits integrated on the CPU (orbit.h).
+enum FleetMotion { kFleetKepler = 0, kFleetSchwarzschild = 1 };
+
+// How the ray marcher's rays leave the camera (projection in
+// blackhole_main.frag). The rasterized satellites and grid are drawn for the
+// perspective camera only.
+enum Projection {
+  kProjectionPerspective = 0,
+  kProjectionEquirectangular = 1,
+  kProjectionDome = 2,
+  kProjectionCubemap = 3
+};
+// Poster sizes suggested for each projection: 16K, 8K by 4K, an 8K dome
+// master, and 2K cube map faces.
+static const int kPosterSizes[][2] = {
+    {16384, 8192}, {8192, 4096}, {8192, 8192}, {6144, 4096}};
 
 #define IMGUI_TOGGLE(NAME, DEFAULT)                                            \
   static bool NAME = DEFAULT;                                                  \
@@ -51,17 +90,6 @@ static void glfwErrorCallback(int error, const char *description) {
   fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
-struct Mesh {
-  GLuint vao = 0;
-  GLsizei vertexCount = 0;
-};
-
-// 缓动函数：平滑的缓入缓出效果
-float easeInOutCubic(float t) {
-  return t < 0.5f ? 4.0f * t * t * t
-                  : 1.0f - powf(-2.0f * t + 2.0f, 3.0f) / 2.0f;
-}
-
 float easeInOutQuint(float t) {
   return t < 0.5f ? 16.0f * t * t * t * t * t
                   : 1.0f - powf(-2.0f * t + 2.0f, 5.0f) / 2.0f;
@@ -70,446 +98,6 @@ float easeInOutQuint(float t) {
 // 更平滑的缓动：结合 sine 和 cubic
 float easeInOutSine(float t) { return -(cosf(3.14159265f * t) - 1.0f) / 2.0f; }
 
-glm::vec3 calculateBezierPoint(float t, const glm::vec3 &p0,
-                               const glm::vec3 &p1, const glm::vec3 &p2,
-                               const glm::vec3 &p3) {
-  float u = 1.0f - t;
-  float tt = t * t;
-  float uu = u * u;
-  float uuu = uu * u;
-  float ttt = tt * t;
-
-  return uuu * p0 + 3.0f * uu * t * p1 + 3.0f * u * tt * p2 + ttt * p3;
-}
-
-Mesh createSatelliteMesh() {
-  struct Vertex {
-    glm::vec3 pos;
-    glm::vec3 normal;
-  };
-
-  std::vector<Vertex> vertices;
-
-  auto addFace = [&](const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
-                     const glm::vec3 &d) {
-    glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
-    vertices.push_back({a, n});
-    vertices.push_back({b, n});
-    vertices.push_back({c, n});
-    vertices.push_back({a, n});
-    vertices.push_back({c, n});
-    vertices.push_back({d, n});
-  };
-
-  auto addTri = [&](const glm::vec3 &a, const glm::vec3 &b,
-                    const glm::vec3 &c) {
-    glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
-    vertices.push_back({a, n});
-    vertices.push_back({b, n});
-    vertices.push_back({c, n});
-  };
-
-  auto addBox = [&](const glm::vec3 &center, const glm::vec3 &halfSize) {
-    glm::vec3 p000 = center + glm::vec3(-halfSize.x, -halfSize.y, -halfSize.z);
-    glm::vec3 p001 = center + glm::vec3(-halfSize.x, -halfSize.y, halfSize.z);
-    glm::vec3 p010 = center + glm::vec3(-halfSize.x, halfSize.y, -halfSize.z);
-    glm::vec3 p011 = center + glm::vec3(-halfSize.x, halfSize.y, halfSize.z);
-    glm::vec3 p100 = center + glm::vec3(halfSize.x, -halfSize.y, -halfSize.z);
-    glm::vec3 p101 = center + glm::vec3(halfSize.x, -halfSize.y, halfSize.z);
-    glm::vec3 p110 = center + glm::vec3(halfSize.x, halfSize.y, -halfSize.z);
-    glm::vec3 p111 = center + glm::vec3(halfSize.x, halfSize.y, halfSize.z);
-
-    // +X, -X, +Y, -Y, +Z, -Z faces
-    addFace(p100, p110, p111, p101);
-    addFace(p010, p000, p001, p011);
-    addFace(p110, p010, p011, p111);
-    addFace(p000, p100, p101, p001);
-    addFace(p101, p111, p011, p001);
-    addFace(p100, p000, p010, p110);
-  };
-
-  // Helper to add a cylinder along Y axis
-  auto addCylinder = [&](const glm::vec3 &base, float radius, float height,
-                         int segments) {
-    for (int i = 0; i < segments; i++) {
-      float a0 = 2.0f * 3.14159f * i / segments;
-      float a1 = 2.0f * 3.14159f * (i + 1) / segments;
-      glm::vec3 p0 = base + glm::vec3(cos(a0) * radius, 0, sin(a0) * radius);
-      glm::vec3 p1 = base + glm::vec3(cos(a1) * radius, 0, sin(a1) * radius);
-      glm::vec3 p2 = p1 + glm::vec3(0, height, 0);
-      glm::vec3 p3 = p0 + glm::vec3(0, height, 0);
-      addFace(p0, p1, p2, p3);
-      // Top cap
-      glm::vec3 topCenter = base + glm::vec3(0, height, 0);
-      addTri(topCenter, p3, p2);
-      // Bottom cap
-      addTri(base, p1, p0);
-    }
-  };
-
-  // Helper to add a cone along Y axis
-  auto addCone = [&](const glm::vec3 &base, float radius, float height,
-                     int segments) {
-    glm::vec3 tip = base + glm::vec3(0, height, 0);
-    for (int i = 0; i < segments; i++) {
-      float a0 = 2.0f * 3.14159f * i / segments;
-      float a1 = 2.0f * 3.14159f * (i + 1) / segments;
-      glm::vec3 p0 = base + glm::vec3(cos(a0) * radius, 0, sin(a0) * radius);
-      glm::vec3 p1 = base + glm::vec3(cos(a1) * radius, 0, sin(a1) * radius);
-      addTri(p0, p1, tip);
-      addTri(base, p1, p0);
-    }
-  };
-
-  // ========== MAIN BODY ==========
-  // Central octagonal body (more interesting than a box)
-  float bodyRadius = 0.32f;
-  float bodyHeight = 0.5f;
-  int bodySides = 8;
-  glm::vec3 bodyBase = glm::vec3(0, -bodyHeight / 2, 0);
-  for (int i = 0; i < bodySides; i++) {
-    float a0 = 2.0f * 3.14159f * i / bodySides;
-    float a1 = 2.0f * 3.14159f * (i + 1) / bodySides;
-    glm::vec3 p0 =
-        bodyBase + glm::vec3(cos(a0) * bodyRadius, 0, sin(a0) * bodyRadius);
-    glm::vec3 p1 =
-        bodyBase + glm::vec3(cos(a1) * bodyRadius, 0, sin(a1) * bodyRadius);
-    glm::vec3 p2 = p1 + glm::vec3(0, bodyHeight, 0);
-    glm::vec3 p3 = p0 + glm::vec3(0, bodyHeight, 0);
-    addFace(p0, p1, p2, p3);
-    // Top cap
-    glm::vec3 topCenter = glm::vec3(0, bodyHeight / 2, 0);
-    addTri(topCenter, p3, p2);
-    // Bottom cap
-    glm::vec3 bottomCenter = glm::vec3(0, -bodyHeight / 2, 0);
-    addTri(bottomCenter, p1, p0);
-  }
-
-  // ========== SOLAR PANEL ARMS ==========
-  // Connection arms from body to panels
-  addBox(glm::vec3(-0.5f, 0.0f, 0.0f), glm::vec3(0.18f, 0.04f, 0.04f));
-  addBox(glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.18f, 0.04f, 0.04f));
-
-  // ========== SOLAR PANELS (segmented for realism) ==========
-  // Left panel - main frame
-  float panelX = -1.15f;
-  float panelWidth = 0.75f;
-  float panelHeight = 0.45f;
-  addBox(glm::vec3(panelX, 0.0f, 0.0f),
-         glm::vec3(panelWidth, 0.02f, panelHeight));
-  // Panel frame edges
-  addBox(glm::vec3(panelX, 0.025f, panelHeight - 0.02f),
-         glm::vec3(panelWidth, 0.015f, 0.02f));
-  addBox(glm::vec3(panelX, 0.025f, -panelHeight + 0.02f),
-         glm::vec3(panelWidth, 0.015f, 0.02f));
-  addBox(glm::vec3(panelX - panelWidth + 0.02f, 0.025f, 0.0f),
-         glm::vec3(0.02f, 0.015f, panelHeight - 0.02f));
-  addBox(glm::vec3(panelX + panelWidth - 0.02f, 0.025f, 0.0f),
-         glm::vec3(0.02f, 0.015f, panelHeight - 0.02f));
-  // Panel grid lines
-  for (int i = 1; i < 4; i++) {
-    float offset = panelX - panelWidth + (2.0f * panelWidth * i / 4.0f);
-    addBox(glm::vec3(offset, 0.022f, 0.0f),
-           glm::vec3(0.008f, 0.008f, panelHeight - 0.03f));
-  }
-
-  // Right panel - main frame
-  panelX = 1.15f;
-  addBox(glm::vec3(panelX, 0.0f, 0.0f),
-         glm::vec3(panelWidth, 0.02f, panelHeight));
-  // Panel frame edges
-  addBox(glm::vec3(panelX, 0.025f, panelHeight - 0.02f),
-         glm::vec3(panelWidth, 0.015f, 0.02f));
-  addBox(glm::vec3(panelX, 0.025f, -panelHeight + 0.02f),
-         glm::vec3(panelWidth, 0.015f, 0.02f));
-  addBox(glm::vec3(panelX - panelWidth + 0.02f, 0.025f, 0.0f),
-         glm::vec3(0.02f, 0.015f, panelHeight - 0.02f));
-  addBox(glm::vec3(panelX + panelWidth - 0.02f, 0.025f, 0.0f),
-         glm::vec3(0.02f, 0.015f, panelHeight - 0.02f));
-  // Panel grid lines
-  for (int i = 1; i < 4; i++) {
-    float offset = panelX - panelWidth + (2.0f * panelWidth * i / 4.0f);
-    addBox(glm::vec3(offset, 0.022f, 0.0f),
-           glm::vec3(0.008f, 0.008f, panelHeight - 0.03f));
-  }
-
-  // ========== ANTENNA DISH ==========
-  // Dish base/mount on top
-  addCylinder(glm::vec3(0, 0.25f, 0), 0.08f, 0.06f, 12);
-  // Dish arm
-  addBox(glm::vec3(0, 0.38f, 0.12f), glm::vec3(0.02f, 0.08f, 0.02f));
-  // Simplified dish (cone shape)
-  addCone(glm::vec3(0, 0.32f, 0.22f), 0.12f, 0.08f, 12);
-
-  // ========== COMMUNICATION ANTENNAS ==========
-  // Small antenna masts
-  addCylinder(glm::vec3(0.15f, 0.25f, -0.15f), 0.015f, 0.25f, 6);
-  addCylinder(glm::vec3(-0.15f, 0.25f, 0.15f), 0.015f, 0.2f, 6);
-  // Antenna tips
-  addBox(glm::vec3(0.15f, 0.52f, -0.15f), glm::vec3(0.025f, 0.025f, 0.025f));
-  addBox(glm::vec3(-0.15f, 0.47f, 0.15f), glm::vec3(0.02f, 0.02f, 0.02f));
-
-  // ========== THRUSTERS ==========
-  // Bottom thrusters (4 corner nozzles)
-  float thrusterOffset = 0.2f;
-  addCone(glm::vec3(thrusterOffset, -0.25f, thrusterOffset), 0.04f, -0.08f, 8);
-  addCone(glm::vec3(-thrusterOffset, -0.25f, thrusterOffset), 0.04f, -0.08f, 8);
-  addCone(glm::vec3(thrusterOffset, -0.25f, -thrusterOffset), 0.04f, -0.08f, 8);
-  addCone(glm::vec3(-thrusterOffset, -0.25f, -thrusterOffset), 0.04f, -0.08f,
-          8);
-
-  // ========== SENSOR EQUIPMENT ==========
-  // Front sensor package
-  addBox(glm::vec3(0, 0, 0.38f), glm::vec3(0.12f, 0.1f, 0.06f));
-  addCylinder(glm::vec3(0.06f, -0.02f, 0.44f), 0.025f, 0.04f, 8);
-  addCylinder(glm::vec3(-0.06f, -0.02f, 0.44f), 0.025f, 0.04f, 8);
-
-  // ========== DECORATIVE DETAILS ==========
-  // Body accent strips
-  for (int i = 0; i < 4; i++) {
-    float angle = 3.14159f / 4.0f + i * 3.14159f / 2.0f;
-    glm::vec3 stripPos = glm::vec3(cos(angle) * 0.33f, 0, sin(angle) * 0.33f);
-    addBox(stripPos, glm::vec3(0.015f, 0.26f, 0.015f));
-  }
-
-  GLuint vao, vbo;
-  glGenVertexArrays(1, &vao);
-  glGenBuffers(1, &vbo);
-
-  glBindVertexArray(vao);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
-               vertices.data(), GL_STATIC_DRAW);
-
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                        (void *)offsetof(Vertex, normal));
-
-  glBindVertexArray(0);
-
-  Mesh mesh;
-  mesh.vao = vao;
-  mesh.vertexCount = (GLsizei)vertices.size();
-  return mesh;
-}
-
-Mesh createBezierSurfaceMesh(int uSteps, int vSteps) {
-  std::vector<glm::vec3> vertices;
-  for (int i = 0; i < uSteps; i++) {
-    for (int j = 0; j < vSteps; j++) {
-      float u0 = (float)i / uSteps;
-      float u1 = (float)(i + 1) / uSteps;
-      float v0 = (float)j / vSteps;
-      float v1 = (float)(j + 1) / vSteps;
-
-      // Two triangles per quad.
-      // Z component is unused here as UV are passed in X,Y. Shader evaluates position.
-      vertices.push_back({u0, v0, 0.0f});
-      vertices.push_back({u1, v0, 0.0f});
-      vertices.push_back({u0, v1, 0.0f});
-
-      vertices.push_back({u1, v0, 0.0f});
-      vertices.push_back({u1, v1, 0.0f});
-      vertices.push_back({u0, v1, 0.0f});
-    }
-  }
-
-  GLuint vao, vbo;
-  glGenVertexArrays(1, &vao);
-  glGenBuffers(1, &vbo);
-
-  glBindVertexArray(vao);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3),
-               vertices.data(), GL_STATIC_DRAW);
-
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
-
-  glBindVertexArray(0);
-
-  Mesh mesh;
-  mesh.vao = vao;
-  mesh.vertexCount = (GLsizei)vertices.size();
-  return mesh;
-}
-
-struct CameraState {
-  glm::vec3 pos;
-  glm::vec3 target;
-  float fovScale;
-  float rollRadians;
-  glm::mat4 view;
-  glm::mat4 projection;
-};
-
-CameraState computeCameraState(double timeSeconds, int width, int height,
-                               float mouseX, float mouseY,
-                               bool mouseControlEnabled, bool frontView,
-                               bool topView, float cameraRollDeg,
-                               float fovScale, bool autopilotActive,
-                               const glm::vec3 &autopilotPos) {
-  CameraState cs{};
-  cs.fovScale = fovScale;
-  cs.rollRadians = glm::radians(cameraRollDeg);
-
-  if (autopilotActive) {
-    cs.pos = autopilotPos;
-  } else if (mouseControlEnabled) {
-    glm::vec2 mouse =
-        glm::clamp(glm::vec2(mouseX, mouseY) / glm::vec2(width, height),
-                   glm::vec2(0.0f), glm::vec2(1.0f)) -
-        glm::vec2(0.5f);
-    cs.pos = glm::vec3(-cos(mouse.x * 10.0f) * 15.0f, mouse.y * 30.0f,
-                       sin(mouse.x * 10.0f) * 15.0f);
-  } else if (frontView) {
-    cs.pos = glm::vec3(10.0f, 1.0f, 10.0f);
-  } else if (topView) {
-    cs.pos = glm::vec3(15.0f, 15.0f, 0.0f);
-  } else {
-    cs.pos = glm::vec3(-cos((float)timeSeconds * 0.1f) * 15.0f,
-                       sin((float)timeSeconds * 0.1f) * 15.0f,
-                       sin((float)timeSeconds * 0.1f) * 15.0f);
-  }
-
-  cs.target = glm::vec3(0.0f);
-
-  float aspect = (float)width / (float)height;
-  float fovY = 2.0f * atan(0.5f * fovScale);
-  glm::vec3 up =
-      glm::normalize(glm::vec3(sin(cs.rollRadians), cos(cs.rollRadians), 0.0f));
-
-  cs.view = glm::lookAt(cs.pos, cs.target, up);
-  cs.projection = glm::perspective(fovY, aspect, 0.1f, 500.0f);
-
-  return cs;
-}
-
-// 计算卫星在椭圆轨道上的位置和朝向
-struct SatelliteState {
-  glm::vec3 position;
-  glm::vec3 velocity; // 用于计算朝向
-};
-
-SatelliteState computeSatelliteOrbit(double timeSeconds) {
-  // 椭圆轨道参数
-  const float semiMajorAxis = 5.5f;       // 半长轴
-  const float eccentricity = 0.3f;        // 离心率
-  const float inclination = 15.0f;        // 轨道倾角（度）
-  const float orbitSpeed = 0.15f;         // 轨道角速度
-  const float verticalOscillation = 0.8f; // 垂直振荡幅度
-  const float verticalFreq = 0.4f;        // 垂直振荡频率
-
-  float angle = (float)(timeSeconds * orbitSpeed);
-
-  // 椭圆轨道半径 r = a(1-e²) / (1 + e*cos(θ))
-  float r = semiMajorAxis * (1.0f - eccentricity * eccentricity) /
-            (1.0f + eccentricity * cos(angle));
-
-  // 基础椭圆位置
-  float x = r * cos(angle);
-  float z = r * sin(angle);
-
-  // 添加轨道倾角
-  float incRad = glm::radians(inclination);
-  float y = z * sin(incRad) +
-            verticalOscillation * sin((float)timeSeconds * verticalFreq);
-  z = z * cos(incRad);
-
-  // 计算速度方向（用于卫星朝向）
-  float nextAngle = angle + 0.01f;
-  float nextR = semiMajorAxis * (1.0f - eccentricity * eccentricity) /
-                (1.0f + eccentricity * cos(nextAngle));
-  float nextX = nextR * cos(nextAngle);
-  float nextZ = nextR * sin(nextAngle);
-  float nextY =
-      nextZ * sin(incRad) +
-      verticalOscillation * sin((float)(timeSeconds + 0.01) * verticalFreq);
-  nextZ = nextZ * cos(incRad);
-
-  SatelliteState state;
-  state.position = glm::vec3(x, y, z);
-  state.velocity = glm::normalize(glm::vec3(nextX - x, nextY - y, nextZ - z));
-  return state;
-}
-
-glm::mat4 computeSatelliteModel(double timeSeconds, const glm::vec3 &worldPos,
-                                const glm::vec3 &velocity) {
-  const float selfSpinSpeed = 1.2f; // 自转速度
-  const float wobbleAmount = 5.0f;  // 轻微摇摆幅度（度）
-  const float wobbleSpeed = 2.0f;
-
-  glm::mat4 model = glm::translate(glm::mat4(1.0f), worldPos);
-
-  // 计算卫星朝向运动方向的旋转
-  glm::vec3 forward = velocity;
-  glm::vec3 worldUp = glm::vec3(0.0f, 1.0f, 0.0f);
-  glm::vec3 right = glm::normalize(glm::cross(worldUp, forward));
-  glm::vec3 up = glm::cross(forward, right);
-
-  // 构建朝向矩阵
-  glm::mat4 orientation = glm::mat4(1.0f);
-  orientation[0] = glm::vec4(right, 0.0f);
-  orientation[1] = glm::vec4(up, 0.0f);
-  orientation[2] = glm::vec4(forward, 0.0f);
-
-  model = model * orientation;
-
-  // 添加轻微摇摆
-  float wobble = wobbleAmount * sin((float)timeSeconds * wobbleSpeed);
-  model = glm::rotate(model, glm::radians(wobble), glm::vec3(1.0f, 0.0f, 0.0f));
-  model = glm::rotate(model, glm::radians(wobble * 0.7f),
-                      glm::vec3(0.0f, 0.0f, 1.0f));
-
-  // 太阳能板自转（绕自身Y轴）
-  model = glm::rotate(model, (float)(timeSeconds * selfSpinSpeed),
-                      glm::vec3(0.0f, 1.0f, 0.0f));
-
-  model = glm::scale(model, glm::vec3(0.18f));
-  return model;
-}
-
-
-
-void renderSatellite(const Mesh &mesh, GLuint program, const glm::mat4 &model,
-                     const glm::mat4 &view, const glm::mat4 &projection,
-                     const glm::vec3 &cameraPos, const glm::vec3 &lightDir,
-                     GLuint galaxyCubemap, float dishAngle, float time) {
-  glUseProgram(program);
-
-  glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE,
-                     glm::value_ptr(model));
-  glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE,
-                     glm::value_ptr(view));
-  glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE,
-                     glm::value_ptr(projection));
-  glUniform3fv(glGetUniformLocation(program, "viewPos"), 1,
-               glm::value_ptr(cameraPos));
-  glUniform3fv(glGetUniformLocation(program, "lightDir"), 1,
-               glm::value_ptr(lightDir));
-  glUniform3f(glGetUniformLocation(program, "lightColor"), 1.0f, 0.95f, 0.85f);
-  glUniform3f(glGetUniformLocation(program, "rimColor"), 1.4f, 1.2f, 0.95f);
-  glUniform1f(glGetUniformLocation(program, "rimStrength"), 1.35f);
-
-  // Time for animated effects (blinking lights, etc.)
-  glUniform1f(glGetUniformLocation(program, "time"), time);
-
-  glUniform1f(glGetUniformLocation(program, "dishRotation"), dishAngle);
-
-  // Bind Cubemap
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, galaxyCubemap);
-  glUniform1i(glGetUniformLocation(program, "galaxy"), 0);
-
-  glBindVertexArray(mesh.vao);
-  glDrawArrays(GL_TRIANGLES, 0, mesh.vertexCount);
-  glBindVertexArray(0);
-
-  glUseProgram(0);
-}
-
 void mouseCallback(GLFWwindow * /*window*/, double x, double y) {
   mouseX = (float)x;
   mouseY = (float)y;
@@ -528,8 +116,11 @@ public:
     glUseProgram(0);
   }
 
+  // hudLayer, if not 0, is composited over the output (see HudLayer).
   void render(GLuint inputColorTexture, int width, int height,
-              GLuint destFramebuffer = 0) {
+              GLuint destFramebuffer = 0,
+              const std::map<std::string, float> &floatUniforms = {},
+              GLuint hudLayer = 0) {
     glBindFramebuffer(GL_FRAMEBUFFER, destFramebuffer);
 
     glViewport(0, 0, width, height);
@@ -546,9 +137,22 @@ public:
     glUniform1f(glGetUniformLocation(this->program, "time"),
                 (float)glfwGetTime());
 
+    for (auto const &[name, val] : floatUniforms) {
+      glUniform1f(glGetUniformLocation(this->program, name.c_str()), val);
+    }
+
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, inputColorTexture);
 
+    glUniform1f(glGetUniformLocation(this->program, "hudLayerEnabled"),
+                hudLayer != 0 ? 1.0f : 0.0f);
+    if (hudLayer != 0) {
+      glUniform1i(glGetUniformLocation(this->program, "hudLayer"), 1);
+      glActiveTexture(GL_TEXTURE1);
+      glBindTexture(GL_TEXTURE_2D, hudLayer);
+      glActiveTexture(GL_TEXTURE0);
+    }
+
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
     glUseProgram(0);
@@ -556,6 +160,44 @@ public:
 };
 
 int main(int argc, char **argv) {
+  // --coordinator renders the autopilot flythrough on worker processes, which
+  // are this program run with --worker HOST:PORT (see RenderCoordinator).
+  bool coordinator = false;
+  std::string workerAddress;
+  RenderCoordinatorCreateInfo farmInfo;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (arg == "--coordinator") {
+      coordinator = true;
+    } else if (arg == "--worker" && value) {
+      workerAddress = argv[++i];
+    } else if (arg == "--workers" && value) {
+      farmInfo.localWorkers = atoi(argv[++i]);
+    } else if (arg == "--port" && value) {
+      farmInfo.port = atoi(argv[++i]);
+    } else if (arg == "--size" && value) {
+      sscanf(argv[++i], "%dx%d", &farmInfo.width, &farmInfo.height);
+    } else if (arg == "--fps" && value) {
+      farmInfo.fps = (float)atof(argv[++i]);
+    } else if (arg == "--frames" && value) {
+      sscanf(argv[++i], "%d-%d", &farmInfo.firstFrame, &farmInfo.lastFrame);
+    } else if (arg == "--tile" && value) {
+      farmInfo.tileSize = atoi(argv[++i]);
+    } else if (arg == "--output" && value) {
+      farmInfo.outputDirectory = argv[++i];
+    } else {
+      fprintf(stderr, "Unknown argument %s\n", argv[i]);
+    }
+  }
+  if (coordinator) {
+    std::error_code error;
+    farmInfo.outputDirectory =
+        std::filesystem::absolute(farmInfo.outputDirectory, error).string();
+    farmInfo.workerCommand = {
+        std::filesystem::absolute(argv[0], error).string(), "--worker"};
+  }
+
   // Ensure working directory is where the executable lives so relative asset
   // paths (assets/, shader/) are found even when launched from Finder.
   try {
@@ -565,6 +207,11 @@ int main(int argc, char **argv) {
   } catch (...) {
   }
 
+  if (coordinator) {
+    RenderCoordinator farm(farmInfo);
+    return farm.run() ? 0 : 1;
+  }
+
   // Setup window
   glfwSetErrorCallback(glfwErrorCallback);
   if (!glfwInit())
@@ -587,13 +234,17 @@ int main(int argc, char **argv) {
   // glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // 3.0+ only
 #endif
 
+  // Workers render offscreen.
+  if (!workerAddress.empty()) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  }
+
   // Create window with graphics context (windowed)
   GLFWwindow *window =
       glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "UNMANNED STARRY SKY", NULL, NULL);
   if (window == NULL)
     return 1;
   glfwMakeContextCurrent(window);
-  glfwSwapInterval(1); // Enable vsync
   glfwSetCursorPosCallback(window, mouseCallback);
   glfwSetWindowPos(window, 0, 0);
 
@@ -645,20 +296,52 @@ int main(int argc, char **argv) {
     ImGui_ImplOpenGL3_Init(glsl_version);
   }
 
+  // Filter across cube face edges, which the sky's small mip levels need.
+  if (GLEW_VERSION_3_2 || GLEW_ARB_seamless_cube_map) {
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+  }
+
+  // Every program compiles in parallel while the rest of the setup runs; the
+  // create calls below and renderToTexture() pick them up from the manager.
+  // The ray marcher goes first as it takes by far the longest.
+  ShaderManager shaderManager(window);
+  shaderManager.submit("shader/simple.vert", "shader/blackhole_main.frag");
+  shaderManager.submit("shader/satellite.vert", "shader/satellite.frag");
+  shaderManager.submit("shader/grid.vert", "shader/grid.frag");
+  shaderManager.submit("shader/hud.vert", "shader/hud.frag");
+  submitSatelliteFleetShaders(shaderManager);
+  for (const char *fragShader :
+       {"shader/bloom_brightness_pass.frag", "shader/bloom_downsample.frag",
+        "shader/bloom_upsample.frag", "shader/bloom_composite.frag",
+        "shader/tonemapping.frag", "shader/upscale_easu.frag",
+        "shader/upscale_rcas.frag", "shader/passthrough.frag",
+        "shader/disk_cache.frag"}) {
+    shaderManager.submit("shader/simple.vert", fragShader);
+  }
+
   GLuint fboBlackhole = 0, texBlackhole = 0;
 
   GLuint quadVAO = createQuadVAO();
   glBindVertexArray(quadVAO);
 
+  // Decoded on the thread pool while the rest of the setup runs; drawn with
+  // placeholders until uploaded.
+  AssetLoader assetLoader;
+  int galaxyAsset = assetLoader.requestCubemap("assets/skybox_nebula_dark",
+                                               glm::vec3(0.02f, 0.02f, 0.04f));
+  int colorMapAsset = assetLoader.requestTexture2D("assets/color_map.png");
+
+  // Tiled sky streamed on demand, if a pyramid was built with texpack --vt.
+  VirtualSky virtualSky;
+  virtualSky.open(virtualTexturePath("assets/skybox_nebula_dark"));
+
   Mesh satelliteMesh = createSatelliteMesh();
-  GLuint satelliteProgram =
-      createShaderProgram("shader/satellite.vert", "shader/satellite.frag");
-  GLuint blackholeProgram =
-      createShaderProgram("shader/simple.vert", "shader/blackhole_main.frag");
 
   // Spacetime Curvature Grid (Gravity Well) Setup
-  Mesh gridMesh = createBezierSurfaceMesh(80, 80);
-  GLuint gridProgram = createShaderProgram("shader/grid.vert", "shader/grid.frag");
+  BezierGridCreateInfo gridInfo;
+  gridInfo.uSteps = 80;
+  gridInfo.vSteps = 80;
+  BezierGrid grid = createBezierGrid(gridInfo);
 
   // 4x4 Control Points for "Spacetime Curvature Grid" (Gravity Well)
   // Grid spans from -25 to +25 in X and Z, flat plane at y = -5.0
@@ -682,41 +365,76 @@ int main(int argc, char **argv) {
       }
   }
 
-  // Main loop
+  HudLayer hudLayer;
+  std::unique_ptr<FrameCapture> capture; // while recording
+  std::unique_ptr<Poster> poster;         // while rendering a poster
+  SimulationState tileFrame;              // the frame a tile shows
+  std::unique_ptr<RenderWorker> worker;   // with --worker
+  RenderJob job;                          // the worker's current job
+
+  // Everything that takes a program comes last, so that the setup above ran
+  // while they compiled; the ray marcher, the slowest, is taken last of all.
+  GLuint satelliteProgram =
+      createShaderProgram("shader/satellite.vert", "shader/satellite.frag");
+  SatelliteFleetCreateInfo fleetCreateInfo;
+  SatelliteFleet fleet = createSatelliteFleet(fleetCreateInfo, satelliteMesh);
+  GLuint gridProgram = createShaderProgram("shader/grid.vert", "shader/grid.frag");
   PostProcessPass passthrough("shader/passthrough.frag");
+  PostProcessPass sharpen("shader/upscale_rcas.frag");
+  HudRenderer hudRenderer;
+  DiskCache diskCache;
+  GLuint blackholeProgram =
+      createShaderProgram("shader/simple.vert", "shader/blackhole_main.frag");
+  shaderManager.finish();
 
-  double lastFrameTime = glfwGetTime();
-  bool autopilotActive = false;
-  double autopilotT = 0.0;
-  bool prevCKey = false;
-  const float autopilotDuration = 18.0f; // 增加动画时长让动画更从容
+  // Vsync with up to two frames queued on the GPU, switchable in the HUD.
+  FramePacer framePacer;
+
+  if (!workerAddress.empty()) {
+    worker = std::make_unique<RenderWorker>(workerAddress);
+    if (!worker->ok()) {
+      return 1;
+    }
+    // Jobs go out as fast as the GPU renders them.
+    framePacer.setPresentMode(kPresentUncapped);
+  }
 
-  // 优化的贝塞尔曲线控制点 - 创建更优美的螺旋接近路径
-  const glm::vec3 bezierP0 = glm::vec3(25.0f, 12.0f, 25.0f); // 起点：远处高位
-  const glm::vec3 bezierP1 =
-      glm::vec3(-15.0f, 8.0f, 20.0f); // 控制点1：绕到左侧
-  const glm::vec3 bezierP2 =
-      glm::vec3(12.0f, 3.0f, 8.0f); // 控制点2：绕到右侧低位
-  const glm::vec3 bezierP3 = glm::vec3(0.0f, 1.0f, 5.0f); // 终点：靠近黑洞
+  // The ray marcher reads its camera from a buffer written right before its
+  // draw, so that mouse orbiting can use the freshest cursor position.
+  CameraLatch cameraLatch;
+  cameraLatch.attach(blackholeProgram);
+
+  // Camera, autopilot, satellite and CPU fleet run on their own thread; the
+  // loop below feeds it input and draws interpolated snapshots.
+  SimulationCreateInfo simulationInfo;
+  simulationInfo.fleetCapacity = fleet.capacity;
+  simulationInfo.fleetSeed = fleetCreateInfo.seed;
+  Simulation simulation(simulationInfo);
+  SimulationInput simulationInput;
+  bool prevCKey = false;
 
   while (!glfwWindowShouldClose(window)) {
+    framePacer.beginFrame();
     glfwPollEvents();
 
+    // A worker renders its jobs one after another and quits with the
+    // coordinator.
+    if (worker) {
+      if (!worker->nextJob(job)) {
+        break;
+      }
+      tileFrame = flythroughState(job.time);
+    }
+
     // ESC key to exit
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
       glfwSetWindowShouldClose(window, GLFW_TRUE);
     }
 
-    double now = glfwGetTime();
-    double deltaTime = now - lastFrameTime;
-    lastFrameTime = now;
-
     // Camera mode controls
     bool cPressed = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
     if (cPressed && !prevCKey) {
-      autopilotActive = !autopilotActive;
-      if (autopilotActive)
-        autopilotT = 0.0;
+      simulationInput.autopilotToggles++;
     }
     prevCKey = cPressed;
 
@@ -728,10 +446,6 @@ int main(int argc, char **argv) {
     if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) cameraPreset = 4;
     if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS) cameraPreset = 0;
 
-    if (autopilotActive) {
-      autopilotT = std::min(1.0, autopilotT + deltaTime / autopilotDuration);
-    }
-
     if (kEnableImGui) {
       ImGui_ImplOpenGL3_NewFrame();
       ImGui_ImplGlfw_NewFrame();
@@ -744,14 +458,51 @@ int main(int argc, char **argv) {
     glfwGetFramebufferSize(window, &width, &height);
     if (width <= 0 || height <= 0) {
       glfwSwapBuffers(window);
+      framePacer.endFrame();
       continue;
     }
     glViewport(0, 0, width, height);
 
     // renderScene(fboBlackhole);
 
-    static GLuint galaxy = loadCubemap("assets/skybox_nebula_dark");
-    static GLuint colorMap = loadTexture2D("assets/color_map.png");
+    assetLoader.update();
+    virtualSky.update();
+    if (kEnableImGui) {
+      const ShaderCacheStats &shaderCache = shaderCacheStats();
+      ImGui::Text("Shader cache: %d/%d hits, %.0f ms of compiling saved",
+                  shaderCache.hits, shaderCache.hits + shaderCache.misses,
+                  shaderCache.savedMs);
+
+      int presentMode = framePacer.presentMode();
+      if (ImGui::Combo("presentMode", &presentMode,
+                       "Vsync\0" "Uncapped\0" "Limited\0" "Adaptive\0")) {
+        framePacer.setPresentMode(presentMode);
+      }
+      int framesInFlight = framePacer.framesInFlight();
+      if (ImGui::SliderInt("framesInFlight", &framesInFlight, 1, 3)) {
+        framePacer.setFramesInFlight(framesInFlight);
+      }
+      if (presentMode == kPresentLimited) {
+        static float targetFps = 60.0f;
+        if (ImGui::SliderFloat("targetFps", &targetFps, 15.0f, 240.0f)) {
+          framePacer.setTargetFps(targetFps);
+        }
+      }
+      std::vector<float> latency = framePacer.latencyHistory();
+      ImGui::PlotLines("##latency", latency.data(), (int)latency.size(), 0,
+                       nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+      ImGui::Text("GPU latency: %.1f ms (avg %.1f, max %.1f)",
+                  framePacer.latencyMs(), framePacer.averageLatencyMs(),
+                  framePacer.maxLatencyMs());
+      ImGui::Text("Waited %.1f ms on fences, %.1f ms on the limiter",
+                  framePacer.fenceWaitMs(), framePacer.limiterWaitMs());
+      ImGui::Text("Input latency: %.1f ms (avg %.1f, max %.1f)",
+                  framePacer.inputLatencyMs(),
+                  framePacer.averageInputLatencyMs(),
+                  framePacer.maxInputLatencyMs());
+    }
+    GLuint galaxy = assetLoader.texture(galaxyAsset);
+    GLuint colorMap = assetLoader.texture(colorMapAsset);
 
     static int renderWidth = 0;
     static int renderHeight = 0;
@@ -760,10 +511,35 @@ int main(int argc, char **argv) {
     static GLuint texUpsampled[kMaxBloomIter] = {};
     static GLuint texBloomFinal = 0;
     static GLuint texTonemapped = 0;
+    static int upscaledWidth = 0;
+    static int upscaledHeight = 0;
+    static GLuint texUpscaled = 0;
+
+    static int renderScaleIndex = kDefaultRenderScale;
+    static int upscaler = kUpscalerEASU;
+    if (kEnableImGui) {
+      ImGui::Combo("renderScale", &renderScaleIndex,
+                   "100%\0" "75%\0" "67%\0" "50%\0");
+      ImGui::Combo("upscaler", &upscaler, "Bilinear\0" "EASU + RCAS\0");
+    }
+    const float renderScale = kRenderScales[renderScaleIndex];
 
     // Use scaled resolution for expensive ray marching pass
-    int scaledWidth = (int)(width * kRenderScale);
-    int scaledHeight = (int)(height * kRenderScale);
+    int scaledWidth = (int)(width * renderScale);
+    int scaledHeight = (int)(height * renderScale);
+    // One tile of a poster or a job a frame; the window shows it as it is
+    // done.
+    bool tiled = poster || worker;
+    ImageTile tile;
+    if (worker) {
+      tile = job.tile;
+    } else if (poster) {
+      tile = poster->currentTile();
+    }
+    if (tiled) {
+      scaledWidth = tile.renderWidth;
+      scaledHeight = tile.renderHeight;
+    }
     if (scaledWidth < 1)
       scaledWidth = 1;
     if (scaledHeight < 1)
@@ -776,6 +552,21 @@ int main(int argc, char **argv) {
       SCR_WIDTH = width;
       SCR_HEIGHT = height;
 
+      // Posters switch to the tile size and back, so free the old targets.
+      if (fboBlackhole != 0) {
+        deleteFramebuffer(fboBlackhole);
+      }
+      if (texBlackhole != 0) {
+        deleteColorTexture(texBlackhole);
+        deleteColorTexture(texBrightness);
+        deleteColorTexture(texBloomFinal);
+        deleteColorTexture(texTonemapped);
+        for (int i = 0; i < kMaxBloomIter; i++) {
+          deleteColorTexture(texDownsampled[i]);
+          deleteColorTexture(texUpsampled[i]);
+        }
+      }
+
       texBlackhole = createColorTexture(renderWidth, renderHeight);
 
       FramebufferCreateInfo fbInfo = {};
@@ -785,6 +576,7 @@ int main(int argc, char **argv) {
       fbInfo.createDepthBuffer = true;
       fboBlackhole = createFramebuffer(fbInfo);
       assert(fboBlackhole != 0);
+      virtualSky.attachFeedback(fboBlackhole, renderWidth, renderHeight);
 
       texBrightness = createColorTexture(renderWidth, renderHeight);
       texBloomFinal = createColorTexture(renderWidth, renderHeight);
@@ -807,29 +599,77 @@ int main(int argc, char **argv) {
       }
     }
 
+    // The upscaled image is LDR and lives at the window resolution.
+    if (width != upscaledWidth || height != upscaledHeight) {
+      upscaledWidth = width;
+      upscaledHeight = height;
+      if (texUpscaled != 0) {
+        deleteColorTexture(texUpscaled);
+      }
+      texUpscaled = createColorTexture(width, height, false);
+    }
+
     static bool mouseControlEnabled = true;
     static bool frontView = false;
     static bool topView = false;
     static float cameraRollDeg = 0.0f;
+    static bool lateLatch = true;
+    static int projection = kProjectionPerspective;
     const float fovScale = 1.0f;
 
     if (kEnableImGui) {
       ImGui::Checkbox("mouseControl", &mouseControlEnabled);
+      ImGui::Checkbox("lateLatch", &lateLatch);
       ImGui::Checkbox("frontView", &frontView);
       ImGui::Checkbox("topView", &topView);
       ImGui::SliderFloat("cameraRoll", &cameraRollDeg, -180.0f, 180.0f);
+      ImGui::Combo("projection", &projection,
+                   "Perspective\0" "Equirectangular\0" "Dome master\0"
+                   "Cubemap faces\0");
     }
 
+    static int fleetSize = 0;
+    static int fleetMotion = kFleetKepler;
+
+    simulationInput.mouseX = mouseX;
+    simulationInput.mouseY = mouseY;
+    simulationInput.width = renderWidth;
+    simulationInput.height = renderHeight;
+    simulationInput.mouseControl = mouseControlEnabled;
+    simulationInput.frontView = frontView;
+    simulationInput.topView = topView;
+    simulationInput.cameraRollDeg = cameraRollDeg;
+    simulationInput.fovScale = fovScale;
+    simulationInput.fleetSize = fleetSize;
+    simulationInput.fleetSchwarzschild = fleetMotion == kFleetSchwarzschild;
+    simulationInput.sampledAt = glfwGetTime();
+    simulation.setInput(simulationInput);
+
     // Simple 3D HUD Labels - moved below after cameraState is computed
 
-    // 使用缓动函数让动画更平滑
-    float easedT = easeInOutCubic((float)autopilotT);
-    glm::vec3 autopilotPos =
-        calculateBezierPoint(easedT, bezierP0, bezierP1, bezierP2, bezierP3);
-    CameraState cameraState = computeCameraState(
-        now, renderWidth, renderHeight, mouseX, mouseY, mouseControlEnabled,
-        frontView, topView, cameraRollDeg, fovScale, autopilotActive,
-        autopilotPos);
+    // A poster's tiles all show the frame it was started on, a job's the
+    // flythrough at its time.
+    const SimulationState &frame =
+        tiled ? tileFrame : simulation.sample(glfwGetTime());
+    double now = frame.time;
+    const SatelliteState &satState = frame.satellite;
+    CameraState cameraState = frame.camera;
+    if (tiled) {
+      updateCameraMatrices(cameraState, tile.imageWidth, tile.imageHeight);
+      cameraState.projection = tileProjection(tile, cameraState.projection);
+    } else {
+      updateCameraMatrices(cameraState, renderWidth, renderHeight);
+    }
+    // When the mouse drives the camera, the time the frame's cursor position
+    // was read, for the input latency; moved forward by the late latch.
+    bool mouseDriven = mouseControlEnabled && !frame.autopilotActive;
+    double inputTime =
+        mouseDriven && frame.inputTime > 0.0 ? frame.inputTime : -1.0;
+    if (kEnableImGui) {
+      ImGui::Text("Simulation: tick %llu, %.2f ms",
+                  (unsigned long long)simulation.ticks(),
+                  simulation.tickCostMs());
+    }
 
     // ================== PROFESSIONAL HUD INTERFACE ==================
     if (kEnableImGui) {
@@ -898,7 +738,6 @@ int main(int argc, char **argv) {
         ImGui::End();
 
         // === Satellite Status Panel (Bottom Left) ===
-        SatelliteState satPreview = computeSatelliteOrbit(now);
         ImGui::SetNextWindowPos(ImVec2(20, (float)height - 120));
         ImGui::SetNextWindowBgAlpha(0.45f);
         if (ImGui::Begin("Satellite", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav)) {
@@ -911,8 +750,8 @@ int main(int argc, char **argv) {
             ImGui::SameLine();
             ImGui::Text("Transmitting...");
 
-            ImGui::Text("Orbit Radius: %.2f Rs", glm::length(satPreview.position));
-            ImGui::Text("Velocity: %.2f c", glm::length(satPreview.velocity) * 0.1f);
+            ImGui::Text("Orbit Radius: %.2f Rs", glm::length(satState.position));
+            ImGui::Text("Velocity: %.2f c", glm::length(satState.velocity) * 0.1f);
         }
         ImGui::End();
 
@@ -929,14 +768,82 @@ int main(int argc, char **argv) {
         }
         ImGui::End();
     }
+
+    if (lateLatch && mouseDriven && !tiled) {
+      // Re-read the cursor now, with the HUD built and just before the first
+      // view-dependent draw, rather than use the one sampled at the top of
+      // the frame. Every pass below, occluders included, uses this pose.
+      double cursorX, cursorY;
+      glfwGetCursorPos(window, &cursorX, &cursorY);
+      inputTime = glfwGetTime();
+      CameraState latched = computeCameraState(
+          now, renderWidth, renderHeight, (float)cursorX, (float)cursorY,
+          true, false, false, cameraRollDeg, fovScale, false,
+          glm::vec3(0.0f));
+      cameraState.pos = latched.pos;
+      cameraState.target = latched.target;
+      updateCameraMatrices(cameraState, renderWidth, renderHeight);
+    }
+
+    // --- Step 1: Opaque occluders into fboBlackhole
+    // Every covered pixel is tagged with stencil 1, so the ray march below
+    // only runs on the pixels that stay visible.
+    glBindFramebuffer(GL_FRAMEBUFFER, fboBlackhole);
+    glViewport(0, 0, renderWidth, renderHeight);
+    glStencilMask(0xFF);
+    glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+
+    // Panoramas are ray marched only; the rasterized passes need a pinhole.
+    bool panorama = projection != kProjectionPerspective;
+    glm::vec3 lightDir = glm::normalize(-satState.position);
+    if (!panorama) {
+      renderSatellite(satelliteMesh, satelliteProgram, frame.satelliteModel,
+                      cameraState.view, cameraState.projection,
+                      cameraState.pos, lightDir, galaxy, frame.dishAngle,
+                      (float)now);
+    }
+
+    static float fleetCullDistance = 60.0f;
+    if (kEnableImGui) {
+      ImGui::SliderInt("fleetSize", &fleetSize, 0, fleet.capacity);
+      ImGui::Combo("fleetMotion", &fleetMotion,
+                   "Kepler (GPU)\0" "Schwarzschild (CPU)\0");
+      ImGui::SliderFloat("fleetCullDistance", &fleetCullDistance, 5.0f, 200.0f);
+    }
+    SatelliteFleetRenderInfo fleetInfo;
+    fleetInfo.count = fleetSize;
+    fleetInfo.view = cameraState.view;
+    fleetInfo.projection = cameraState.projection;
+    fleetInfo.cameraPos = cameraState.pos;
+    fleetInfo.galaxyCubemap = galaxy;
+    fleetInfo.time = (float)now;
+    fleetInfo.maxDistance = fleetCullDistance;
+    if (fleetMotion == kFleetSchwarzschild && !frame.fleetModels.empty()) {
+      if (kEnableImGui) {
+        ImGui::Text("Orbit propagation: %.2f ms (simulation thread)",
+                    frame.fleetPropagationMs);
+      }
+      fleetInfo.count = (int)frame.fleetModels.size();
+      if (!panorama) {
+        renderSatelliteFleetModels(fleet, frame.fleetModels.data(), fleetInfo);
+      }
+    } else if (!panorama) {
+      renderSatelliteFleet(fleet, fleetInfo);
+    }
+
+    glDisable(GL_STENCIL_TEST);
+
     {
-      // --- Step 1: Black hole ray marching into fboBlackhole
+      // --- Step 2: Black hole ray marching around the occluders
       RenderToTextureInfo blackholeUniforms;
       RenderToTextureInfo &rtti = blackholeUniforms;
       rtti.cubemapUniforms["galaxy"] = galaxy;
       rtti.textureUniforms["colorMap"] = colorMap;
-      rtti.floatUniforms["mouseX"] = mouseX;
-      rtti.floatUniforms["mouseY"] = mouseY;
 
       IMGUI_TOGGLE(gravitationalLensing, true);
       IMGUI_TOGGLE(renderBlackHole, true);
@@ -949,20 +856,45 @@ int main(int argc, char **argv) {
       IMGUI_SLIDER(adiskNoiseLOD, 5.0f, 1.0f, 12.0f);
       IMGUI_SLIDER(adiskNoiseScale, 0.8f, 0.0f, 10.0f);
       IMGUI_SLIDER(adiskSpeed, 0.5f, 0.0f, 1.0f);
+      IMGUI_SLIDER(adiskAbsorption, 0.05f, 0.0f, 1.0f);
+
+      // The disk's emission baked into a texture, a few layers a frame; the
+      // tiles of a poster or a job regenerate it whole for their frame.
+      IMGUI_TOGGLE(adiskCache, true);
+      if (adiskCache && adiskEnabled) {
+        static int adiskCacheLayers = diskCache.layersPerFrame();
+        if (kEnableImGui) {
+          ImGui::SliderInt("adiskCacheLayers", &adiskCacheLayers, 1,
+                           diskCache.layers());
+          ImGui::Text("Disk cache: oldest layer %.2f s",
+                      diskCache.maxAge(now));
+        }
+        diskCache.setLayersPerFrame(adiskCacheLayers);
+        diskCache.update(rtti.floatUniforms, colorMap, now, tiled);
+        glBindFramebuffer(GL_FRAMEBUFFER, fboBlackhole);
+        glViewport(0, 0, renderWidth, renderHeight);
+      }
 
-      rtti.floatUniforms["mouseControl"] = mouseControlEnabled ? 1.0f : 0.0f;
-      rtti.floatUniforms["frontView"] = frontView ? 1.0f : 0.0f;
-      rtti.floatUniforms["topView"] = topView ? 1.0f : 0.0f;
-      rtti.floatUniforms["cameraRoll"] = cameraRollDeg;
-      rtti.floatUniforms["fovScale"] = fovScale;
-      rtti.floatUniforms["useExternalCamera"] = 1.0f;
-      rtti.floatUniforms["externalFovScale"] = cameraState.fovScale;
-      rtti.vec3Uniforms["externalCameraPos"] = cameraState.pos;
-      rtti.vec3Uniforms["externalTarget"] = cameraState.target;
-
-      glBindFramebuffer(GL_FRAMEBUFFER, fboBlackhole);
-      glViewport(0, 0, renderWidth, renderHeight);
+      static bool virtualSkyEnabled = true;
+      if (kEnableImGui && virtualSky.loaded()) {
+        ImGui::Checkbox("virtualSky", &virtualSkyEnabled);
+        ImGui::Text("Sky tiles: %zu resident, %zu loading (%.0f MB cache)",
+                    virtualSky.residentTiles(), virtualSky.pendingTiles(),
+                    virtualSky.cacheBytes() / 1048576.0);
+      }
+      // Tiles cannot wait for the sky tiles they request, so posters and
+      // jobs use the cubemap.
+      bool useVirtualSky = virtualSky.loaded() && virtualSkyEnabled && !tiled;
+      rtti.floatUniforms["virtualSky"] = useVirtualSky ? 1.0f : 0.0f;
+
+      rtti.floatUniforms["projection"] = (float)projection;
+
+      // Early stencil rejection skips traceColor() on covered pixels; the
+      // shader neither discards nor writes depth, so it is not disabled.
       glDisable(GL_DEPTH_TEST);
+      glEnable(GL_STENCIL_TEST);
+      glStencilFunc(GL_EQUAL, 0, 0xFF);
+      glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
 
       glUseProgram(blackholeProgram);
       glBindVertexArray(quadVAO);
@@ -970,6 +902,15 @@ int main(int argc, char **argv) {
       glUniform2f(glGetUniformLocation(blackholeProgram, "resolution"),
                   (float)renderWidth, (float)renderHeight);
       glUniform1f(glGetUniformLocation(blackholeProgram, "time"), (float)now);
+      glm::vec2 tileOffset(0.0f), posterResolution(0.0f);
+      if (tiled) {
+        tileOffset = glm::vec2(tile.origin());
+        posterResolution = glm::vec2(tile.imageWidth, tile.imageHeight);
+      }
+      glUniform2fv(glGetUniformLocation(blackholeProgram, "tileOffset"), 1,
+                   glm::value_ptr(tileOffset));
+      glUniform2fv(glGetUniformLocation(blackholeProgram, "posterResolution"),
+                   1, glm::value_ptr(posterResolution));
 
       for (auto const &[name, val] : rtti.floatUniforms) {
         GLint loc = glGetUniformLocation(blackholeProgram, name.c_str());
@@ -1000,26 +941,30 @@ int main(int argc, char **argv) {
       for (auto const &[name, tex] : rtti.cubemapUniforms) {
         bindTexture(name, tex, GL_TEXTURE_CUBE_MAP);
       }
+      bindTexture("adiskEmission", diskCache.texture(), GL_TEXTURE_3D);
+      // Always bound: its samplers must not share units with the above.
+      virtualSky.bind(blackholeProgram, textureUnit);
+
+      cameraLatch.latch(cameraState);
 
+      if (useVirtualSky) {
+        virtualSky.beginFeedback();
+      }
       glDrawArrays(GL_TRIANGLES, 0, 6);
-    }
+      cameraLatch.release();
 
-    // --- Step 2: Depth pass for the satellite in the same FBO
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
+      glDisable(GL_STENCIL_TEST);
+      glEnable(GL_DEPTH_TEST);
+      if (useVirtualSky) {
+        virtualSky.endFeedback();
+      }
+    }
 
-    SatelliteState satState = computeSatelliteOrbit(now);
-    glm::mat4 satelliteModel =
-        computeSatelliteModel(now, satState.position, satState.velocity);
-    glm::vec3 lightDir = glm::normalize(-satState.position);
-    float dishAngle = (float)now * 2.0f; // Rotate 2 rad/sec
-    renderSatellite(satelliteMesh, satelliteProgram, satelliteModel,
-                    cameraState.view, cameraState.projection, cameraState.pos,
-                    lightDir, galaxy, dishAngle, (float)now);
+    // === Step 3: Spacetime Curvature Grid (Gravity Well) - Line List ===
+    if (!panorama) {
+        // Only re-evaluated on the CPU when the control points change.
+        updateBezierGrid(grid, controlPoints);
 
-    // === Spacetime Curvature Grid (Gravity Well) - Wireframe Mode ===
-    {
         glUseProgram(gridProgram);
 
         // Set uniforms
@@ -1027,22 +972,16 @@ int main(int argc, char **argv) {
         glUniformMatrix4fv(glGetUniformLocation(gridProgram, "model"), 1, GL_FALSE, glm::value_ptr(gridModel));
         glUniformMatrix4fv(glGetUniformLocation(gridProgram, "view"), 1, GL_FALSE, glm::value_ptr(cameraState.view));
         glUniformMatrix4fv(glGetUniformLocation(gridProgram, "projection"), 1, GL_FALSE, glm::value_ptr(cameraState.projection));
-        glUniform3fv(glGetUniformLocation(gridProgram, "controlPoints"), 16, glm::value_ptr(controlPoints[0]));
-
-        // Enable wireframe mode
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
         // Enable blending for transparency
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        // Draw the grid mesh
-        glBindVertexArray(gridMesh.vao);
-        glDrawArrays(GL_TRIANGLES, 0, gridMesh.vertexCount);
+        // Draw every grid edge once
+        glBindVertexArray(grid.mesh.vao);
+        glDrawElements(GL_LINES, grid.mesh.indexCount, grid.mesh.indexType, (void *)0);
         glBindVertexArray(0);
 
-        // Restore fill mode immediately (so it doesn't affect black hole)
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
         glDisable(GL_BLEND);
 
         glUseProgram(0);
@@ -1128,16 +1067,182 @@ int main(int argc, char **argv) {
       renderToTexture(rtti);
     }
 
-    passthrough.render(texTonemapped, width, height);
+    // --- Poster: the tile rendered this frame goes to the file, or back to
+    // the coordinator
+    if (worker) {
+      worker->finishJob(job, texTonemapped);
+    } else if (poster) {
+      poster->writeTile(texTonemapped);
+      if (!poster->ok() || poster->done()) {
+        if (poster->done()) {
+          printf("Poster written\n");
+        }
+        poster.reset();
+      }
+    }
+    if (kEnableImGui) {
+      static int posterSize[2] = {16384, 8192};
+      static int posterTileSize = 1024;
+      static int posterProjection = kProjectionPerspective;
+      if (projection != posterProjection) {
+        posterProjection = projection;
+        posterSize[0] = kPosterSizes[projection][0];
+        posterSize[1] = kPosterSizes[projection][1];
+      }
+      if (worker) {
+        ImGui::Text("Worker: job %d, frame %d", job.id, job.frame);
+      } else if (!poster) {
+        ImGui::InputInt2("posterSize", posterSize);
+        ImGui::SliderInt("posterTileSize", &posterTileSize, 256, 4096);
+        if (ImGui::Button("Render poster")) {
+          PosterCreateInfo posterInfo;
+          posterInfo.width = posterSize[0];
+          posterInfo.height = posterSize[1];
+          posterInfo.tileSize = posterTileSize;
+          poster = std::make_unique<Poster>(posterInfo);
+          tileFrame = frame;
+          if (!poster->ok()) {
+            poster.reset();
+          }
+        }
+      } else {
+        ImGui::ProgressBar((float)poster->tilesDone() / poster->tileCount());
+        ImGui::Text("Poster: tile %d of %d", poster->tilesDone() + 1,
+                    poster->tileCount());
+        if (ImGui::Button("Cancel poster")) {
+          poster.reset();
+        }
+      }
+    }
+
+    // --- Capture: the tonemapped frame, at render resolution, without HUD
+    if (kEnableImGui) {
+      static int captureFormat = kCapturePng;
+      static float captureFps = 60.0f;
+      if (!capture) {
+        ImGui::Combo("captureFormat", &captureFormat,
+                     "PNG sequence\0" "Y4M\0");
+        ImGui::SliderFloat("captureFps", &captureFps, 10.0f, 120.0f);
+        if (ImGui::Button("Start capture")) {
+          FrameCaptureCreateInfo captureInfo;
+          captureInfo.format = captureFormat;
+          captureInfo.path =
+              captureFormat == kCaptureY4m ? "capture.y4m" : "capture";
+          captureInfo.fps = captureFps;
+          capture = std::make_unique<FrameCapture>(captureInfo);
+        }
+      } else {
+        ImGui::Text("Capture: %d frames, %d late, %d dropped, %d stalls, "
+                    "%d queued",
+                    capture->captured(), capture->late(), capture->dropped(),
+                    capture->stalls(), capture->queued());
+        if (ImGui::Button("Stop capture")) {
+          capture.reset();
+        }
+      }
+    }
+    if (capture) {
+      capture->capture(texTonemapped, renderWidth, renderHeight,
+                       glfwGetTime());
+    }
 
+    static float sharpness = 0.2f;
+    static bool fastHud = true;
+    static bool cachedHud = true;
     if (kEnableImGui) {
+      if (upscaler == kUpscalerEASU) {
+        ImGui::SliderFloat("sharpness", &sharpness, 0.0f, 2.0f);
+      }
+      ImGui::Checkbox("fastHud", &fastHud);
+      if (fastHud) {
+        ImGui::Text("HUD: %d draws, %.2f ms CPU, %.2f ms GPU",
+                    hudRenderer.drawCalls(), hudRenderer.cpuMs(),
+                    hudRenderer.gpuMs());
+      }
+      ImGui::Checkbox("cachedHud", &cachedHud);
+      if (cachedHud) {
+        float hudRefreshRate = hudLayer.refreshRate();
+        if (ImGui::SliderFloat("hudRefreshRate", &hudRefreshRate, 1.0f,
+                               60.0f)) {
+          hudLayer.setRefreshRate(hudRefreshRate);
+        }
+        ImGui::Text("HUD layer: %d updates/s", hudLayer.updatesPerSecond());
+      }
       ImGui::Render();
-      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
+
+    auto drawHud = [&]() {
+      if (fastHud) {
+        // The passes above leave blending, depth and stencil tests off and
+        // rely on the quad's vertex array staying bound.
+        HudGlState hudState;
+        hudState.vertexArray = quadVAO;
+        hudRenderer.render(ImGui::GetDrawData(), hudState);
+      } else {
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+      }
+    };
+
+    // The HUD is drawn into its layer only when its content changed, and
+    // composited by the final pass.
+    GLuint hudTexture = 0;
+    if (kEnableImGui && cachedHud) {
+      if (hudLayer.needsUpdate(ImGui::GetDrawData(), width, height,
+                               glfwGetTime(),
+                               ImGui::GetIO().WantCaptureMouse)) {
+        hudLayer.begin();
+        drawHud();
+        hudLayer.end();
+      }
+      hudTexture = hudLayer.texture();
+    }
+
+    // --- Final pass: upscale the tonemapped image to the window
+    if (upscaler == kUpscalerEASU) {
+      RenderToTextureInfo rtti;
+      rtti.fragShader = "shader/upscale_easu.frag";
+      rtti.textureUniforms["texture0"] = texTonemapped;
+      rtti.targetTexture = texUpscaled;
+      rtti.width = width;
+      rtti.height = height;
+      renderToTexture(rtti);
+
+      sharpen.render(texUpscaled, width, height, 0, {{"sharpness", sharpness}},
+                     hudTexture);
+    } else {
+      passthrough.render(texTonemapped, width, height, 0, {}, hudTexture);
+    }
+
+    if (kEnableImGui && !cachedHud) {
+      drawHud();
     }
 
     glfwSwapBuffers(window);
+    framePacer.endFrame(
+        inputTime >= 0.0 ? (float)((glfwGetTime() - inputTime) * 1000.0)
+                         : -1.0f);
+
+    static bool firstFrame = true;
+    if (firstFrame) {
+      firstFrame = false;
+      printf("First frame presented %.0f ms after start\n",
+             glfwGetTime() * 1000.0);
+    }
   }
 
+  assetLoader.shutdown();
+  virtualSky.shutdown();
+  simulation.shutdown();
+  shaderManager.shutdown();
+  framePacer.shutdown();
+  cameraLatch.shutdown();
+  hudRenderer.shutdown();
+  hudLayer.shutdown();
+  diskCache.shutdown();
+  capture.reset();
+  poster.reset();
+  worker.reset();
+
   if (kEnableImGui) {
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
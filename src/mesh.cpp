@@ -0,0 +1,178 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int kMaxCacheSize = 64;
+
+float vertexScore(int cachePosition, int remainingValence, int cacheSize) {
+  if (remainingValence == 0) {
+    // No triangles left to emit, the vertex is irrelevant.
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cachePosition >= 0) {
+    if (cachePosition < 3) {
+      // The last triangle emitted; a fixed score discourages picking the
+      // same vertices twice in a row, which would hurt strip-like behavior.
+      score = 0.75f;
+    } else {
+      float scaler = 1.0f / (float)(cacheSize - 3);
+      score = 1.0f - (float)(cachePosition - 3) * scaler;
+      score = powf(score, 1.5f);
+    }
+  }
+
+  // Boost vertices with few triangles left so that lone triangles get
+  // finished off instead of being left behind.
+  score += 2.0f * powf((float)remainingValence, -0.5f);
+  return score;
+}
+
+} // namespace
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount,
+                         int cacheSize) {
+  cacheSize = std::clamp(cacheSize, 4, kMaxCacheSize - 3);
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // Vertex -> triangle adjacency in CSR form.
+  std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+  for (uint32_t index : indices) {
+    adjacencyOffset[index + 1]++;
+  }
+  for (size_t v = 0; v < vertexCount; v++) {
+    adjacencyOffset[v + 1] += adjacencyOffset[v];
+  }
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> valence(vertexCount, 0);
+  for (size_t t = 0; t < triangleCount; t++) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = indices[t * 3 + k];
+      adjacency[adjacencyOffset[v] + valence[v]++] = (uint32_t)t;
+    }
+  }
+
+  std::vector<float> score(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    score[v] = vertexScore(-1, valence[v], cacheSize);
+  }
+
+  std::vector<bool> emitted(triangleCount, false);
+
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+
+  // LRU cache, with room for the three vertices pushed by a triangle.
+  uint32_t cache[kMaxCacheSize + 3];
+  int cacheCount = 0;
+
+  size_t scanCursor = 0;
+  int64_t bestTriangle = -1;
+
+  for (size_t emittedCount = 0; emittedCount < triangleCount;
+       emittedCount++) {
+    if (bestTriangle < 0) {
+      // Nothing useful in the cache: fall back to the first remaining
+      // triangle in input order.
+      while (emitted[scanCursor]) {
+        scanCursor++;
+      }
+      bestTriangle = (int64_t)scanCursor;
+    }
+
+    uint32_t tri = (uint32_t)bestTriangle;
+    emitted[tri] = true;
+
+    uint32_t newCache[kMaxCacheSize + 3];
+    int newCount = 0;
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = indices[tri * 3 + k];
+      output.push_back(v);
+      newCache[newCount++] = v;
+
+      // Drop the triangle from the vertex's remaining adjacency.
+      uint32_t *begin = &adjacency[adjacencyOffset[v]];
+      uint32_t *end = begin + valence[v];
+      uint32_t *it = std::find(begin, end, tri);
+      std::swap(*it, *(end - 1));
+      valence[v]--;
+    }
+
+    for (int i = 0; i < cacheCount; i++) {
+      uint32_t v = cache[i];
+      if (v != newCache[0] && v != newCache[1] && v != newCache[2]) {
+        newCache[newCount++] = v;
+      }
+    }
+
+    // Vertices that fell out of the cache lose their cache bonus.
+    for (int i = cacheSize; i < newCount; i++) {
+      score[newCache[i]] = vertexScore(-1, valence[newCache[i]], cacheSize);
+    }
+
+    cacheCount = std::min(newCount, cacheSize);
+    std::copy(newCache, newCache + cacheCount, cache);
+
+    for (int i = 0; i < cacheCount; i++) {
+      uint32_t v = cache[i];
+      score[v] = vertexScore(i, valence[v], cacheSize);
+    }
+
+    // Re-score the triangles touching the cache and pick the next one.
+    bestTriangle = -1;
+    float bestScore = -1.0f;
+    for (int i = 0; i < cacheCount; i++) {
+      uint32_t v = cache[i];
+      for (uint32_t a = 0; a < valence[v]; a++) {
+        uint32_t t = adjacency[adjacencyOffset[v] + a];
+        float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] +
+                  score[indices[t * 3 + 2]];
+        if (s > bestScore) {
+          bestScore = s;
+          bestTriangle = t;
+        }
+      }
+    }
+  }
+
+  indices.swap(output);
+}
+
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t> &indices,
+                                          size_t vertexCount) {
+  std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+  uint32_t next = 0;
+  for (uint32_t &index : indices) {
+    if (remap[index] == UINT32_MAX) {
+      remap[index] = next++;
+    }
+    index = remap[index];
+  }
+  return remap;
+}
+
+float computeACMR(const std::vector<uint32_t> &indices, size_t vertexCount,
+                  int cacheSize) {
+  if (indices.empty()) {
+    return 0.0f;
+  }
+
+  // Simulate a FIFO cache by recording when each vertex was last inserted.
+  std::vector<int64_t> insertedAt(vertexCount, INT64_MIN / 2);
+  int64_t time = 0;
+  size_t misses = 0;
+  for (uint32_t index : indices) {
+    if (time - insertedAt[index] >= cacheSize) {
+      insertedAt[index] = time++;
+      misses++;
+    }
+  }
+  return (float)misses / (float)(indices.size() / 3);
+}
@@ -0,0 +1,40 @@
+
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+
+struct Mesh {
+  GLuint vao = 0;
+  // Buffers behind the vao, for meshes that are re-bound into other vertex
+  // arrays (e.g. with instanced attributes). Zero when not needed.
+  GLuint vertexBuffer = 0;
+  GLuint indexBuffer = 0;
+  GLsizei vertexCount = 0;
+  // Indexed meshes are drawn with glDrawElements when indexCount is non-zero.
+  GLsizei indexCount = 0;
+  GLenum indexType = GL_UNSIGNED_SHORT;
+};
+
+// Reorders the triangles of an indexed triangle list for post-transform vertex
+// cache locality (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation").
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount,
+                         int cacheSize = 32);
+
+// Renumbers vertices in order of first use so that vertex fetches walk the
+// vertex buffer linearly. Returns the old-to-new remap table; vertices that are
+// never referenced map to UINT32_MAX.
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t> &indices,
+                                          size_t vertexCount);
+
+// Average cache miss ratio (transformed vertices per triangle) of a FIFO cache
+// of the given size. 3.0 is the worst case, 0.5 the ideal for regular grids.
+float computeACMR(const std::vector<uint32_t> &indices, size_t vertexCount,
+                  int cacheSize = 32);
+
+#endif /* MESH_H */
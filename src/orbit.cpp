@@ -0,0 +1,211 @@
+#include "orbit.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Bodies per parallelFor chunk: big enough to amortize the dispatch, small
+// enough that a chunk of state (about 60 bytes per body) stays in L2.
+const size_t kBodiesPerChunk = 4096;
+
+// One leapfrog step of n bodies. Plain loop over restrict pointers so that
+// the compiler vectorizes across bodies (needs -fno-math-errno for sqrt).
+void leapfrogStep(size_t n, float mass, float h, float *__restrict px,
+                  float *__restrict py, float *__restrict pz,
+                  float *__restrict vx, float *__restrict vy,
+                  float *__restrict vz, const float *__restrict k,
+                  float *__restrict sc, float *__restrict ss,
+                  const float *__restrict dc, const float *__restrict ds) {
+  const float halfH = 0.5f * h;
+  for (size_t i = 0; i < n; i++) {
+    // Kick, drift, kick. The second kick of one step and the first of the
+    // next are not merged so that velocities are in sync after each step.
+    float r2 = px[i] * px[i] + py[i] * py[i] + pz[i] * pz[i];
+    float invR2 = 1.0f / r2;
+    float invR3 = invR2 / std::sqrt(r2);
+    float a = -(mass + k[i] * invR2) * invR3 * halfH;
+    float hvx = vx[i] + a * px[i];
+    float hvy = vy[i] + a * py[i];
+    float hvz = vz[i] + a * pz[i];
+
+    float x = px[i] + h * hvx;
+    float y = py[i] + h * hvy;
+    float z = pz[i] + h * hvz;
+
+    r2 = x * x + y * y + z * z;
+    invR2 = 1.0f / r2;
+    invR3 = invR2 / std::sqrt(r2);
+    a = -(mass + k[i] * invR2) * invR3 * halfH;
+    vx[i] = hvx + a * x;
+    vy[i] = hvy + a * y;
+    vz[i] = hvz + a * z;
+    px[i] = x;
+    py[i] = y;
+    pz[i] = z;
+
+    float c = sc[i] * dc[i] - ss[i] * ds[i];
+    ss[i] = sc[i] * ds[i] + ss[i] * dc[i];
+    sc[i] = c;
+  }
+}
+
+// Runs steps leapfrog steps over bodies [begin, end).
+void integrate(OrbitBodies &b, size_t begin, size_t end, int steps) {
+  size_t n = end - begin;
+  for (int s = 0; s < steps; s++) {
+    leapfrogStep(n, b.info.mass, b.info.step, &b.px[begin], &b.py[begin],
+                 &b.pz[begin], &b.vx[begin], &b.vy[begin], &b.vz[begin],
+                 &b.k[begin], &b.spinCos[begin], &b.spinSin[begin],
+                 &b.stepCos[begin], &b.stepSin[begin]);
+  }
+
+  // Renormalize the spin once per advance to stop rounding drift.
+  float *__restrict sc = &b.spinCos[begin];
+  float *__restrict ss = &b.spinSin[begin];
+  for (size_t i = 0; i < n; i++) {
+    float len = 1.0f / std::sqrt(sc[i] * sc[i] + ss[i] * ss[i]);
+    sc[i] *= len;
+    ss[i] *= len;
+  }
+}
+
+// Same orientation as computeSatelliteModel(): face the direction of motion,
+// then spin around the local y axis. No wobble.
+void buildModels(OrbitBodies &b, size_t begin, size_t end) {
+  const float *__restrict px = b.px.data();
+  const float *__restrict py = b.py.data();
+  const float *__restrict pz = b.pz.data();
+  const float *__restrict vx = b.vx.data();
+  const float *__restrict vy = b.vy.data();
+  const float *__restrict vz = b.vz.data();
+  const float *__restrict sc = b.spinCos.data();
+  const float *__restrict ss = b.spinSin.data();
+  const float *__restrict scale = b.scale.data();
+  float *__restrict out = &b.models[0][0][0];
+
+  for (size_t i = begin; i < end; i++) {
+    float invV = 1.0f / std::sqrt(vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+    float fx = vx[i] * invV;
+    float fy = vy[i] * invV;
+    float fz = vz[i] * invV;
+    // right = normalize(cross(worldUp, forward)), up = cross(forward, right)
+    float invH = 1.0f / std::sqrt(fx * fx + fz * fz);
+    float rx = fz * invH;
+    float rz = -fx * invH;
+    float ux = fy * rz;
+    float uy = fz * rx - fx * rz;
+    float uz = -fy * rx;
+
+    float c = sc[i] * scale[i];
+    float s = ss[i] * scale[i];
+    float *m = out + i * 16;
+    m[0] = c * rx - s * fx;
+    m[1] = -s * fy;
+    m[2] = c * rz - s * fz;
+    m[3] = 0.0f;
+    m[4] = ux * scale[i];
+    m[5] = uy * scale[i];
+    m[6] = uz * scale[i];
+    m[7] = 0.0f;
+    m[8] = s * rx + c * fx;
+    m[9] = c * fy;
+    m[10] = s * rz + c * fz;
+    m[11] = 0.0f;
+    m[12] = px[i];
+    m[13] = py[i];
+    m[14] = pz[i];
+    m[15] = 1.0f;
+  }
+}
+
+} // namespace
+
+OrbitBodies createOrbitBodies(const OrbitBodiesCreateInfo &info,
+                              const std::vector<SatelliteOrbitParams> &orbits) {
+  OrbitBodies b;
+  b.info = info;
+  b.count = orbits.size();
+  for (std::vector<float> *array :
+       {&b.px, &b.py, &b.pz, &b.vx, &b.vy, &b.vz, &b.k, &b.spinCos,
+        &b.spinSin, &b.stepCos, &b.stepSin, &b.scale}) {
+    array->resize(b.count);
+  }
+  b.models.resize(b.count);
+
+  const float m = info.mass;
+  for (size_t i = 0; i < b.count; i++) {
+    const SatelliteOrbitParams &o = orbits[i];
+    float e = o.orbit.y;
+    float rp = std::max(o.orbit.x * (1.0f - e), 6.0f * m);
+
+    // Newtonian periapsis speed with the 1 / (1 - 3M/r) relativistic boost,
+    // which is exactly circular for e = 0, capped below escape speed.
+    float v2 = m * (1.0f + e) / (rp - 3.0f * m);
+    v2 = std::min(v2, 0.9f * 2.0f * m / (rp - 2.0f * m));
+    float v = std::sqrt(v2) * (o.orbit.w < 0.0f ? -1.0f : 1.0f);
+
+    // Periapsis at the phase angle in the orbital plane, inclined around x
+    // and rotated around y by the node longitude as in evaluateSatelliteOrbit.
+    float phase = o.oscillation.z;
+    glm::vec2 dir(std::cos(phase), std::sin(phase));
+    glm::vec2 tangent(-dir.y, dir.x);
+    float sinI = std::sin(o.orbit.z);
+    float cosI = std::cos(o.orbit.z);
+    float cosN = std::cos(o.oscillation.w);
+    float sinN = std::sin(o.oscillation.w);
+    auto toWorld = [&](glm::vec2 p) {
+      glm::vec3 q(p.x, p.y * sinI, p.y * cosI);
+      return glm::vec3(cosN * q.x + sinN * q.z, q.y, -sinN * q.x + cosN * q.z);
+    };
+    glm::vec3 pos = toWorld(dir * rp);
+    glm::vec3 vel = toWorld(tangent * v);
+
+    b.px[i] = pos.x;
+    b.py[i] = pos.y;
+    b.pz[i] = pos.z;
+    b.vx[i] = vel.x;
+    b.vy[i] = vel.y;
+    b.vz[i] = vel.z;
+    b.k[i] = 3.0f * m * rp * rp * v2;
+
+    // Spin is in radians per scene second, the step in simulated time.
+    float spinStep = o.attitude.x * info.step / info.timeScale;
+    b.spinCos[i] = 1.0f;
+    b.spinSin[i] = 0.0f;
+    b.stepCos[i] = std::cos(spinStep);
+    b.stepSin[i] = std::sin(spinStep);
+    b.scale[i] = o.attitude.w;
+  }
+
+  ThreadPool::shared().parallelFor(
+      b.count, kBodiesPerChunk,
+      [&b](size_t begin, size_t end) { buildModels(b, begin, end); });
+  return b;
+}
+
+int advanceOrbitBodies(OrbitBodies &bodies, float dt) {
+  bodies.accumulator += dt * bodies.info.timeScale;
+  int steps = (int)(bodies.accumulator / bodies.info.step);
+  if (steps > bodies.info.maxStepsPerAdvance) {
+    // Drop the backlog rather than trying to catch up.
+    steps = bodies.info.maxStepsPerAdvance;
+    bodies.accumulator = 0.0f;
+  } else {
+    bodies.accumulator -= (float)steps * bodies.info.step;
+  }
+  if (steps == 0) {
+    return 0;
+  }
+
+  // Each chunk integrates all of its steps and then writes its matrices while
+  // the state is still in cache.
+  ThreadPool::shared().parallelFor(
+      bodies.count, kBodiesPerChunk,
+      [&bodies, steps](size_t begin, size_t end) {
+        integrate(bodies, begin, end, steps);
+        buildModels(bodies, begin, end);
+      });
+  return steps;
+}
@@ -0,0 +1,61 @@
+
+
+#ifndef ORBIT_H
+#define ORBIT_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "satellite.h"
+
+struct OrbitBodiesCreateInfo {
+  // Black hole mass in scene units (G = c = 1); 0.5 puts the horizon at r = 1.
+  float mass = 0.5f;
+  // Simulated time per scene second. The default matches the angular speeds
+  // of the analytic fleet orbits (0.15 rad/s at a = 5.5).
+  float timeScale = 2.7f;
+  // Fixed integration step in simulated time.
+  float step = 1.0f / 60.0f;
+  // Upper bound on steps per advance, so a long hitch cannot stall a frame.
+  int maxStepsPerAdvance = 16;
+};
+
+// Structure-of-arrays state of many bodies orbiting the black hole, advanced
+// with a kick-drift-kick leapfrog under the Schwarzschild effective potential
+//   a = -M r / |r|^3 * (1 + 3 L^2 / |r|^2),
+// whose extra term reproduces perihelion precession and the innermost stable
+// orbit at r = 6M. The force is central, so L is exactly conserved by every
+// kick and drift and is stored per body.
+struct OrbitBodies {
+  OrbitBodiesCreateInfo info;
+  size_t count = 0;
+  float accumulator = 0.0f;
+
+  std::vector<float> px, py, pz;
+  std::vector<float> vx, vy, vz;
+  // 3 M L^2, the coefficient of the relativistic correction.
+  std::vector<float> k;
+  // Self-spin as a unit complex number, advanced by a fixed rotation per step.
+  std::vector<float> spinCos, spinSin;
+  std::vector<float> stepCos, stepSin;
+  std::vector<float> scale;
+
+  // One model matrix per body, filled by advanceOrbitBodies() and ready for
+  // upload as an instanced attribute buffer.
+  std::vector<glm::mat4> models;
+};
+
+// Starts every body at the periapsis of its orbit with a tangential speed
+// between circular and 90% of escape speed, so all orbits stay bound and
+// outside the photon sphere. Only orbit.x/y/z, oscillation.z/w and
+// attitude.x/w are used; the vertical oscillation has no physical
+// counterpart.
+OrbitBodies createOrbitBodies(const OrbitBodiesCreateInfo &info,
+                              const std::vector<SatelliteOrbitParams> &orbits);
+
+// Advances the bodies by dt scene seconds in whole fixed steps and rebuilds
+// their model matrices. Returns the number of steps taken.
+int advanceOrbitBodies(OrbitBodies &bodies, float dt);
+
+#endif /* ORBIT_H */
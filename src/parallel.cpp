@@ -0,0 +1,109 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+  if (threadCount == 0) {
+    unsigned hw = std::thread::hardware_concurrency();
+    threadCount = hw > 1 ? hw - 1 : 1;
+  }
+  for (unsigned i = 0; i < threadCount; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  taskAvailable.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+  }
+  taskAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+      if (stopping && tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t minChunk,
+                             const std::function<void(size_t, size_t)> &fn) {
+  minChunk = std::max<size_t>(minChunk, 1);
+  size_t maxChunks = (size_t)threadCount() + 1;
+  size_t chunkCount = std::min(maxChunks, count / minChunk);
+  if (chunkCount < 2) {
+    if (count > 0) {
+      fn(0, count);
+    }
+    return;
+  }
+
+  // Shared with the helper tasks, which may still be queued after the last
+  // chunk has been claimed and this call has returned.
+  struct State {
+    std::function<void(size_t, size_t)> fn;
+    size_t count = 0;
+    size_t chunkCount = 0;
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<size_t> remaining{0};
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+  auto state = std::make_shared<State>();
+  state->fn = fn;
+  state->count = count;
+  state->chunkCount = chunkCount;
+  state->remaining = chunkCount;
+
+  auto runChunks = [](State &s) {
+    for (;;) {
+      size_t chunk = s.nextChunk.fetch_add(1);
+      if (chunk >= s.chunkCount) {
+        return;
+      }
+      size_t begin = s.count * chunk / s.chunkCount;
+      size_t end = s.count * (chunk + 1) / s.chunkCount;
+      s.fn(begin, end);
+      if (s.remaining.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.done.notify_all();
+      }
+    }
+  };
+
+  for (size_t i = 1; i < chunkCount; i++) {
+    submit([state, runChunks] { runChunks(*state); });
+  }
+  runChunks(*state);
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&] { return state->remaining.load() == 0; });
+}
+
+ThreadPool &ThreadPool::shared() {
+  static ThreadPool pool;
+  return pool;
+}
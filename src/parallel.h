@@ -0,0 +1,49 @@
+
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads for CPU-side work (mesh baking, asset
+// decoding, simulation). Tasks run in FIFO order.
+class ThreadPool {
+public:
+  // threadCount == 0 uses one worker per hardware thread minus the caller.
+  explicit ThreadPool(unsigned threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> task);
+
+  // Runs fn(begin, end) over contiguous chunks of [0, count) and returns once
+  // every chunk is done. The calling thread works on chunks too, so this is
+  // safe to call from inside a pool task. Runs inline when count is smaller
+  // than two chunks of minChunk.
+  void parallelFor(size_t count, size_t minChunk,
+                   const std::function<void(size_t, size_t)> &fn);
+
+  unsigned threadCount() const { return (unsigned)workers.size(); }
+
+  // Process-wide pool, created on first use.
+  static ThreadPool &shared();
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable taskAvailable;
+  bool stopping = false;
+};
+
+#endif /* PARALLEL_H */
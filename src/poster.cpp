@@ -0,0 +1,165 @@
+#include "poster.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+int alignUp(int value, int alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Largest square render a texture, a renderbuffer and the viewport all take.
+int maxRenderSize() {
+  GLint maxTextureSize = 0, maxRenderbufferSize = 0;
+  GLint maxViewport[2] = {};
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+  glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+  glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+  return std::min({maxTextureSize, maxRenderbufferSize, maxViewport[0],
+                   maxViewport[1]});
+}
+
+} // namespace
+
+glm::mat4 tileProjection(const ImageTile &tile, const glm::mat4 &projection) {
+  // Scale and shift normalized device coordinates so that the tile's render
+  // spans -1 to 1: x' = x * W / w + W / w - 1 - 2 * origin / w, likewise for
+  // y, multiplied through by w in clip space.
+  glm::vec2 image((float)tile.imageWidth, (float)tile.imageHeight);
+  glm::vec2 render((float)tile.renderWidth, (float)tile.renderHeight);
+  glm::vec2 origin(tile.origin());
+  glm::vec2 scale = image / render;
+  glm::vec2 bias = scale - 1.0f - 2.0f * origin / render;
+
+  glm::mat4 tileMatrix(1.0f);
+  tileMatrix[0][0] = scale.x;
+  tileMatrix[1][1] = scale.y;
+  tileMatrix[3][0] = bias.x;
+  tileMatrix[3][1] = bias.y;
+  return tileMatrix * projection;
+}
+
+void readTile(GLuint framebuffer, GLuint texture, const ImageTile &tile,
+              std::vector<uint8_t> &pixels) {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                         GL_TEXTURE_2D, texture, 0);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  pixels.resize((size_t)tile.width * tile.height * 3);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(tile.margin, tile.margin, tile.width, tile.height, GL_RGB,
+               GL_UNSIGNED_BYTE, pixels.data());
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+std::vector<ImageTile> splitImage(int width, int height, int tileSize,
+                                  int margin) {
+  tileSize = alignUp(std::max(tileSize, 1), kPosterAlignment);
+  margin = alignUp(std::max(margin, 0), kPosterAlignment);
+  int columns = (width + tileSize - 1) / tileSize;
+  int rows = (height + tileSize - 1) / tileSize;
+
+  std::vector<ImageTile> tiles;
+  for (int row = rows - 1; row >= 0; --row) {
+    for (int column = 0; column < columns; ++column) {
+      ImageTile tile;
+      tile.imageWidth = width;
+      tile.imageHeight = height;
+      tile.x = column * tileSize;
+      tile.y = row * tileSize;
+      tile.width = std::min(tileSize, width - tile.x);
+      tile.height = std::min(tileSize, height - tile.y);
+      tile.margin = margin;
+      tile.renderWidth = tileSize + margin * 2;
+      tile.renderHeight = tile.renderWidth;
+      tiles.push_back(tile);
+    }
+  }
+  return tiles;
+}
+
+bool PpmWriter::open(const std::string &path, int width, int height) {
+  output.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!output.is_open()) {
+    return false;
+  }
+  output << "P6\n" << width << " " << height << "\n255\n";
+  dataOffset = output.tellp();
+  this->width = width;
+  this->height = height;
+  return (bool)output;
+}
+
+bool PpmWriter::write(const ImageTile &tile,
+                      const std::vector<uint8_t> &pixels) {
+  // The file is top row first, the tile bottom row first.
+  for (int j = 0; j < tile.height; ++j) {
+    std::streamoff imageRow = height - 1 - (tile.y + j);
+    output.seekp(dataOffset + (imageRow * width + tile.x) * 3);
+    output.write((const char *)pixels.data() + (size_t)j * tile.width * 3,
+                 (std::streamsize)tile.width * 3);
+  }
+  return (bool)output;
+}
+
+void PpmWriter::close() {
+  if (output.is_open()) {
+    output.close();
+  }
+}
+
+Poster::Poster(const PosterCreateInfo &info) : info(info) {
+  this->info.width = std::max(this->info.width, 1);
+  this->info.height = std::max(this->info.height, 1);
+  int tileSize = alignUp(std::max(info.tileSize, 1), kPosterAlignment);
+  int margin = alignUp(std::max(info.margin, 0), kPosterAlignment);
+
+  int maxSize = maxRenderSize();
+  int maxTileSize = (maxSize - margin * 2) / kPosterAlignment * kPosterAlignment;
+  if (maxSize > 0 && tileSize > maxTileSize) {
+    if (maxTileSize < kPosterAlignment) {
+      margin = 0;
+      maxTileSize = maxSize / kPosterAlignment * kPosterAlignment;
+    }
+    printf("WARNING: Poster tiles of %d pixels exceed the limit of %d, using "
+           "%d\n",
+           tileSize, maxSize, maxTileSize);
+    tileSize = maxTileSize;
+  }
+  tiles = splitImage(this->info.width, this->info.height, tileSize, margin);
+
+  if (!output.open(info.path, this->info.width, this->info.height)) {
+    printf("ERROR: Failed to open %s for the poster\n", info.path.c_str());
+    return;
+  }
+  glGenFramebuffers(1, &framebuffer);
+  printf("Rendering a %dx%d poster to %s in %d tiles of %d pixels\n",
+         this->info.width, this->info.height, info.path.c_str(), tileCount(),
+         tileSize);
+}
+
+Poster::~Poster() { shutdown(); }
+
+void Poster::writeTile(GLuint texture) {
+  if (!ok() || done()) {
+    return;
+  }
+  readTile(framebuffer, texture, tiles[tile], pixels);
+  if (!output.write(tiles[tile], pixels)) {
+    printf("ERROR: Failed to write the poster to %s, stopping\n",
+           info.path.c_str());
+    output.close();
+    return;
+  }
+  tile++;
+}
+
+void Poster::shutdown() {
+  output.close();
+  if (framebuffer != 0) {
+    glDeleteFramebuffers(1, &framebuffer);
+    framebuffer = 0;
+  }
+}
@@ -0,0 +1,123 @@
+
+
+#ifndef POSTER_H
+#define POSTER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Tile sizes and margins are kept multiples of this, so that the bloom
+// pyramid of every tile (down to 1/32 of its size) samples the same texel
+// grid as that of the whole image.
+const int kPosterAlignment = 32;
+
+// Part of a larger image rendered in place of the window's frame. The
+// renders of all tiles of an image are the same size; tiles at the right and
+// top edges render past the image.
+struct ImageTile {
+  int imageWidth = 0;
+  int imageHeight = 0;
+  // Pixels of the image the tile contributes, from the lower left.
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  int height = 0;
+  // Pixels rendered around them and thrown away, so that bloom near the
+  // tile's edges sees the same neighbourhood as in the whole image.
+  int margin = 0;
+  int renderWidth = 0;
+  int renderHeight = 0;
+
+  // Pixel of the image at the lower left of the render, so possibly
+  // negative.
+  glm::ivec2 origin() const { return glm::ivec2(x - margin, y - margin); }
+};
+
+// Maps the image's clip space, for a projection built with its aspect ratio,
+// to the tile's render.
+glm::mat4 tileProjection(const ImageTile &tile, const glm::mat4 &projection);
+
+// Reads the tile's pixels, without the margin, out of texture (its render)
+// as RGB rows from the bottom up, through framebuffer.
+void readTile(GLuint framebuffer, GLuint texture, const ImageTile &tile,
+              std::vector<uint8_t> &pixels);
+
+// Splits a width by height image into tiles of tileSize plus a margin on
+// every side, both rounded up to kPosterAlignment. Returns the tiles from
+// the top row down.
+std::vector<ImageTile> splitImage(int width, int height, int tileSize,
+                                  int margin);
+
+// Binary PPM written a tile at a time at each row's offset, so that only a
+// tile is ever held in memory, whatever the image's size.
+class PpmWriter {
+public:
+  bool open(const std::string &path, int width, int height);
+  bool isOpen() const { return output.is_open(); }
+  // pixels as from readTile().
+  bool write(const ImageTile &tile, const std::vector<uint8_t> &pixels);
+  void close();
+
+private:
+  std::ofstream output;
+  std::streamoff dataOffset = 0;
+  int width = 0;
+  int height = 0;
+};
+
+struct PosterCreateInfo {
+  int width = 16384;
+  int height = 8192;
+  // Pixels of the image each tile contributes.
+  int tileSize = 1024;
+  // Bloom reaches about 100 pixels at five levels.
+  int margin = 128;
+  std::string path = "poster.ppm";
+};
+
+// Renders an image far larger than a framebuffer can be as a grid of tiles,
+// one per frame. Each tile is drawn with the full image's camera restricted
+// to the tile's part of the view: the tile's origin offsets the ray
+// marcher's pixels and tileProjection() narrows the rasterized passes'
+// frustum.
+class Poster {
+public:
+  explicit Poster(const PosterCreateInfo &info = PosterCreateInfo());
+  ~Poster();
+
+  Poster(const Poster &) = delete;
+  Poster &operator=(const Poster &) = delete;
+
+  bool ok() const { return output.isOpen(); }
+  bool done() const { return tile >= tileCount(); }
+
+  int width() const { return info.width; }
+  int height() const { return info.height; }
+  int tileCount() const { return (int)tiles.size(); }
+  int tilesDone() const { return tile; }
+
+  // The tile to render next.
+  const ImageTile &currentTile() const { return tiles[tile]; }
+
+  // Reads the current tile out of texture, its render, writes it to the file
+  // and moves to the next.
+  void writeTile(GLuint texture);
+
+  // Closes the file; also run by the destructor.
+  void shutdown();
+
+private:
+  PosterCreateInfo info;
+  std::vector<ImageTile> tiles;
+  int tile = 0;
+  GLuint framebuffer = 0;
+  PpmWriter output;
+  std::vector<uint8_t> pixels; // one tile
+};
+
+#endif /* POSTER_H */
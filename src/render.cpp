@@ -6,6 +6,9 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+// Framebuffers made by renderToTexture(), by their color texture.
+static std::map<GLuint, GLuint> textureFramebufferMap;
+
 GLuint createColorTexture(int width, int height, bool hdr) {
   GLuint colorTexture;
   glGenTextures(1, &colorTexture);
@@ -55,6 +58,29 @@ GLuint createFramebuffer(const FramebufferCreateInfo &info) {
   return framebuffer;
 }
 
+void deleteColorTexture(GLuint texture) {
+  auto it = textureFramebufferMap.find(texture);
+  if (it != textureFramebufferMap.end()) {
+    glDeleteFramebuffers(1, &it->second);
+    textureFramebufferMap.erase(it);
+  }
+  glDeleteTextures(1, &texture);
+}
+
+void deleteFramebuffer(GLuint framebuffer) {
+  GLint depthBuffer = 0;
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glGetFramebufferAttachmentParameteriv(
+      GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+      GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &depthBuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (depthBuffer != 0) {
+    GLuint renderbuffer = (GLuint)depthBuffer;
+    glDeleteRenderbuffers(1, &renderbuffer);
+  }
+  glDeleteFramebuffers(1, &framebuffer);
+}
+
 GLuint createQuadVAO() {
   std::vector<glm::vec3> vertices;
 
@@ -119,7 +145,6 @@ void renderToTexture(const RenderToTextureInfo &rtti) {
 
   // Lazy creation of a framebuffer as the render target and attach the texture
   // as the color attachment.
-  static std::map<GLuint, GLuint> textureFramebufferMap;
   GLuint targetFramebuffer;
   if (!textureFramebufferMap.count(rtti.targetTexture)) {
     FramebufferCreateInfo createInfo;
@@ -21,6 +21,13 @@ struct FramebufferCreateInfo {
 
 GLuint createFramebuffer(const FramebufferCreateInfo &info);
 
+// Deletes a texture along with the framebuffer renderToTexture() made for
+// it, which would otherwise render into a later texture given the same name.
+void deleteColorTexture(GLuint texture);
+
+// Deletes a framebuffer made by createFramebuffer() and its depth buffer.
+void deleteFramebuffer(GLuint framebuffer);
+
 GLuint createQuadVAO();
 
 struct RenderToTextureInfo {
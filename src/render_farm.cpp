@@ -0,0 +1,640 @@
+#include "render_farm.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <csignal>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+#include "simulation.h"
+
+#ifndef _WIN32
+
+namespace {
+
+// Every message is a header of two 32-bit words, its type and the bytes
+// that follow, then 32-bit fields and for results the pixels. All words are
+// in network byte order.
+enum MessageType : uint32_t {
+  kMessageHello = 1,  // worker: pid
+  kMessageJob = 2,    // coordinator: RenderJob fields
+  kMessageResult = 3, // worker: job id, width, height, RGB rows bottom up
+  kMessageDone = 4    // coordinator: no more jobs
+};
+
+const size_t kHeaderBytes = 8;
+const int kJobFields = 12;
+const int kResultFields = 3;
+
+double now() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool sendAll(int socket, const void *data, size_t size) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  while (size > 0) {
+    ssize_t sent = send(socket, bytes, size, 0);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    bytes += sent;
+    size -= (size_t)sent;
+  }
+  return true;
+}
+
+bool receiveAll(int socket, void *data, size_t size) {
+  uint8_t *bytes = (uint8_t *)data;
+  while (size > 0) {
+    ssize_t received = recv(socket, bytes, size, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    size -= (size_t)received;
+  }
+  return true;
+}
+
+// The type, size and fields of a message whose data follows.
+std::vector<uint32_t> messageHeader(uint32_t type,
+                                    const std::vector<int32_t> &fields,
+                                    size_t dataBytes) {
+  std::vector<uint32_t> words;
+  words.push_back(htonl(type));
+  words.push_back(htonl((uint32_t)(fields.size() * 4 + dataBytes)));
+  for (int32_t field : fields) {
+    words.push_back(htonl((uint32_t)field));
+  }
+  return words;
+}
+
+// Sends on the worker's blocking socket.
+bool sendMessage(int socket, uint32_t type, const std::vector<int32_t> &fields,
+                 const std::vector<uint8_t> *data = nullptr) {
+  size_t dataBytes = data != nullptr ? data->size() : 0;
+  std::vector<uint32_t> words = messageHeader(type, fields, dataBytes);
+  if (!sendAll(socket, words.data(), words.size() * 4)) {
+    return false;
+  }
+  return dataBytes == 0 || sendAll(socket, data->data(), dataBytes);
+}
+
+// Queues a message without data for the coordinator's non-blocking sockets.
+void appendMessage(std::vector<uint8_t> &bytes, uint32_t type,
+                   const std::vector<int32_t> &fields) {
+  std::vector<uint32_t> words = messageHeader(type, fields, 0);
+  const uint8_t *header = (const uint8_t *)words.data();
+  bytes.insert(bytes.end(), header, header + words.size() * 4);
+}
+
+int32_t fieldAt(const uint8_t *payload, int index) {
+  uint32_t word;
+  memcpy(&word, payload + index * 4, 4);
+  return (int32_t)ntohl(word);
+}
+
+std::vector<int32_t> encodeJob(const RenderJob &job) {
+  const ImageTile &tile = job.tile;
+  return {job.id,
+          job.frame,
+          (int32_t)std::lround(job.time * 1e6),
+          tile.imageWidth,
+          tile.imageHeight,
+          tile.x,
+          tile.y,
+          tile.width,
+          tile.height,
+          tile.margin,
+          tile.renderWidth,
+          tile.renderHeight};
+}
+
+RenderJob decodeJob(const uint8_t *payload) {
+  RenderJob job;
+  job.id = fieldAt(payload, 0);
+  job.frame = fieldAt(payload, 1);
+  job.time = fieldAt(payload, 2) * 1e-6;
+  job.tile.imageWidth = fieldAt(payload, 3);
+  job.tile.imageHeight = fieldAt(payload, 4);
+  job.tile.x = fieldAt(payload, 5);
+  job.tile.y = fieldAt(payload, 6);
+  job.tile.width = fieldAt(payload, 7);
+  job.tile.height = fieldAt(payload, 8);
+  job.tile.margin = fieldAt(payload, 9);
+  job.tile.renderWidth = fieldAt(payload, 10);
+  job.tile.renderHeight = fieldAt(payload, 11);
+  return job;
+}
+
+} // namespace
+
+RenderCoordinator::RenderCoordinator(const RenderCoordinatorCreateInfo &info)
+    : info(info) {
+  // A worker that goes away must not take the coordinator with it.
+  signal(SIGPIPE, SIG_IGN);
+
+  int lastFrame = info.lastFrame;
+  if (lastFrame < 0) {
+    lastFrame = (int)std::ceil(autopilotDuration() * info.fps) - 1;
+  }
+  int tileSize = info.tileSize > 0 ? info.tileSize
+                                   : std::max(info.width, info.height);
+  std::vector<ImageTile> tiles =
+      splitImage(info.width, info.height, tileSize, info.margin);
+  // Frame by frame, so that frames are finished and closed in order.
+  for (int frame = info.firstFrame; frame <= lastFrame; ++frame) {
+    tilesLeft[frame] = (int)tiles.size();
+    for (const ImageTile &tile : tiles) {
+      JobState state;
+      state.job.id = (int)jobs.size();
+      state.job.frame = frame;
+      state.job.time = frame / (double)info.fps;
+      state.job.tile = tile;
+      pending.push_back(state.job.id);
+      jobs.push_back(state);
+    }
+  }
+  jobsLeft = (int)jobs.size();
+
+  std::error_code error;
+  std::filesystem::create_directories(info.outputDirectory, error);
+
+  listener = ::socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons((uint16_t)info.port);
+  if (listener < 0 ||
+      bind(listener, (sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, 64) != 0) {
+    printf("ERROR: Failed to listen on port %d: %s\n", info.port,
+           strerror(errno));
+    if (listener >= 0) {
+      close(listener);
+      listener = -1;
+    }
+    return;
+  }
+
+  for (int i = 0; i < info.localWorkers && !info.workerCommand.empty(); ++i) {
+    std::vector<std::string> arguments = info.workerCommand;
+    arguments.push_back("127.0.0.1:" + std::to_string(info.port));
+    std::vector<char *> argv;
+    for (std::string &argument : arguments) {
+      argv.push_back(argument.data());
+    }
+    argv.push_back(nullptr);
+    pid_t pid = 0;
+    if (posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ) !=
+        0) {
+      printf("ERROR: Failed to start worker %s\n", argv[0]);
+      continue;
+    }
+    localPids.push_back(pid);
+  }
+
+  printf("Render farm: %d frames of %dx%d in %zu jobs on port %d, %d local "
+         "workers\n",
+         lastFrame - info.firstFrame + 1, info.width, info.height, jobs.size(),
+         info.port, (int)localPids.size());
+}
+
+RenderCoordinator::~RenderCoordinator() { shutdown(); }
+
+bool RenderCoordinator::run() {
+  if (listener < 0) {
+    return false;
+  }
+  double start = now();
+  double lastWorkerSeen = start;
+
+  while (jobsLeft > 0) {
+    std::vector<pollfd> fds;
+    fds.push_back({listener, POLLIN, 0});
+    for (const Connection &connection : connections) {
+      short events = POLLIN;
+      if (!connection.output.empty()) {
+        events |= POLLOUT;
+      }
+      fds.push_back({connection.socket, events, 0});
+    }
+    // Wakes up now and then for the timeouts.
+    poll(fds.data(), (nfds_t)fds.size(), 100);
+
+    if (fds[0].revents & POLLIN) {
+      accept();
+    }
+    for (size_t i = 1; i < fds.size(); ++i) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      auto it = std::find_if(
+          connections.begin(), connections.end(),
+          [&](const Connection &c) { return c.socket == fds[i].fd; });
+      if (it == connections.end()) {
+        continue;
+      }
+      bool alive = true;
+      if (fds[i].revents & POLLOUT) {
+        alive = flush(*it);
+      }
+      if (alive && (fds[i].revents & ~POLLOUT) != 0) {
+        alive = receive(*it);
+      }
+      if (!alive) {
+        disconnect(*it);
+        connections.erase(it);
+      }
+    }
+
+    double time = now();
+    for (Connection &connection : connections) {
+      std::vector<int> late;
+      for (int jobId : connection.jobs) {
+        if (time - jobs[jobId].startedAt > info.jobTimeoutSeconds) {
+          late.push_back(jobId);
+        }
+      }
+      for (int jobId : late) {
+        connection.jobs.erase(std::find(connection.jobs.begin(),
+                                        connection.jobs.end(), jobId));
+        retry(jobId, "timed out");
+      }
+    }
+    dispatch();
+
+    if (!connections.empty()) {
+      lastWorkerSeen = time;
+    } else if (time - lastWorkerSeen > info.workerWaitSeconds) {
+      printf("ERROR: No render farm workers for %.0f s, giving up with %d "
+             "jobs left\n",
+             info.workerWaitSeconds, jobsLeft);
+      break;
+    }
+  }
+
+  double seconds = now() - start;
+  int frames = framesWritten + framesFailed;
+  printf("Render farm: %d frames written, %d failed in %.1f s (%.2f "
+         "frames/s)\n",
+         framesWritten, framesFailed, seconds,
+         seconds > 0.0 ? frames / seconds : 0.0);
+  for (const Connection &connection : connections) {
+    printf("  worker %d: %d jobs\n", connection.pid, connection.completed);
+  }
+  shutdown();
+  return jobsLeft == 0 && framesFailed == 0;
+}
+
+void RenderCoordinator::accept() {
+  int socket = ::accept(listener, nullptr, nullptr);
+  if (socket < 0) {
+    return;
+  }
+  int noDelay = 1;
+  setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+  Connection connection;
+  connection.socket = socket;
+  connections.push_back(connection);
+}
+
+bool RenderCoordinator::receive(Connection &connection) {
+  uint8_t buffer[65536];
+  bool open = true;
+  while (true) {
+    ssize_t received = recv(connection.socket, buffer, sizeof(buffer), 0);
+    if (received > 0) {
+      connection.input.insert(connection.input.end(), buffer,
+                              buffer + received);
+      continue;
+    }
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    // Closed or failed; what arrived before still counts, such as the last
+    // result of a worker that then quit.
+    open = false;
+    break;
+  }
+
+  size_t offset = 0;
+  while (connection.input.size() - offset >= kHeaderBytes) {
+    uint32_t header[2];
+    memcpy(header, connection.input.data() + offset, kHeaderBytes);
+    uint32_t type = ntohl(header[0]);
+    size_t size = ntohl(header[1]);
+    if (connection.input.size() - offset - kHeaderBytes < size) {
+      break;
+    }
+    const uint8_t *payload = connection.input.data() + offset + kHeaderBytes;
+    if (type == kMessageHello && size >= 4) {
+      connection.pid = fieldAt(payload, 0);
+    } else if (type == kMessageResult) {
+      handleResult(connection, payload, size);
+    }
+    offset += kHeaderBytes + size;
+  }
+  connection.input.erase(connection.input.begin(),
+                         connection.input.begin() + offset);
+  return open;
+}
+
+void RenderCoordinator::handleResult(Connection &connection,
+                                     const uint8_t *payload, size_t size) {
+  if (size < kResultFields * 4) {
+    return;
+  }
+  int jobId = fieldAt(payload, 0);
+  if (jobId < 0 || jobId >= (int)jobs.size()) {
+    return;
+  }
+  connection.jobs.erase(
+      std::remove(connection.jobs.begin(), connection.jobs.end(), jobId),
+      connection.jobs.end());
+  JobState &state = jobs[jobId];
+  const ImageTile &tile = state.job.tile;
+  if (state.done) {
+    return; // a retried job's first result came in after all
+  }
+  if (fieldAt(payload, 1) != tile.width || fieldAt(payload, 2) != tile.height ||
+      size != kResultFields * 4 + (size_t)tile.width * tile.height * 3) {
+    retry(jobId, "sent a malformed result");
+    return;
+  }
+  connection.completed++;
+
+  int frame = state.job.frame;
+  PpmWriter &writer = openFrames[frame];
+  if (!writer.isOpen()) {
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%05d.ppm", frame);
+    std::string path =
+        (std::filesystem::path(info.outputDirectory) / name).string();
+    if (!writer.open(path, tile.imageWidth, tile.imageHeight)) {
+      printf("ERROR: Failed to open %s\n", path.c_str());
+    }
+  }
+  const uint8_t *pixels = payload + kResultFields * 4;
+  std::vector<uint8_t> tilePixels(pixels, payload + size);
+  if (!writer.isOpen() || !writer.write(tile, tilePixels)) {
+    state.failed = true;
+  }
+  state.done = true;
+  jobsLeft--;
+
+  if (--tilesLeft[frame] == 0) {
+    writer.close();
+    openFrames.erase(frame);
+    bool failed = false;
+    for (const JobState &other : jobs) {
+      failed |= other.job.frame == frame && other.failed;
+    }
+    failed ? framesFailed++ : framesWritten++;
+    printf("Frame %d %s (%d of %d frames)\n", frame,
+           failed ? "FAILED" : "written", framesWritten + framesFailed,
+           (int)tilesLeft.size());
+  }
+}
+
+bool RenderCoordinator::flush(Connection &connection) {
+  size_t offset = 0;
+  while (offset < connection.output.size()) {
+    ssize_t sent = send(connection.socket, connection.output.data() + offset,
+                        connection.output.size() - offset, 0);
+    if (sent > 0) {
+      offset += (size_t)sent;
+      continue;
+    }
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break; // the rest goes out on POLLOUT
+    }
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    return false;
+  }
+  connection.output.erase(connection.output.begin(),
+                          connection.output.begin() + offset);
+  return true;
+}
+
+void RenderCoordinator::dispatch() {
+  for (auto it = connections.begin(); it != connections.end();) {
+    Connection &connection = *it;
+    while (!pending.empty() &&
+           (int)connection.jobs.size() < std::max(info.jobsPerWorker, 1)) {
+      int jobId = pending.front();
+      pending.pop_front();
+      JobState &state = jobs[jobId];
+      if (state.done) {
+        continue;
+      }
+      state.attempts++;
+      state.startedAt = now();
+      connection.jobs.push_back(jobId);
+      appendMessage(connection.output, kMessageJob, encodeJob(state.job));
+    }
+    if (!flush(connection)) {
+      // Its jobs go back to the front of pending for the next connections.
+      disconnect(connection);
+      it = connections.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void RenderCoordinator::retry(int jobId, const char *reason) {
+  JobState &state = jobs[jobId];
+  if (state.done) {
+    return;
+  }
+  if (state.attempts >= info.maxAttempts) {
+    printf("ERROR: Job %d (frame %d) %s after %d attempts, giving up\n",
+           jobId, state.job.frame, reason, state.attempts);
+    state.failed = true;
+    state.done = true;
+    jobsLeft--;
+    int frame = state.job.frame;
+    if (--tilesLeft[frame] == 0) {
+      openFrames.erase(frame);
+      framesFailed++;
+    }
+    return;
+  }
+  printf("WARNING: Job %d (frame %d) %s, handing it out again\n", jobId,
+         state.job.frame, reason);
+  // First in line, so that its frame is finished next.
+  pending.push_front(jobId);
+}
+
+void RenderCoordinator::disconnect(Connection &connection) {
+  close(connection.socket);
+  std::vector<int> lost = connection.jobs;
+  connection.jobs.clear();
+  for (int jobId : lost) {
+    retry(jobId, "lost its worker");
+  }
+}
+
+void RenderCoordinator::shutdown() {
+  for (Connection &connection : connections) {
+    // Best effort; a worker that misses it stops when the socket closes.
+    appendMessage(connection.output, kMessageDone, {});
+    flush(connection);
+    close(connection.socket);
+  }
+  connections.clear();
+  if (listener >= 0) {
+    close(listener);
+    listener = -1;
+  }
+  for (pid_t pid : localPids) {
+    waitpid(pid, nullptr, 0);
+  }
+  localPids.clear();
+  openFrames.clear();
+}
+
+RenderWorker::RenderWorker(const std::string &address) {
+  signal(SIGPIPE, SIG_IGN);
+
+  size_t colon = address.rfind(':');
+  std::string host = address.substr(0, colon);
+  std::string port = colon != std::string::npos ? address.substr(colon + 1)
+                                                 : std::string("47800");
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *results = nullptr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0) {
+    printf("ERROR: Failed to resolve the coordinator %s\n", address.c_str());
+    return;
+  }
+  for (addrinfo *result = results; result != nullptr && socket < 0;
+       result = result->ai_next) {
+    socket = ::socket(result->ai_family, result->ai_socktype,
+                      result->ai_protocol);
+    if (socket >= 0 && connect(socket, result->ai_addr, result->ai_addrlen)) {
+      close(socket);
+      socket = -1;
+    }
+  }
+  freeaddrinfo(results);
+  if (socket < 0) {
+    printf("ERROR: Failed to connect to the coordinator %s\n",
+           address.c_str());
+    return;
+  }
+  int noDelay = 1;
+  setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  sendMessage(socket, kMessageHello, {(int32_t)getpid()});
+  glGenFramebuffers(1, &framebuffer);
+}
+
+RenderWorker::~RenderWorker() { shutdown(); }
+
+bool RenderWorker::nextJob(RenderJob &job) {
+  while (socket >= 0) {
+    uint32_t header[2];
+    if (!receiveAll(socket, header, kHeaderBytes)) {
+      return false;
+    }
+    uint32_t type = ntohl(header[0]);
+    std::vector<uint8_t> payload(ntohl(header[1]));
+    if (!receiveAll(socket, payload.data(), payload.size())) {
+      return false;
+    }
+    if (type == kMessageDone) {
+      return false;
+    }
+    if (type == kMessageJob && payload.size() >= kJobFields * 4) {
+      job = decodeJob(payload.data());
+      return true;
+    }
+  }
+  return false;
+}
+
+void RenderWorker::finishJob(const RenderJob &job, GLuint texture) {
+  if (socket < 0) {
+    return;
+  }
+  readTile(framebuffer, texture, job.tile, pixels);
+  if (!sendMessage(socket, kMessageResult,
+                   {job.id, job.tile.width, job.tile.height}, &pixels)) {
+    printf("ERROR: Lost the coordinator\n");
+    close(socket);
+    socket = -1;
+  }
+}
+
+void RenderWorker::shutdown() {
+  if (socket >= 0) {
+    close(socket);
+    socket = -1;
+  }
+  if (framebuffer != 0) {
+    glDeleteFramebuffers(1, &framebuffer);
+    framebuffer = 0;
+  }
+}
+
+#else
+
+RenderCoordinator::RenderCoordinator(const RenderCoordinatorCreateInfo &info)
+    : info(info) {
+  printf("ERROR: The render farm is not supported on Windows\n");
+}
+
+RenderCoordinator::~RenderCoordinator() {}
+
+bool RenderCoordinator::run() { return false; }
+
+void RenderCoordinator::shutdown() {}
+
+RenderWorker::RenderWorker(const std::string &) {
+  printf("ERROR: The render farm is not supported on Windows\n");
+}
+
+RenderWorker::~RenderWorker() {}
+
+bool RenderWorker::nextJob(RenderJob &) { return false; }
+
+void RenderWorker::finishJob(const RenderJob &, GLuint) {}
+
+void RenderWorker::shutdown() {}
+
+#endif
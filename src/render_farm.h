@@ -0,0 +1,145 @@
+
+
+#ifndef RENDER_FARM_H
+#define RENDER_FARM_H
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "poster.h"
+
+// One tile of one frame of the autopilot flythrough.
+struct RenderJob {
+  int id = 0;
+  int frame = 0;
+  double time = 0.0; // seconds into the flythrough
+  ImageTile tile;
+};
+
+struct RenderCoordinatorCreateInfo {
+  int port = 47800;
+  int width = 7680; // 8K UHD
+  int height = 4320;
+  float fps = 30.0f;
+  int firstFrame = 0;
+  int lastFrame = -1; // -1: to the end of the flythrough
+  // Frames are split into tiles of this size (see Poster), or rendered
+  // whole when it is 0.
+  int tileSize = 2048;
+  int margin = 128;
+  // frame_00000.ppm onwards.
+  std::string outputDirectory = "flythrough";
+  // Workers started on this machine, each running workerCommand with the
+  // coordinator's address appended. Others may connect from elsewhere.
+  int localWorkers = 2;
+  std::vector<std::string> workerCommand;
+  // Jobs queued with each worker, so that it starts on the next one as soon
+  // as it has sent a result. Faster workers come back for more sooner.
+  int jobsPerWorker = 2;
+  // A job is handed out again when its worker disconnects or takes longer
+  // than jobTimeoutSeconds, up to maxAttempts times.
+  int maxAttempts = 3;
+  double jobTimeoutSeconds = 300.0;
+  // Gives up when no worker has been connected for this long.
+  double workerWaitSeconds = 60.0;
+};
+
+// Splits a range of flythrough frames into jobs, hands them out over TCP to
+// RenderWorker processes, one per GPU, NUMA node or machine, and assembles
+// the tiles they send back into one PPM per frame. Needs no GL context.
+class RenderCoordinator {
+public:
+  explicit RenderCoordinator(
+      const RenderCoordinatorCreateInfo &info = RenderCoordinatorCreateInfo());
+  ~RenderCoordinator();
+
+  RenderCoordinator(const RenderCoordinator &) = delete;
+  RenderCoordinator &operator=(const RenderCoordinator &) = delete;
+
+  // Returns once every job is done or the workers are gone; true if every
+  // frame was written.
+  bool run();
+
+  // Closes the connections and waits for the local workers; also run by the
+  // destructor.
+  void shutdown();
+
+private:
+  struct Connection {
+    int socket = -1;
+    int pid = 0; // as the worker introduced itself
+    std::vector<uint8_t> input;
+    // Queued messages the socket has not taken yet, sent on POLLOUT.
+    std::vector<uint8_t> output;
+    std::vector<int> jobs; // in flight
+    int completed = 0;
+  };
+
+  struct JobState {
+    RenderJob job;
+    int attempts = 0;
+    bool done = false;
+    bool failed = false;
+    double startedAt = 0.0;
+  };
+
+  void accept();
+  bool receive(Connection &connection);
+  bool flush(Connection &connection);
+  void handleResult(Connection &connection, const uint8_t *payload,
+                    size_t size);
+  void dispatch();
+  void retry(int jobId, const char *reason);
+  // Closes the connection and hands its jobs out again; the caller removes
+  // it from connections.
+  void disconnect(Connection &connection);
+
+  RenderCoordinatorCreateInfo info;
+  int listener = -1;
+  std::vector<int> localPids;
+  std::vector<Connection> connections;
+
+  std::vector<JobState> jobs;
+  std::deque<int> pending;
+  std::map<int, PpmWriter> openFrames;
+  std::map<int, int> tilesLeft; // by frame
+  int jobsLeft = 0;
+  int framesWritten = 0;
+  int framesFailed = 0;
+};
+
+// Renders jobs of a RenderCoordinator: the render loop takes one with
+// nextJob(), renders its tile offscreen as it would a poster's, and streams
+// the pixels back with finishJob().
+class RenderWorker {
+public:
+  // address is the coordinator's host:port.
+  explicit RenderWorker(const std::string &address);
+  ~RenderWorker();
+
+  RenderWorker(const RenderWorker &) = delete;
+  RenderWorker &operator=(const RenderWorker &) = delete;
+
+  bool ok() const { return socket >= 0; }
+
+  // Waits for the next job; false once the coordinator has no more or is
+  // gone.
+  bool nextJob(RenderJob &job);
+  // Reads the job's tile out of texture, its render, and sends it.
+  void finishJob(const RenderJob &job, GLuint texture);
+
+  // Disconnects; also run by the destructor.
+  void shutdown();
+
+private:
+  int socket = -1;
+  GLuint framebuffer = 0;
+  std::vector<uint8_t> pixels;
+};
+
+#endif /* RENDER_FARM_H */
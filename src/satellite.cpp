@@ -0,0 +1,447 @@
+#include "satellite.h"
+
+#include <assert.h>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+void setSatelliteVertexFormat() {
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(SatelliteVertex),
+                        (void *)offsetof(SatelliteVertex, position));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+                        sizeof(SatelliteVertex),
+                        (void *)offsetof(SatelliteVertex, normal));
+  glEnableVertexAttribArray(2);
+  glVertexAttribIPointer(2, 1, GL_UNSIGNED_SHORT, sizeof(SatelliteVertex),
+                         (void *)offsetof(SatelliteVertex, material));
+}
+
+Mesh createSatelliteMesh() {
+  std::vector<SatelliteVertex> vertices;
+  std::vector<uint32_t> indices;
+  std::map<std::pair<uint64_t, uint32_t>, uint32_t> vertexLookup;
+
+  // Material and dish flag applied to the parts added below.
+  uint16_t material = kSatMatGold;
+  bool rotating = false;
+
+  auto addVertex = [&](const glm::vec3 &pos, const glm::vec3 &n) {
+    SatelliteVertex v;
+    v.position[0] = glm::packHalf1x16(pos.x);
+    v.position[1] = glm::packHalf1x16(pos.y);
+    v.position[2] = glm::packHalf1x16(pos.z);
+    v.material = material;
+    v.normal = glm::packSnorm3x10_1x2(glm::vec4(n, rotating ? 1.0f : 0.0f));
+
+    // Deduplicate on the packed bits, so corners shared by the two triangles
+    // of a quad (or by coplanar neighbours) are stored once.
+    uint64_t positionAndMaterial;
+    memcpy(&positionAndMaterial, &v, sizeof(positionAndMaterial));
+    auto [it, inserted] = vertexLookup.try_emplace(
+        {positionAndMaterial, v.normal}, (uint32_t)vertices.size());
+    if (inserted) {
+      vertices.push_back(v);
+    }
+    indices.push_back(it->second);
+  };
+
+  auto addFace = [&](const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+                     const glm::vec3 &d) {
+    glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
+    addVertex(a, n);
+    addVertex(b, n);
+    addVertex(c, n);
+    addVertex(a, n);
+    addVertex(c, n);
+    addVertex(d, n);
+  };
+
+  auto addTri = [&](const glm::vec3 &a, const glm::vec3 &b,
+                    const glm::vec3 &c) {
+    glm::vec3 n = glm::normalize(glm::cross(b - a, c - a));
+    addVertex(a, n);
+    addVertex(b, n);
+    addVertex(c, n);
+  };
+
+  auto addBox = [&](const glm::vec3 &center, const glm::vec3 &halfSize) {
+    glm::vec3 p000 = center + glm::vec3(-halfSize.x, -halfSize.y, -halfSize.z);
+    glm::vec3 p001 = center + glm::vec3(-halfSize.x, -halfSize.y, halfSize.z);
+    glm::vec3 p010 = center + glm::vec3(-halfSize.x, halfSize.y, -halfSize.z);
+    glm::vec3 p011 = center + glm::vec3(-halfSize.x, halfSize.y, halfSize.z);
+    glm::vec3 p100 = center + glm::vec3(halfSize.x, -halfSize.y, -halfSize.z);
+    glm::vec3 p101 = center + glm::vec3(halfSize.x, -halfSize.y, halfSize.z);
+    glm::vec3 p110 = center + glm::vec3(halfSize.x, halfSize.y, -halfSize.z);
+    glm::vec3 p111 = center + glm::vec3(halfSize.x, halfSize.y, halfSize.z);
+
+    // +X, -X, +Y, -Y, +Z, -Z faces
+    addFace(p100, p110, p111, p101);
+    addFace(p010, p000, p001, p011);
+    addFace(p110, p010, p011, p111);
+    addFace(p000, p100, p101, p001);
+    addFace(p101, p111, p011, p001);
+    addFace(p100, p000, p010, p110);
+  };
+
+  // Helper to add a cylinder along Y axis
+  auto addCylinder = [&](const glm::vec3 &base, float radius, float height,
+                         int segments) {
+    for (int i = 0; i < segments; i++) {
+      float a0 = 2.0f * 3.14159f * i / segments;
+      float a1 = 2.0f * 3.14159f * (i + 1) / segments;
+      glm::vec3 p0 = base + glm::vec3(cos(a0) * radius, 0, sin(a0) * radius);
+      glm::vec3 p1 = base + glm::vec3(cos(a1) * radius, 0, sin(a1) * radius);
+      glm::vec3 p2 = p1 + glm::vec3(0, height, 0);
+      glm::vec3 p3 = p0 + glm::vec3(0, height, 0);
+      addFace(p0, p1, p2, p3);
+      // Top cap
+      glm::vec3 topCenter = base + glm::vec3(0, height, 0);
+      addTri(topCenter, p3, p2);
+      // Bottom cap
+      addTri(base, p1, p0);
+    }
+  };
+
+  // Helper to add a cone along Y axis
+  auto addCone = [&](const glm::vec3 &base, float radius, float height,
+                     int segments) {
+    glm::vec3 tip = base + glm::vec3(0, height, 0);
+    for (int i = 0; i < segments; i++) {
+      float a0 = 2.0f * 3.14159f * i / segments;
+      float a1 = 2.0f * 3.14159f * (i + 1) / segments;
+      glm::vec3 p0 = base + glm::vec3(cos(a0) * radius, 0, sin(a0) * radius);
+      glm::vec3 p1 = base + glm::vec3(cos(a1) * radius, 0, sin(a1) * radius);
+      addTri(p0, p1, tip);
+      addTri(base, p1, p0);
+    }
+  };
+
+  // ========== MAIN BODY ==========
+  // Central octagonal body (more interesting than a box)
+  material = kSatMatGold;
+  float bodyRadius = 0.32f;
+  float bodyHeight = 0.5f;
+  int bodySides = 8;
+  glm::vec3 bodyBase = glm::vec3(0, -bodyHeight / 2, 0);
+  for (int i = 0; i < bodySides; i++) {
+    float a0 = 2.0f * 3.14159f * i / bodySides;
+    float a1 = 2.0f * 3.14159f * (i + 1) / bodySides;
+    glm::vec3 p0 =
+        bodyBase + glm::vec3(cos(a0) * bodyRadius, 0, sin(a0) * bodyRadius);
+    glm::vec3 p1 =
+        bodyBase + glm::vec3(cos(a1) * bodyRadius, 0, sin(a1) * bodyRadius);
+    glm::vec3 p2 = p1 + glm::vec3(0, bodyHeight, 0);
+    glm::vec3 p3 = p0 + glm::vec3(0, bodyHeight, 0);
+    addFace(p0, p1, p2, p3);
+    // Top cap
+    glm::vec3 topCenter = glm::vec3(0, bodyHeight / 2, 0);
+    addTri(topCenter, p3, p2);
+    // Bottom cap
+    glm::vec3 bottomCenter = glm::vec3(0, -bodyHeight / 2, 0);
+    addTri(bottomCenter, p1, p0);
+  }
+
+  // ========== SOLAR PANEL ARMS ==========
+  // Connection arms from body to panels
+  addBox(glm::vec3(-0.5f, 0.0f, 0.0f), glm::vec3(0.18f, 0.04f, 0.04f));
+  addBox(glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.18f, 0.04f, 0.04f));
+
+  // ========== SOLAR PANELS (segmented for realism) ==========
+  float panelWidth = 0.75f;
+  float panelHeight = 0.45f;
+  for (float side : {-1.0f, 1.0f}) {
+    float panelX = 1.15f * side;
+    // Main frame
+    material = kSatMatPanel;
+    addBox(glm::vec3(panelX, 0.0f, 0.0f),
+           glm::vec3(panelWidth, 0.02f, panelHeight));
+    // Panel frame edges
+    material = kSatMatPanelFrame;
+    addBox(glm::vec3(panelX, 0.025f, panelHeight - 0.02f),
+           glm::vec3(panelWidth, 0.015f, 0.02f));
+    addBox(glm::vec3(panelX, 0.025f, -panelHeight + 0.02f),
+           glm::vec3(panelWidth, 0.015f, 0.02f));
+    addBox(glm::vec3(panelX - side * (panelWidth - 0.02f), 0.025f, 0.0f),
+           glm::vec3(0.02f, 0.015f, panelHeight - 0.02f));
+    // Panel grid lines
+    for (int i = 1; i < 4; i++) {
+      float offset = panelX - panelWidth + (2.0f * panelWidth * i / 4.0f);
+      addBox(glm::vec3(offset, 0.022f, 0.0f),
+             glm::vec3(0.008f, 0.008f, panelHeight - 0.03f));
+    }
+    // Outer edge carries the strobe light
+    material = kSatMatPanelTip;
+    addBox(glm::vec3(panelX + side * (panelWidth - 0.02f), 0.025f, 0.0f),
+           glm::vec3(0.02f, 0.015f, panelHeight - 0.02f));
+  }
+
+  // ========== ANTENNA DISH ==========
+  // Everything above the body rotates with the dish.
+  rotating = true;
+  material = kSatMatAntenna;
+  // Dish base/mount on top
+  addCylinder(glm::vec3(0, 0.25f, 0), 0.08f, 0.06f, 12);
+  // Dish arm
+  addBox(glm::vec3(0, 0.38f, 0.12f), glm::vec3(0.02f, 0.08f, 0.02f));
+  // Simplified dish (cone shape)
+  addCone(glm::vec3(0, 0.32f, 0.22f), 0.12f, 0.08f, 12);
+
+  // ========== COMMUNICATION ANTENNAS ==========
+  // Small antenna masts
+  addCylinder(glm::vec3(0.15f, 0.25f, -0.15f), 0.015f, 0.25f, 6);
+  addCylinder(glm::vec3(-0.15f, 0.25f, 0.15f), 0.015f, 0.2f, 6);
+  // Antenna tips
+  material = kSatMatBeacon;
+  addBox(glm::vec3(0.15f, 0.52f, -0.15f), glm::vec3(0.025f, 0.025f, 0.025f));
+  addBox(glm::vec3(-0.15f, 0.47f, 0.15f), glm::vec3(0.02f, 0.02f, 0.02f));
+  rotating = false;
+
+  // ========== THRUSTERS ==========
+  // Bottom thrusters (4 corner nozzles)
+  material = kSatMatThruster;
+  float thrusterOffset = 0.2f;
+  addCone(glm::vec3(thrusterOffset, -0.25f, thrusterOffset), 0.04f, -0.08f, 8);
+  addCone(glm::vec3(-thrusterOffset, -0.25f, thrusterOffset), 0.04f, -0.08f, 8);
+  addCone(glm::vec3(thrusterOffset, -0.25f, -thrusterOffset), 0.04f, -0.08f, 8);
+  addCone(glm::vec3(-thrusterOffset, -0.25f, -thrusterOffset), 0.04f, -0.08f,
+          8);
+
+  // ========== SENSOR EQUIPMENT ==========
+  // Front sensor package
+  material = kSatMatSensor;
+  addBox(glm::vec3(0, 0, 0.38f), glm::vec3(0.12f, 0.1f, 0.06f));
+  material = kSatMatSensorLens;
+  addCylinder(glm::vec3(0.06f, -0.02f, 0.44f), 0.025f, 0.04f, 8);
+  addCylinder(glm::vec3(-0.06f, -0.02f, 0.44f), 0.025f, 0.04f, 8);
+
+  // ========== DECORATIVE DETAILS ==========
+  // Body accent strips, with warning lights on the body corners
+  material = kSatMatWarningLight;
+  for (int i = 0; i < 4; i++) {
+    float angle = 3.14159f / 4.0f + i * 3.14159f / 2.0f;
+    glm::vec3 stripPos = glm::vec3(cos(angle) * 0.33f, 0, sin(angle) * 0.33f);
+    addBox(stripPos, glm::vec3(0.015f, 0.26f, 0.015f));
+  }
+
+  // Reorder triangles for the post-transform cache, then vertices in order of
+  // first use for linear vertex fetches.
+  optimizeVertexCache(indices, vertices.size());
+  std::vector<uint32_t> remap = optimizeVertexFetch(indices, vertices.size());
+  std::vector<SatelliteVertex> orderedVertices(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    orderedVertices[remap[i]] = vertices[i];
+  }
+
+  assert(orderedVertices.size() <= 65536);
+  std::vector<uint16_t> indices16(indices.begin(), indices.end());
+
+  GLuint vao, vbo, ebo;
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ebo);
+
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER,
+               orderedVertices.size() * sizeof(SatelliteVertex),
+               orderedVertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices16.size() * sizeof(uint16_t),
+               indices16.data(), GL_STATIC_DRAW);
+
+  setSatelliteVertexFormat();
+
+  glBindVertexArray(0);
+
+  Mesh mesh;
+  mesh.vao = vao;
+  mesh.vertexBuffer = vbo;
+  mesh.indexBuffer = ebo;
+  mesh.vertexCount = (GLsizei)orderedVertices.size();
+  mesh.indexCount = (GLsizei)indices16.size();
+  mesh.indexType = GL_UNSIGNED_SHORT;
+  return mesh;
+}
+
+SatelliteState evaluateSatelliteOrbit(const SatelliteOrbitParams &params,
+                                      double timeSeconds) {
+  const glm::vec4 &orbit = params.orbit;
+  const glm::vec4 &oscillation = params.oscillation;
+  float t = (float)timeSeconds;
+
+  // 椭圆轨道半径 r = a(1-e²) / (1 + e*cos(θ))
+  float e = orbit.y;
+  float angle = t * orbit.w + oscillation.z;
+  float cosA = cos(angle);
+  float sinA = sin(angle);
+  float p = orbit.x * (1.0f - e * e);
+  float denom = 1.0f + e * cosA;
+  float r = p / denom;
+  float drdA = p * e * sinA / (denom * denom);
+
+  // 基础椭圆位置及其对时间的导数
+  glm::vec2 planar = r * glm::vec2(cosA, sinA);
+  glm::vec2 dPlanar =
+      (drdA * glm::vec2(cosA, sinA) + r * glm::vec2(-sinA, cosA)) * orbit.w;
+
+  // 添加轨道倾角和垂直振荡
+  float sinI = sin(orbit.z);
+  float cosI = cos(orbit.z);
+  float vt = t * oscillation.y + oscillation.z;
+  glm::vec3 pos(planar.x, planar.y * sinI + oscillation.x * sin(vt),
+                planar.y * cosI);
+  glm::vec3 vel(dPlanar.x,
+                dPlanar.y * sinI + oscillation.x * oscillation.y * cos(vt),
+                dPlanar.y * cosI);
+
+  // Rotate the orbital plane around the y axis by the node longitude.
+  float cosN = cos(oscillation.w);
+  float sinN = sin(oscillation.w);
+  glm::mat3 node(cosN, 0.0f, -sinN, 0.0f, 1.0f, 0.0f, sinN, 0.0f, cosN);
+
+  SatelliteState state;
+  state.position = node * pos;
+  state.velocity = node * vel;
+  return state;
+}
+
+SatelliteState computeSatelliteOrbit(double timeSeconds) {
+  // 椭圆轨道参数
+  const float semiMajorAxis = 5.5f;       // 半长轴
+  const float eccentricity = 0.3f;        // 离心率
+  const float inclination = 15.0f;        // 轨道倾角（度）
+  const float orbitSpeed = 0.15f;         // 轨道角速度
+  const float verticalOscillation = 0.8f; // 垂直振荡幅度
+  const float verticalFreq = 0.4f;        // 垂直振荡频率
+
+  SatelliteOrbitParams params;
+  params.orbit = glm::vec4(semiMajorAxis, eccentricity,
+                           glm::radians(inclination), orbitSpeed);
+  params.oscillation =
+      glm::vec4(verticalOscillation, verticalFreq, 0.0f, 0.0f);
+  params.attitude = glm::vec4(0.0f);
+
+  // 速度方向用于卫星朝向
+  SatelliteState state = evaluateSatelliteOrbit(params, timeSeconds);
+  state.velocity = glm::normalize(state.velocity);
+  return state;
+}
+
+glm::mat4 computeSatelliteModel(double timeSeconds, const glm::vec3 &worldPos,
+                                const glm::vec3 &velocity) {
+  const float selfSpinSpeed = 1.2f; // 自转速度
+  const float wobbleAmount = 5.0f;  // 轻微摇摆幅度（度）
+  const float wobbleSpeed = 2.0f;
+
+  glm::mat4 model = glm::translate(glm::mat4(1.0f), worldPos);
+
+  // 计算卫星朝向运动方向的旋转
+  glm::vec3 forward = velocity;
+  glm::vec3 worldUp = glm::vec3(0.0f, 1.0f, 0.0f);
+  glm::vec3 right = glm::normalize(glm::cross(worldUp, forward));
+  glm::vec3 up = glm::cross(forward, right);
+
+  // 构建朝向矩阵
+  glm::mat4 orientation = glm::mat4(1.0f);
+  orientation[0] = glm::vec4(right, 0.0f);
+  orientation[1] = glm::vec4(up, 0.0f);
+  orientation[2] = glm::vec4(forward, 0.0f);
+
+  model = model * orientation;
+
+  // 添加轻微摇摆
+  float wobble = wobbleAmount * sin((float)timeSeconds * wobbleSpeed);
+  model = glm::rotate(model, glm::radians(wobble), glm::vec3(1.0f, 0.0f, 0.0f));
+  model = glm::rotate(model, glm::radians(wobble * 0.7f),
+                      glm::vec3(0.0f, 0.0f, 1.0f));
+
+  // 太阳能板自转（绕自身Y轴）
+  model = glm::rotate(model, (float)(timeSeconds * selfSpinSpeed),
+                      glm::vec3(0.0f, 1.0f, 0.0f));
+
+  model = glm::scale(model, glm::vec3(0.18f));
+  return model;
+}
+
+
+
+void computeSatelliteEmission(float time, glm::vec3 emission[kSatMatCount]) {
+  for (int i = 0; i < kSatMatCount; i++) {
+    emission[i] = glm::vec3(0.0f);
+  }
+  // Blue beacon light on antenna tips (fast blink)
+  float blueBlink =
+      glm::smoothstep(0.4f, 0.6f, sinf(time * 6.0f) * 0.5f + 0.5f);
+  emission[kSatMatBeacon] = glm::vec3(0.3f, 0.7f, 1.0f) * 3.0f * blueBlink;
+  // Red warning light on body corners (slow pulse)
+  float redPulse = glm::smoothstep(0.3f, 0.7f, sinf(time * 2.0f) * 0.5f + 0.5f);
+  emission[kSatMatWarningLight] =
+      glm::vec3(1.0f, 0.1f, 0.05f) * 2.5f * redPulse;
+  // Green status light on sensor package (steady with occasional flicker)
+  float greenFlicker =
+      0.7f + 0.3f * sinf(time * 15.0f + sinf(time * 3.0f) * 5.0f);
+  emission[kSatMatSensorLens] =
+      glm::vec3(0.1f, 1.0f, 0.3f) * 1.5f * greenFlicker;
+  // White strobe on solar panel tips (very fast strobe)
+  float strobe = time * 4.0f - floorf(time * 4.0f) >= 0.9f ? 1.0f : 0.0f;
+  emission[kSatMatPanelTip] = glm::vec3(1.0f, 1.0f, 1.0f) * 4.0f * strobe;
+  // Thruster glow (orange pulsing when active)
+  float thrusterGlow = 0.3f + 0.7f * (sinf(time * 8.0f) * 0.5f + 0.5f);
+  emission[kSatMatThruster] =
+      glm::vec3(1.0f, 0.5f, 0.1f) * 2.0f * thrusterGlow;
+}
+
+void renderSatellite(const Mesh &mesh, GLuint program, const glm::mat4 &model,
+                     const glm::mat4 &view, const glm::mat4 &projection,
+                     const glm::vec3 &cameraPos, const glm::vec3 &lightDir,
+                     GLuint galaxyCubemap, float dishAngle, float time) {
+  glUseProgram(program);
+
+  glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE,
+                     glm::value_ptr(model));
+  glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE,
+                     glm::value_ptr(view));
+  glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE,
+                     glm::value_ptr(projection));
+
+  // Normal matrix once per draw instead of once per vertex.
+  glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+  glUniformMatrix3fv(glGetUniformLocation(program, "normalMatrix"), 1,
+                     GL_FALSE, glm::value_ptr(normalMatrix));
+
+  glUniform3fv(glGetUniformLocation(program, "viewPos"), 1,
+               glm::value_ptr(cameraPos));
+  glUniform3fv(glGetUniformLocation(program, "lightDir"), 1,
+               glm::value_ptr(lightDir));
+  glUniform3f(glGetUniformLocation(program, "lightColor"), 1.0f, 0.95f, 0.85f);
+  glUniform3f(glGetUniformLocation(program, "rimColor"), 1.4f, 1.2f, 0.95f);
+  glUniform1f(glGetUniformLocation(program, "rimStrength"), 1.35f);
+
+  // Animated indicator lights only depend on time, so their emission is
+  // evaluated here once per material instead of per fragment.
+  glm::vec3 emission[kSatMatCount];
+  computeSatelliteEmission(time, emission);
+  glUniform3fv(glGetUniformLocation(program, "emission"), kSatMatCount,
+               glm::value_ptr(emission[0]));
+
+  glUniform1f(glGetUniformLocation(program, "dishRotation"), dishAngle);
+
+  // Bind Cubemap
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, galaxyCubemap);
+  glUniform1i(glGetUniformLocation(program, "galaxy"), 0);
+
+  glBindVertexArray(mesh.vao);
+  glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void *)0);
+  glBindVertexArray(0);
+
+  glUseProgram(0);
+}
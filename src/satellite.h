@@ -0,0 +1,77 @@
+
+
+#ifndef SATELLITE_H
+#define SATELLITE_H
+
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+// Per-vertex material IDs, indexing the material table in satellite.frag.
+enum SatelliteMaterial {
+  kSatMatGold = 0,
+  kSatMatPanel,
+  kSatMatPanelFrame,
+  kSatMatAntenna,
+  kSatMatThruster,
+  kSatMatSensor,
+  kSatMatBeacon,
+  kSatMatWarningLight,
+  kSatMatSensorLens,
+  kSatMatPanelTip,
+  kSatMatCount
+};
+
+// Packed satellite vertex: half-float position, material ID and a 10:10:10:2
+// normal whose 2-bit field flags the parts of the rotating dish assembly.
+struct SatelliteVertex {
+  uint16_t position[3];
+  uint16_t material;
+  uint32_t normal;
+};
+static_assert(sizeof(SatelliteVertex) == 12, "unexpected vertex padding");
+
+// 计算卫星在椭圆轨道上的位置和朝向
+struct SatelliteState {
+  glm::vec3 position;
+  glm::vec3 velocity; // 用于计算朝向
+};
+
+// Sets up vertex attributes 0-2 of the bound vertex array for the
+// SatelliteVertex layout, reading from the bound GL_ARRAY_BUFFER.
+void setSatelliteVertexFormat();
+
+// Orbit parameters of one satellite, also evaluated on the GPU by
+// shader/satellite_orbit.glsl for the fleet. Angles are in radians.
+struct SatelliteOrbitParams {
+  glm::vec4 orbit;       // semi-major axis, eccentricity, inclination, speed
+  glm::vec4 oscillation; // vertical amplitude, frequency, phase, node longitude
+  glm::vec4 attitude;    // self-spin speed, wobble, wobble speed, scale
+};
+static_assert(sizeof(SatelliteOrbitParams) == 48, "must match std430 layout");
+
+Mesh createSatelliteMesh();
+
+// Position and analytic velocity on the orbit at the given time.
+SatelliteState evaluateSatelliteOrbit(const SatelliteOrbitParams &params,
+                                      double timeSeconds);
+
+// The hero satellite; its velocity is normalized.
+SatelliteState computeSatelliteOrbit(double timeSeconds);
+
+glm::mat4 computeSatelliteModel(double timeSeconds, const glm::vec3 &worldPos,
+                                const glm::vec3 &velocity);
+
+// Emission of the animated indicator lights for each material at the given
+// time, uploaded to the "emission" uniform array of satellite.frag.
+void computeSatelliteEmission(float time, glm::vec3 emission[kSatMatCount]);
+
+void renderSatellite(const Mesh &mesh, GLuint program, const glm::mat4 &model,
+                     const glm::mat4 &view, const glm::mat4 &projection,
+                     const glm::vec3 &cameraPos, const glm::vec3 &lightDir,
+                     GLuint galaxyCubemap, float dishAngle, float time);
+
+#endif /* SATELLITE_H */
@@ -1,13 +1,20 @@
 #include "shader.h"
 
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <GL/glew.h>
+#include <GLFW/glfw3.h>
 
 static std::string readFile(const std::string &file) {
   std::ifstream ifs(file, std::ios::in);
@@ -20,8 +27,38 @@ static std::string readFile(const std::string &file) {
   }
 }
 
-static GLuint compileShader(const std::string &shaderSource,
-                            GLenum shaderType) {
+// Reads a shader file and expands `#include "file"` lines, resolved relative
+// to the including file, so that GLSL snippets can be shared across programs.
+static std::string readShaderSource(const std::string &file) {
+  std::string dir;
+  size_t slash = file.find_last_of('/');
+  if (slash != std::string::npos) {
+    dir = file.substr(0, slash + 1);
+  }
+
+  std::istringstream in(readFile(file));
+  std::stringstream out;
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t pos = line.find_first_not_of(" \t");
+    if (pos != std::string::npos && line.compare(pos, 8, "#include") == 0) {
+      size_t open = line.find('"', pos);
+      size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+      if (close == std::string::npos) {
+        throw std::runtime_error("Malformed #include in " + file + ": " + line);
+      }
+      out << readShaderSource(dir + line.substr(open + 1, close - open - 1));
+    } else {
+      out << line << "\n";
+    }
+  }
+  return out.str();
+}
+
+// Creates a shader and starts compiling it. Drivers with
+// KHR_parallel_shader_compile return at once; the status is checked later by
+// checkShader(), which waits for the result.
+static GLuint startShader(const std::string &shaderSource, GLenum shaderType) {
   // Create shader
   GLuint shader = glCreateShader(shaderType);
 
@@ -30,6 +67,11 @@ static GLuint compileShader(const std::string &shaderSource,
   glShaderSource(shader, 1, &pShaderSource, nullptr);
   glCompileShader(shader);
 
+  return shader;
+}
+
+// Returns the info log of a failed compile, or an empty string on success.
+static std::string checkShader(GLuint shader) {
   GLint success = GL_FALSE;
   glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
   if (success == GL_FALSE) {
@@ -41,33 +83,28 @@ static GLuint compileShader(const std::string &shaderSource,
     std::vector<GLchar> infoLog(maxLength > 1 ? maxLength : 1);
     glGetShaderInfoLog(shader, maxLength, &maxLength, infoLog.data());
     std::string log(infoLog.data(), infoLog.data() + maxLength);
-    std::cerr << "Shader compile error: " << log << std::endl;
-    glDeleteShader(shader);
-    throw std::runtime_error("Failed to compile shader: " + log);
+    return log.empty() ? "(no log)" : log;
   }
-
-  return shader;
+  return "";
 }
 
-GLuint createShaderProgram(const std::string &vertexShaderFile,
-                           const std::string &fragmentShaderFile) {
-
-  // Compile vertex and fragment shaders.
-  std::cout << "Compiling vertex shader: " << vertexShaderFile << std::endl;
-  GLuint vertexShader =
-      compileShader(readFile(vertexShaderFile), GL_VERTEX_SHADER);
-
-  std::cout << "Compiling fragment shader: " << fragmentShaderFile << std::endl;
-  GLuint fragmentShader =
-      compileShader(readFile(fragmentShaderFile), GL_FRAGMENT_SHADER);
-
+static GLuint startLink(const std::vector<GLuint> &shaders, bool retrievable) {
   // Create shader program.
   GLuint program = glCreateProgram();
-  glAttachShader(program, vertexShader);
-  glAttachShader(program, fragmentShader);
+  for (GLuint shader : shaders) {
+    glAttachShader(program, shader);
+  }
+  if (retrievable) {
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
 
   // Link the program.
   glLinkProgram(program);
+  return program;
+}
+
+// Returns the info log of a failed link, or an empty string on success.
+static std::string checkProgram(GLuint program) {
   GLint isLinked = GL_FALSE;
   glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
   if (isLinked == GL_FALSE) {
@@ -76,17 +113,613 @@ GLuint createShaderProgram(const std::string &vertexShaderFile,
     std::vector<GLchar> infoLog(maxLength > 1 ? maxLength : 1);
     glGetProgramInfoLog(program, maxLength, NULL, infoLog.data());
     std::string log(infoLog.data(), infoLog.data() + maxLength);
-    std::cerr << "Shader link error: " << log << std::endl;
-    glDeleteProgram(program);
-    throw std::runtime_error("Failed to link shader program: " + log);
+    return log.empty() ? "(no log)" : log;
+  }
+  return "";
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ShaderStage {
+  GLenum type;
+  std::string file;
+  std::string source; // with includes expanded
+};
+
+// Header of a cached program binary, followed by the driver's blob.
+struct ProgramBinaryHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t binaryFormat;
+  uint32_t size;
+  float compileMs; // what compiling from source took
+  uint32_t reserved;
+};
+static_assert(sizeof(ProgramBinaryHeader) == 32,
+              "ProgramBinaryHeader is written as is");
+
+const char kProgramBinaryMagic[4] = {'B', 'H', 'P', 'B'};
+const uint32_t kProgramBinaryVersion = 1;
+
+std::string cacheDirectory = "shader_cache";
+ShaderCacheStats cacheStats;
+
+double millisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+const char *stageName(GLenum type) {
+  switch (type) {
+  case GL_VERTEX_SHADER:
+    return "vertex";
+  case GL_FRAGMENT_SHADER:
+    return "fragment";
+  case GL_COMPUTE_SHADER:
+    return "compute";
+  default:
+    return "unknown";
+  }
+}
+
+bool programBinarySupported() {
+  static int supported = -1;
+  if (supported < 0) {
+    // Some drivers expose the entry points but no format to store.
+    GLint formatCount = 0;
+    if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    }
+    supported = formatCount > 0 ? 1 : 0;
+  }
+  return supported == 1;
+}
+
+// 64-bit FNV-1a.
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+uint64_t hashString(uint64_t hash, const std::string &value) {
+  uint64_t size = value.size();
+  hash = hashBytes(hash, &size, sizeof(size));
+  return hashBytes(hash, value.data(), value.size());
+}
+
+// A binary is only valid for the exact driver that produced it, so the key
+// covers the driver as well as the sources.
+uint64_t programKey(const std::vector<ShaderStage> &stages) {
+  uint64_t hash = 14695981039346656037ull;
+  hash = hashBytes(hash, &kProgramBinaryVersion, sizeof(kProgramBinaryVersion));
+  for (GLenum name :
+       {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+    const GLubyte *value = glGetString(name);
+    hash = hashString(hash, value ? (const char *)value : "");
+  }
+  for (const ShaderStage &stage : stages) {
+    uint32_t type = stage.type;
+    hash = hashBytes(hash, &type, sizeof(type));
+    hash = hashString(hash, stage.source);
+  }
+  return hash;
+}
+
+// Entries are named after the program's stage files, so that the one a new
+// binary replaces (from before the sources changed) can be found and removed.
+std::string cacheEntryPrefix(const std::vector<ShaderStage> &stages) {
+  std::string prefix;
+  for (const ShaderStage &stage : stages) {
+    if (!prefix.empty()) {
+      prefix += '+';
+    }
+    prefix += std::filesystem::path(stage.file).filename().string();
   }
+  return prefix + "-";
+}
 
-  // Detach shaders after a successful link.
-  glDetachShader(program, vertexShader);
-  glDetachShader(program, fragmentShader);
+std::string cachePath(const std::vector<ShaderStage> &stages, uint64_t key) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+  return cacheDirectory + "/" + cacheEntryPrefix(stages) + name;
+}
+
+// Removes the entries of the program other than the one at path.
+void removeStaleProgramBinaries(const std::string &path,
+                                const std::string &prefix) {
+  std::error_code ec;
+  std::string keep = std::filesystem::path(path).filename().string();
+  std::vector<std::filesystem::path> stale;
+  for (std::filesystem::directory_iterator it(cacheDirectory, ec), end;
+       !ec && it != end; it.increment(ec)) {
+    std::string name = it->path().filename().string();
+    if (name != keep && name.size() == prefix.size() + 20 &&
+        name.compare(0, prefix.size(), prefix) == 0 &&
+        name.compare(name.size() - 4, 4, ".bin") == 0) {
+      stale.push_back(it->path());
+    }
+  }
+  for (const std::filesystem::path &entry : stale) {
+    std::filesystem::remove(entry, ec);
+  }
+}
 
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
+// Returns 0 if there is no usable entry; rejected is set if there was one but
+// the driver refused it (after a driver update with an unchanged version
+// string, for example).
+GLuint loadProgramBinary(const std::string &path, uint64_t key,
+                         float &compileMs, bool &rejected) {
+  std::ifstream ifs(path, std::ios::in | std::ios::binary);
+  if (!ifs.is_open()) {
+    return 0;
+  }
+  ProgramBinaryHeader header;
+  if (!ifs.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      memcmp(header.magic, kProgramBinaryMagic, 4) != 0 ||
+      header.version != kProgramBinaryVersion || header.key != key) {
+    return 0;
+  }
+  std::vector<char> binary(header.size);
+  if (!ifs.read(binary.data(), binary.size())) {
+    return 0;
+  }
 
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header.binaryFormat, binary.data(),
+                  (GLsizei)binary.size());
+  GLint isLinked = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+  if (isLinked == GL_FALSE) {
+    glDeleteProgram(program);
+    rejected = true;
+    return 0;
+  }
+  compileMs = header.compileMs;
   return program;
 }
+
+void saveProgramBinary(GLuint program, const std::string &path,
+                       const std::string &prefix, uint64_t key,
+                       double compileMs) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  std::vector<char> binary(length);
+  GLenum binaryFormat = 0;
+  glGetProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+  ProgramBinaryHeader header = {};
+  memcpy(header.magic, kProgramBinaryMagic, 4);
+  header.version = kProgramBinaryVersion;
+  header.key = key;
+  header.binaryFormat = binaryFormat;
+  header.size = (uint32_t)length;
+  header.compileMs = (float)compileMs;
+
+  // Written aside and renamed, so that a crash or a second instance never
+  // leaves a truncated entry behind.
+  std::error_code ec;
+  std::filesystem::create_directories(cacheDirectory, ec);
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream ofs(tmpPath, std::ios::out | std::ios::binary);
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(binary.data(), length);
+    if (!ofs) {
+      std::cout << "WARNING: Failed to write program binary: " << tmpPath
+                << std::endl;
+      return;
+    }
+  }
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec) {
+    std::cout << "WARNING: Failed to write program binary: " << path
+              << std::endl;
+    std::filesystem::remove(tmpPath, ec);
+    return;
+  }
+  removeStaleProgramBinaries(path, prefix);
+}
+
+// A program on its way from source to a linked program object.
+struct PendingProgram {
+  std::vector<ShaderStage> stages;
+  bool cacheable = false;
+  uint64_t key = 0;
+  std::string path;
+  std::vector<GLuint> shaders;
+  GLuint program = 0;
+  Clock::time_point start;
+  double issueMs = 0.0;    // spent in the compile and link calls
+  double compileMs = -1.0; // set by whoever saw the driver finish
+};
+
+PendingProgram makePendingProgram(std::vector<ShaderStage> stages) {
+  PendingProgram pending;
+  pending.stages = std::move(stages);
+  pending.cacheable = !cacheDirectory.empty() && programBinarySupported();
+  if (pending.cacheable) {
+    pending.key = programKey(pending.stages);
+    pending.path = cachePath(pending.stages, pending.key);
+  }
+  return pending;
+}
+
+const std::string &programName(const PendingProgram &pending) {
+  return pending.stages.back().file;
+}
+
+// Returns the program from the binary cache, or 0 if it has to be compiled.
+GLuint loadCachedProgram(const PendingProgram &pending) {
+  if (!pending.cacheable) {
+    return 0;
+  }
+  Clock::time_point start = Clock::now();
+  float cachedCompileMs = 0.0f;
+  bool rejected = false;
+  GLuint program =
+      loadProgramBinary(pending.path, pending.key, cachedCompileMs, rejected);
+  if (program != 0) {
+    double loadMs = millisecondsSince(start);
+    cacheStats.hits++;
+    cacheStats.loadMs += loadMs;
+    cacheStats.savedMs += cachedCompileMs - loadMs;
+    printf("Loaded program binary: %s (%.1f ms, compiling took %.1f ms)\n",
+           programName(pending).c_str(), loadMs, cachedCompileMs);
+    return program;
+  }
+  if (rejected) {
+    cacheStats.rejected++;
+    printf("WARNING: Cached program binary of %s was rejected, compiling "
+           "from source\n",
+           programName(pending).c_str());
+  }
+  return 0;
+}
+
+void logCompile(const PendingProgram &pending) {
+  for (const ShaderStage &stage : pending.stages) {
+    std::cout << "Compiling " << stageName(stage.type)
+              << " shader: " << stage.file << std::endl;
+  }
+}
+
+// Issues the compiles and the link without waiting for any of them.
+void startProgram(PendingProgram &pending) {
+  pending.start = Clock::now();
+  for (const ShaderStage &stage : pending.stages) {
+    pending.shaders.push_back(startShader(stage.source, stage.type));
+  }
+  pending.program = startLink(pending.shaders, pending.cacheable);
+  pending.issueMs = millisecondsSince(pending.start);
+}
+
+// Waits for the driver, then checks the result and caches the binary. Throws
+// if a stage failed to compile or the program failed to link.
+GLuint finishProgram(PendingProgram &pending) {
+  Clock::time_point waitStart = Clock::now();
+  std::string compileLog;
+  for (GLuint shader : pending.shaders) {
+    compileLog += checkShader(shader);
+  }
+  std::string linkLog = compileLog.empty() ? checkProgram(pending.program) : "";
+  if (pending.compileMs < 0.0) {
+    pending.compileMs = pending.issueMs + millisecondsSince(waitStart);
+  }
+
+  // Detach shaders once the program is linked.
+  for (GLuint shader : pending.shaders) {
+    glDetachShader(pending.program, shader);
+    glDeleteShader(shader);
+  }
+  pending.shaders.clear();
+
+  if (!compileLog.empty()) {
+    std::cerr << "Shader compile error: " << compileLog << std::endl;
+    glDeleteProgram(pending.program);
+    throw std::runtime_error("Failed to compile shader: " + compileLog);
+  }
+  if (!linkLog.empty()) {
+    std::cerr << "Shader link error: " << linkLog << std::endl;
+    glDeleteProgram(pending.program);
+    throw std::runtime_error("Failed to link shader program: " + linkLog);
+  }
+
+  cacheStats.misses++;
+  cacheStats.compileMs += pending.compileMs;
+  if (pending.cacheable) {
+    saveProgramBinary(pending.program, pending.path,
+                      cacheEntryPrefix(pending.stages), pending.key,
+                      pending.compileMs);
+  }
+  return pending.program;
+}
+
+std::string programKeyName(const std::string &firstFile,
+                           const std::string &secondFile) {
+  return firstFile + "\n" + secondFile;
+}
+
+ShaderManager *activeManager = nullptr;
+
+GLuint buildProgram(std::vector<ShaderStage> stages) {
+  std::string name = programKeyName(
+      stages.front().file, stages.size() > 1 ? stages.back().file : "");
+  if (activeManager) {
+    GLuint program = activeManager->take(name);
+    if (program != 0) {
+      return program;
+    }
+  }
+
+  PendingProgram pending = makePendingProgram(std::move(stages));
+  GLuint program = loadCachedProgram(pending);
+  if (program != 0) {
+    return program;
+  }
+  if (activeManager && activeManager->warmedUp()) {
+    printf("WARNING: %s is compiled while rendering; submit it to the "
+           "ShaderManager at startup\n",
+           programName(pending).c_str());
+  }
+  logCompile(pending);
+  startProgram(pending);
+  return finishProgram(pending);
+}
+
+} // namespace
+
+GLuint createShaderProgram(const std::string &vertexShaderFile,
+                           const std::string &fragmentShaderFile) {
+  return buildProgram(
+      {{GL_VERTEX_SHADER, vertexShaderFile, readShaderSource(vertexShaderFile)},
+       {GL_FRAGMENT_SHADER, fragmentShaderFile,
+        readShaderSource(fragmentShaderFile)}});
+}
+
+GLuint createComputeProgram(const std::string &computeShaderFile) {
+  return buildProgram({{GL_COMPUTE_SHADER, computeShaderFile,
+                        readShaderSource(computeShaderFile)}});
+}
+
+void setShaderCacheDirectory(const std::string &dir) { cacheDirectory = dir; }
+
+const ShaderCacheStats &shaderCacheStats() { return cacheStats; }
+
+struct ShaderManager::Job {
+  PendingProgram pending;
+  bool compiled = false; // by a worker; guarded by the mutex
+  bool finished = false;
+  GLuint program = 0;
+  std::string error; // what finishing threw
+};
+
+ShaderManager::ShaderManager(GLFWwindow *window,
+                             const ShaderManagerCreateInfo &info)
+    : created(Clock::now()) {
+  if (GLEW_KHR_parallel_shader_compile) {
+    mode = Mode::Driver;
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // as many as the driver likes
+  } else if (GLEW_ARB_parallel_shader_compile) {
+    mode = Mode::Driver;
+    glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+  } else if (info.workerContexts > 0) {
+    // Hidden windows only for their contexts, which share program and shader
+    // objects with the window's. GLFW needs them created on this thread.
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    for (int i = 0; i < info.workerContexts; ++i) {
+      GLFWwindow *context =
+          glfwCreateWindow(1, 1, "shader compiler", nullptr, window);
+      if (context == nullptr) {
+        break;
+      }
+      contexts.push_back(context);
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!contexts.empty()) {
+      mode = Mode::Workers;
+      for (GLFWwindow *context : contexts) {
+        workers.emplace_back(&ShaderManager::workerLoop, this, context);
+      }
+    }
+  }
+  activeManager = this;
+}
+
+ShaderManager::~ShaderManager() { shutdown(); }
+
+void ShaderManager::submit(const std::string &vertexShaderFile,
+                           const std::string &fragmentShaderFile) {
+  std::string name = programKeyName(vertexShaderFile, fragmentShaderFile);
+  if (jobs.count(name)) {
+    return;
+  }
+  auto job = std::make_shared<Job>();
+  job->pending = makePendingProgram(
+      {{GL_VERTEX_SHADER, vertexShaderFile, readShaderSource(vertexShaderFile)},
+       {GL_FRAGMENT_SHADER, fragmentShaderFile,
+        readShaderSource(fragmentShaderFile)}});
+  start(name, job);
+}
+
+void ShaderManager::submitCompute(const std::string &computeShaderFile) {
+  std::string name = programKeyName(computeShaderFile, "");
+  if (jobs.count(name)) {
+    return;
+  }
+  auto job = std::make_shared<Job>();
+  job->pending = makePendingProgram({{GL_COMPUTE_SHADER, computeShaderFile,
+                                      readShaderSource(computeShaderFile)}});
+  start(name, job);
+}
+
+void ShaderManager::start(const std::string &name,
+                          const std::shared_ptr<Job> &job) {
+  jobs[name] = job;
+  submitted++;
+
+  // Cache hits are cheap enough to load right here.
+  job->program = loadCachedProgram(job->pending);
+  if (job->program != 0) {
+    job->finished = true;
+    return;
+  }
+
+  logCompile(job->pending);
+  if (mode == Mode::Workers) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(job);
+    }
+    workAvailable.notify_one();
+  } else {
+    startProgram(job->pending);
+  }
+}
+
+bool ShaderManager::compiled(Job &job) {
+  switch (mode) {
+  case Mode::Driver: {
+    GLint done = GL_FALSE;
+    glGetProgramiv(job.pending.program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+  }
+  case Mode::Workers: {
+    std::lock_guard<std::mutex> lock(mutex);
+    return job.compiled;
+  }
+  default:
+    return true; // finishing waits for the driver
+  }
+}
+
+void ShaderManager::finishJob(Job &job) {
+  if (mode == Mode::Workers) {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobCompiled.wait(lock, [&job] { return job.compiled; });
+  }
+  try {
+    job.program = finishProgram(job.pending);
+  } catch (const std::runtime_error &e) {
+    job.error = e.what();
+  }
+  job.finished = true;
+}
+
+void ShaderManager::poll() {
+  for (auto &entry : jobs) {
+    Job &job = *entry.second;
+    if (!job.finished && compiled(job)) {
+      if (mode == Mode::Driver) {
+        // An upper bound, as the driver's threads are shared by all jobs.
+        job.pending.compileMs = millisecondsSince(job.pending.start);
+      }
+      finishJob(job);
+    }
+  }
+}
+
+size_t ShaderManager::pending() const {
+  size_t count = 0;
+  for (const auto &entry : jobs) {
+    count += entry.second->finished ? 0 : 1;
+  }
+  return count;
+}
+
+void ShaderManager::finish() {
+  // Finished in whatever order the driver or the workers complete them.
+  while (true) {
+    poll();
+    if (pending() == 0) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  if (!warm) {
+    warm = true;
+    const char *modeName = mode == Mode::Driver    ? "driver threads"
+                           : mode == Mode::Workers ? "worker contexts"
+                                                   : "serial";
+    printf("Shader warm-up: %d programs ready %.0f ms after start (%s)\n",
+           submitted, millisecondsSince(created), modeName);
+  }
+}
+
+GLuint ShaderManager::take(const std::string &name) {
+  auto it = jobs.find(name);
+  if (it == jobs.end()) {
+    return 0;
+  }
+  std::shared_ptr<Job> job = it->second;
+  jobs.erase(it);
+  if (!job->finished) {
+    finishJob(*job);
+  }
+  if (!job->error.empty()) {
+    throw std::runtime_error(job->error);
+  }
+  return job->program;
+}
+
+void ShaderManager::workerLoop(GLFWwindow *context) {
+  glfwMakeContextCurrent(context);
+  while (true) {
+    std::shared_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      workAvailable.wait(lock, [this] { return stopping || !queue.empty(); });
+      if (stopping) {
+        break;
+      }
+      job = queue.front();
+      queue.pop_front();
+    }
+
+    startProgram(job->pending);
+    // Querying the status waits for the compile; glFinish() then makes the
+    // results visible to the window's context.
+    GLint status;
+    for (GLuint shader : job->pending.shaders) {
+      glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    }
+    glGetProgramiv(job->pending.program, GL_LINK_STATUS, &status);
+    glFinish();
+    double compileMs = millisecondsSince(job->pending.start);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job->pending.compileMs = compileMs;
+      job->compiled = true;
+    }
+    jobCompiled.notify_all();
+  }
+  glfwMakeContextCurrent(nullptr);
+}
+
+void ShaderManager::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  workAvailable.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+  for (GLFWwindow *context : contexts) {
+    glfwDestroyWindow(context);
+  }
+  contexts.clear();
+  if (activeManager == this) {
+    activeManager = nullptr;
+  }
+}
@@ -4,9 +4,107 @@
 #define SHADER_H
 
 #include <GL/glew.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct GLFWwindow;
 
 GLuint createShaderProgram(const std::string &vertexShaderFile,
                            const std::string &fragmentShaderFile);
 
+// Requires OpenGL 4.3 or ARB_compute_shader.
+GLuint createComputeProgram(const std::string &computeShaderFile);
+
+// Linked programs are cached on disk as driver binaries, keyed by a hash of
+// the preprocessed sources and the GL vendor, renderer and version, so later
+// launches skip compiling and linking. A binary that is missing or rejected
+// by the driver falls back to compiling from source and is rewritten. Needs
+// OpenGL 4.1 or ARB_get_program_binary; otherwise every program is compiled.
+struct ShaderCacheStats {
+  int hits = 0;
+  int misses = 0;   // compiled from source, including rejected binaries
+  int rejected = 0; // binaries the driver refused to load
+  double compileMs = 0.0; // spent compiling and linking from source
+  double loadMs = 0.0;    // spent loading binaries
+  // Compile time the hits took when they were cached, minus their load time.
+  double savedMs = 0.0;
+};
+
+// Directory of the cache, created on the first write. Empty disables it.
+void setShaderCacheDirectory(const std::string &dir);
+const ShaderCacheStats &shaderCacheStats();
+
+struct ShaderManagerCreateInfo {
+  // Compiler threads when the driver has no KHR_parallel_shader_compile, each
+  // with a hidden context that shares objects with the window's.
+  int workerContexts = 2;
+};
+
+// Compiles every program the renderer needs up front and all at once: on the
+// driver's own threads with KHR_parallel_shader_compile, else on worker
+// threads with shared contexts. While a manager exists, createShaderProgram()
+// and createComputeProgram() hand out the submitted program for their files,
+// waiting only for that one if it is still compiling, instead of compiling.
+// Programs compiled from source after finish() print a warning, since they
+// stall the frame that needs them.
+class ShaderManager {
+public:
+  explicit ShaderManager(
+      GLFWwindow *window,
+      const ShaderManagerCreateInfo &info = ShaderManagerCreateInfo());
+  ~ShaderManager();
+
+  ShaderManager(const ShaderManager &) = delete;
+  ShaderManager &operator=(const ShaderManager &) = delete;
+
+  void submit(const std::string &vertexShaderFile,
+              const std::string &fragmentShaderFile);
+  void submitCompute(const std::string &computeShaderFile);
+
+  // Blocks until every submitted program is linked or has failed; a failure
+  // is thrown by the create call that takes the program.
+  void finish();
+  bool warmedUp() const { return warm; }
+  size_t pending() const;
+
+  // The program submitted under the name, forgotten by the manager, or 0 if
+  // there is none. Used by createShaderProgram() and createComputeProgram().
+  GLuint take(const std::string &name);
+
+  // Joins the workers and destroys their contexts. Call before the window is
+  // destroyed; also run by the destructor.
+  void shutdown();
+
+private:
+  struct Job;
+  enum class Mode { Serial, Driver, Workers };
+
+  void start(const std::string &name, const std::shared_ptr<Job> &job);
+  bool compiled(Job &job);
+  void finishJob(Job &job);
+  void poll();
+  void workerLoop(GLFWwindow *context);
+
+  Mode mode = Mode::Serial;
+  std::unordered_map<std::string, std::shared_ptr<Job>> jobs;
+  int submitted = 0;
+  bool warm = false;
+  std::chrono::steady_clock::time_point created;
+
+  std::vector<GLFWwindow *> contexts;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable workAvailable;
+  std::condition_variable jobCompiled;
+  std::deque<std::shared_ptr<Job>> queue;
+  bool stopping = false;
+};
+
 #endif /* SHADER_H */
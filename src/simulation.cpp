@@ -0,0 +1,276 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "fleet.h"
+
+namespace {
+
+const float kAutopilotDuration = 18.0f; // 增加动画时长让动画更从容
+
+// 优化的贝塞尔曲线控制点 - 创建更优美的螺旋接近路径
+const glm::vec3 kBezierP0 = glm::vec3(25.0f, 12.0f, 25.0f); // 起点：远处高位
+const glm::vec3 kBezierP1 = glm::vec3(-15.0f, 8.0f, 20.0f); // 控制点1：绕到左侧
+const glm::vec3 kBezierP2 = glm::vec3(12.0f, 3.0f, 8.0f); // 控制点2：绕到右侧低位
+const glm::vec3 kBezierP3 = glm::vec3(0.0f, 1.0f, 5.0f); // 终点：靠近黑洞
+
+// 缓动函数：平滑的缓入缓出效果
+float easeInOutCubic(float t) {
+  return t < 0.5f ? 4.0f * t * t * t
+                  : 1.0f - powf(-2.0f * t + 2.0f, 3.0f) / 2.0f;
+}
+
+glm::vec3 calculateBezierPoint(float t, const glm::vec3 &p0,
+                               const glm::vec3 &p1, const glm::vec3 &p2,
+                               const glm::vec3 &p3) {
+  float u = 1.0f - t;
+  float tt = t * t;
+  float uu = u * u;
+  float uuu = uu * u;
+  float ttt = tt * t;
+
+  return uuu * p0 + 3.0f * uu * t * p1 + 3.0f * u * tt * p2 + ttt * p3;
+}
+
+// Camera position at progress (0 to 1) along the autopilot's path.
+glm::vec3 autopilotPosition(double progress) {
+  // 使用缓动函数让动画更平滑
+  float easedT = easeInOutCubic((float)progress);
+  return calculateBezierPoint(easedT, kBezierP0, kBezierP1, kBezierP2,
+                              kBezierP3);
+}
+
+// Matrices change little from one tick to the next, so blending them
+// componentwise stays close to a rigid transform.
+glm::mat4 mixMatrices(const glm::mat4 &a, const glm::mat4 &b, float t) {
+  glm::mat4 m;
+  for (int i = 0; i < 4; ++i) {
+    m[i] = glm::mix(a[i], b[i], t);
+  }
+  return m;
+}
+
+} // namespace
+
+CameraState computeCameraState(double timeSeconds, int width, int height,
+                               float mouseX, float mouseY,
+                               bool mouseControlEnabled, bool frontView,
+                               bool topView, float cameraRollDeg,
+                               float fovScale, bool autopilotActive,
+                               const glm::vec3 &autopilotPos) {
+  CameraState cs{};
+  cs.fovScale = fovScale;
+  cs.rollRadians = glm::radians(cameraRollDeg);
+
+  if (autopilotActive) {
+    cs.pos = autopilotPos;
+  } else if (mouseControlEnabled) {
+    glm::vec2 mouse =
+        glm::clamp(glm::vec2(mouseX, mouseY) / glm::vec2(width, height),
+                   glm::vec2(0.0f), glm::vec2(1.0f)) -
+        glm::vec2(0.5f);
+    cs.pos = glm::vec3(-cos(mouse.x * 10.0f) * 15.0f, mouse.y * 30.0f,
+                       sin(mouse.x * 10.0f) * 15.0f);
+  } else if (frontView) {
+    cs.pos = glm::vec3(10.0f, 1.0f, 10.0f);
+  } else if (topView) {
+    cs.pos = glm::vec3(15.0f, 15.0f, 0.0f);
+  } else {
+    cs.pos = glm::vec3(-cos((float)timeSeconds * 0.1f) * 15.0f,
+                       sin((float)timeSeconds * 0.1f) * 15.0f,
+                       sin((float)timeSeconds * 0.1f) * 15.0f);
+  }
+
+  cs.target = glm::vec3(0.0f);
+
+  updateCameraMatrices(cs, width, height);
+
+  return cs;
+}
+
+double autopilotDuration() { return kAutopilotDuration; }
+
+SimulationState flythroughState(double timeSeconds, float fovScale) {
+  SimulationState state;
+  state.time = timeSeconds;
+  state.autopilotActive = true;
+  glm::vec3 autopilotPos =
+      autopilotPosition(std::clamp(timeSeconds / kAutopilotDuration, 0.0, 1.0));
+  state.camera = computeCameraState(timeSeconds, 1, 1, 0.0f, 0.0f, false,
+                                    false, false, 0.0f, fovScale, true,
+                                    autopilotPos);
+  state.satellite = computeSatelliteOrbit(timeSeconds);
+  state.satelliteModel = computeSatelliteModel(
+      timeSeconds, state.satellite.position, state.satellite.velocity);
+  state.dishAngle = (float)timeSeconds * 2.0f;
+  return state;
+}
+
+void updateCameraMatrices(CameraState &cs, int width, int height) {
+  float aspect = (float)width / (float)height;
+  float fovY = 2.0f * atan(0.5f * cs.fovScale);
+  glm::vec3 up =
+      glm::normalize(glm::vec3(sin(cs.rollRadians), cos(cs.rollRadians), 0.0f));
+
+  cs.view = glm::lookAt(cs.pos, cs.target, up);
+  cs.projection = glm::perspective(fovY, aspect, 0.1f, 500.0f);
+}
+
+Simulation::Simulation(const SimulationCreateInfo &info) : info(info) {
+  // Publish the first tick before the thread starts, so that the render
+  // thread always has a snapshot to sample.
+  double now = glfwGetTime();
+  FrameSnapshot &snapshot = snapshots.back();
+  step(SimulationInput(), now, snapshot.current);
+  snapshot.previous = snapshot.current;
+  last = snapshot.current;
+  snapshots.publish();
+
+  thread = std::thread(&Simulation::run, this);
+}
+
+Simulation::~Simulation() { shutdown(); }
+
+void Simulation::setInput(const SimulationInput &input) {
+  inputs.back() = input;
+  inputs.publish();
+}
+
+void Simulation::run() {
+  using Clock = std::chrono::steady_clock;
+  const double interval = tickInterval();
+  SimulationInput input;
+  uint64_t tick = 0;
+  double next = last.time + interval;
+
+  while (!stopping.load(std::memory_order_relaxed)) {
+    double now = glfwGetTime();
+    if (now < next) {
+      std::this_thread::sleep_for(std::chrono::duration<double>(next - now));
+      continue;
+    }
+    if (now - next > info.maxLagTicks * interval) {
+      next = now; // skip ahead after a stall
+    }
+
+    if (inputs.consume()) {
+      input = inputs.front();
+    }
+    Clock::time_point start = Clock::now();
+    FrameSnapshot &snapshot = snapshots.back();
+    snapshot.tick = ++tick;
+    step(input, next, snapshot.current);
+    snapshot.previous = last;
+    last = snapshot.current;
+    snapshots.publish();
+
+    tickMs.store(std::chrono::duration<float, std::milli>(Clock::now() - start)
+                     .count(),
+                 std::memory_order_relaxed);
+    tickCount.store(tick, std::memory_order_relaxed);
+    next += interval;
+  }
+}
+
+void Simulation::step(const SimulationInput &input, double time,
+                      SimulationState &state) {
+  double dt = time - last.time;
+  state.time = time;
+  state.inputTime = input.sampledAt;
+
+  // Camera mode controls
+  for (; autopilotToggles < input.autopilotToggles; autopilotToggles++) {
+    autopilotActive = !autopilotActive;
+    if (autopilotActive)
+      autopilotT = 0.0;
+  }
+  if (autopilotActive) {
+    autopilotT = std::min(1.0, autopilotT + dt / kAutopilotDuration);
+  }
+  state.autopilotActive = autopilotActive;
+
+  glm::vec3 autopilotPos = autopilotPosition(autopilotT);
+  state.camera = computeCameraState(
+      time, input.width, input.height, input.mouseX, input.mouseY,
+      input.mouseControl, input.frontView, input.topView, input.cameraRollDeg,
+      input.fovScale, autopilotActive, autopilotPos);
+
+  state.satellite = computeSatelliteOrbit(time);
+  state.satelliteModel = computeSatelliteModel(time, state.satellite.position,
+                                               state.satellite.velocity);
+  state.dishAngle = (float)time * 2.0f; // Rotate 2 rad/sec
+
+  state.fleetPropagationMs = 0.0f;
+  if (input.fleetSchwarzschild && input.fleetSize > 0 &&
+      info.fleetCapacity > 0) {
+    if (fleetBodies.count == 0) {
+      // One integration step per tick, so that every tick moves the bodies.
+      OrbitBodiesCreateInfo bodiesInfo;
+      bodiesInfo.step = bodiesInfo.timeScale / (float)info.tickRate;
+      fleetBodies = createOrbitBodies(
+          bodiesInfo,
+          generateSatelliteOrbits(info.fleetCapacity, info.fleetSeed));
+    }
+    auto start = std::chrono::steady_clock::now();
+    advanceOrbitBodies(fleetBodies, (float)dt);
+    state.fleetPropagationMs = std::chrono::duration<float, std::milli>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+    size_t count = std::min((size_t)input.fleetSize, fleetBodies.count);
+    state.fleetModels.assign(fleetBodies.models.begin(),
+                             fleetBodies.models.begin() + count);
+  } else {
+    state.fleetModels.clear();
+  }
+}
+
+const SimulationState &Simulation::sample(double timeSeconds) {
+  snapshots.consume();
+  const FrameSnapshot &snapshot = snapshots.front();
+  const SimulationState &a = snapshot.previous;
+  const SimulationState &b = snapshot.current;
+
+  // One tick behind, so that there is normally a newer tick to blend to.
+  double time = timeSeconds - tickInterval();
+  float t = b.time > a.time ? (float)((time - a.time) / (b.time - a.time))
+                            : 1.0f;
+  t = std::clamp(t, 0.0f, 1.0f);
+
+  sampled.time = a.time + (b.time - a.time) * t;
+  sampled.inputTime = a.inputTime + (b.inputTime - a.inputTime) * t;
+  sampled.camera = b.camera;
+  sampled.camera.pos = glm::mix(a.camera.pos, b.camera.pos, t);
+  sampled.camera.target = glm::mix(a.camera.target, b.camera.target, t);
+  sampled.camera.fovScale = glm::mix(a.camera.fovScale, b.camera.fovScale, t);
+  sampled.camera.rollRadians =
+      glm::mix(a.camera.rollRadians, b.camera.rollRadians, t);
+  sampled.autopilotActive = b.autopilotActive;
+  sampled.satellite.position =
+      glm::mix(a.satellite.position, b.satellite.position, t);
+  sampled.satellite.velocity =
+      glm::mix(a.satellite.velocity, b.satellite.velocity, t);
+  sampled.satelliteModel = mixMatrices(a.satelliteModel, b.satelliteModel, t);
+  sampled.dishAngle = glm::mix(a.dishAngle, b.dishAngle, t);
+  sampled.fleetPropagationMs = b.fleetPropagationMs;
+
+  sampled.fleetModels.resize(b.fleetModels.size());
+  bool blendFleet = a.fleetModels.size() == b.fleetModels.size();
+  for (size_t i = 0; i < b.fleetModels.size(); ++i) {
+    sampled.fleetModels[i] =
+        blendFleet ? mixMatrices(a.fleetModels[i], b.fleetModels[i], t)
+                   : b.fleetModels[i];
+  }
+  return sampled;
+}
+
+void Simulation::shutdown() {
+  stopping.store(true, std::memory_order_relaxed);
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
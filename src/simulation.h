@@ -0,0 +1,146 @@
+
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "orbit.h"
+#include "satellite.h"
+#include "triple_buffer.h"
+
+struct CameraState {
+  glm::vec3 pos;
+  glm::vec3 target;
+  float fovScale;
+  float rollRadians;
+  glm::mat4 view;
+  glm::mat4 projection;
+};
+
+CameraState computeCameraState(double timeSeconds, int width, int height,
+                               float mouseX, float mouseY,
+                               bool mouseControlEnabled, bool frontView,
+                               bool topView, float cameraRollDeg,
+                               float fovScale, bool autopilotActive,
+                               const glm::vec3 &autopilotPos);
+
+// Recomputes view and projection from the camera's pose.
+void updateCameraMatrices(CameraState &cs, int width, int height);
+
+// Inputs sampled on the main thread, where GLFW has to be polled.
+struct SimulationInput {
+  float mouseX = 0.0f;
+  float mouseY = 0.0f;
+  int width = 1; // resolution the mouse position is normalized by
+  int height = 1;
+  bool mouseControl = true;
+  bool frontView = false;
+  bool topView = false;
+  float cameraRollDeg = 0.0f;
+  float fovScale = 1.0f;
+  int autopilotToggles = 0; // presses of the autopilot key so far
+  int fleetSize = 0;
+  bool fleetSchwarzschild = false; // propagate the fleet with orbit.h
+  double sampledAt = 0.0; // glfwGetTime() when the input was read
+};
+
+// Everything the render thread needs from one tick.
+struct SimulationState {
+  double time = 0.0;
+  double inputTime = 0.0; // sampledAt of the input the tick ran with
+  // The camera's view and projection are for the input resolution; call
+  // updateCameraMatrices() for the render resolution.
+  CameraState camera = {};
+  bool autopilotActive = false;
+  SatelliteState satellite = {};
+  glm::mat4 satelliteModel = glm::mat4(1.0f);
+  float dishAngle = 0.0f;
+  // Model matrices of the first fleetSize bodies when fleetSchwarzschild is
+  // set, empty otherwise.
+  std::vector<glm::mat4> fleetModels;
+  float fleetPropagationMs = 0.0f;
+};
+
+// Seconds the autopilot takes from its start to the black hole.
+double autopilotDuration();
+
+// The state timeSeconds into an autopilot flythrough started at time 0,
+// computed directly rather than by ticking, so that any frame of it can be
+// rendered on its own (see RenderWorker). The fleet is left to the GPU.
+SimulationState flythroughState(double timeSeconds, float fovScale = 1.0f);
+
+// The two most recent ticks, so that the render thread can interpolate
+// without keeping a copy of its own.
+struct FrameSnapshot {
+  uint64_t tick = 0;
+  SimulationState previous;
+  SimulationState current;
+};
+
+struct SimulationCreateInfo {
+  double tickRate = 120.0;
+  // After a stall longer than this many ticks the simulation skips ahead
+  // instead of catching up.
+  int maxLagTicks = 8;
+  int fleetCapacity = 0;
+  unsigned fleetSeed = 1;
+};
+
+// Runs input handling, the autopilot, the camera, the satellite orbit and the
+// CPU-propagated fleet on a thread of its own at a fixed tick rate, so that
+// simulation cost and render cost no longer slow each other down. Inputs go
+// in and snapshots come out through lock-free triple buffers; the render
+// thread samples the snapshots one tick in the past and interpolates, so that
+// motion stays smooth whatever the ratio of frame rate to tick rate.
+class Simulation {
+public:
+  explicit Simulation(const SimulationCreateInfo &info = SimulationCreateInfo());
+  ~Simulation();
+
+  Simulation(const Simulation &) = delete;
+  Simulation &operator=(const Simulation &) = delete;
+
+  // Render thread: hands over the latest input, picked up by the next tick.
+  void setInput(const SimulationInput &input);
+
+  // Render thread: the state at timeSeconds (glfwGetTime()), interpolated
+  // between the two latest ticks and held at the newest if the simulation is
+  // behind. Valid until the next call.
+  const SimulationState &sample(double timeSeconds);
+
+  double tickInterval() const { return 1.0 / info.tickRate; }
+  uint64_t ticks() const { return tickCount.load(std::memory_order_relaxed); }
+  float tickCostMs() const { return tickMs.load(std::memory_order_relaxed); }
+
+  // Stops the thread; also run by the destructor.
+  void shutdown();
+
+private:
+  void run();
+  void step(const SimulationInput &input, double time, SimulationState &state);
+
+  SimulationCreateInfo info;
+  TripleBuffer<SimulationInput> inputs;
+  TripleBuffer<FrameSnapshot> snapshots;
+  SimulationState sampled; // render thread
+
+  // Simulation thread.
+  SimulationState last;
+  bool autopilotActive = false;
+  double autopilotT = 0.0;
+  int autopilotToggles = 0;
+  OrbitBodies fleetBodies; // created on first use
+
+  std::thread thread;
+  std::atomic<bool> stopping{false};
+  std::atomic<uint64_t> tickCount{0};
+  std::atomic<float> tickMs{0.0f};
+};
+
+#endif /* SIMULATION_H */
@@ -1,83 +1,35 @@
 #include "texture.h"
 
-#include <iostream>
-#include <vector>
-
-#include <stb_image.h>
-
-GLuint loadTexture2D(const std::string &file, bool repeat) {
-  GLuint textureID;
-  glGenTextures(1, &textureID);
-
-  int width, height, comp;
-  unsigned char *data = stbi_load(file.c_str(), &width, &height, &comp, 0);
-  if (data) {
-    GLenum format = GL_RGB;
-    GLenum internalFormat = GL_SRGB;
-    if (comp == 1) {
-      format = GL_RED;
-      internalFormat = GL_RED;
-    } else if (comp == 3) {
-      format = GL_RGB;
-      internalFormat = GL_SRGB;
-    } else if (comp == 4) {
-      format = GL_RGBA;
-      internalFormat = GL_SRGB_ALPHA;
-    } else {
-      std::cout << "WARNING: Unsupported image format with " << comp
-                << " components: " << file << std::endl;
-    }
-
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format,
-                 GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
-                    repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
-                    repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_image_free(data);
+bool getImageFormat(int comp, GLenum &format, GLenum &internalFormat) {
+  format = GL_RGB;
+  internalFormat = GL_SRGB;
+  if (comp == 1) {
+    format = GL_RED;
+    internalFormat = GL_RED;
+  } else if (comp == 3) {
+    format = GL_RGB;
+    internalFormat = GL_SRGB;
+  } else if (comp == 4) {
+    format = GL_RGBA;
+    internalFormat = GL_SRGB_ALPHA;
   } else {
-    std::cout << "ERROR: Failed to load texture at: " << file << std::endl;
-    stbi_image_free(data);
+    return false;
   }
-
-  return textureID;
+  return true;
 }
 
-GLuint loadCubemap(const std::string &cubemapDir) {
-  const std::vector<std::string> faces = {"right",  "left",  "top",
-                                          "bottom", "front", "back"};
-
-  GLuint textureID;
-  glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-  int width, height, comp;
-  for (GLuint i = 0; i < faces.size(); i++) {
-    unsigned char *data =
-        stbi_load((cubemapDir + "/" + faces[i] + ".png").c_str(), &width,
-                  &height, &comp, 0);
-    if (data) {
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_SRGB, width,
-                   height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-      stbi_image_free(data);
-    } else {
-      std::cout << "Cubemap texture failed to load at path: "
-                << (cubemapDir + "/" + faces[i] + ".png").c_str() << std::endl;
-      stbi_image_free(data);
-    }
+bool isPackedTextureSupported(const PackedTexture &texture) {
+  switch (texture.header.internalFormat) {
+  case GL_RED:
+  case GL_R8:
+  case GL_SRGB:
+  case GL_SRGB8:
+  case GL_SRGB_ALPHA:
+  case GL_SRGB8_ALPHA8:
+    return true;
+  case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+    return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+  default:
+    return false;
   }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-  return textureID;
 }
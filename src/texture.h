@@ -4,10 +4,14 @@
 #define TEXTURE_H
 
 #include <GL/glew.h>
-#include <string>
 
-GLuint loadTexture2D(const std::string &file, bool repeat = true);
+#include "texture_pack.h"
 
-GLuint loadCubemap(const std::string &cubemapDir);
+// Pixel transfer format and sRGB internal format (linear for one channel) of
+// an 8-bit image with comp channels. Returns false if comp is unsupported.
+bool getImageFormat(int comp, GLenum &format, GLenum &internalFormat);
+
+// Whether the current context can sample a packed texture's internal format.
+bool isPackedTextureSupported(const PackedTexture &texture);
 
 #endif /* TEXTURE_H */
@@ -0,0 +1,276 @@
+#include "texture_pack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <GL/glew.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Bytes of a width x height image in the header's format, rows packed with
+// GL_UNPACK_ALIGNMENT 1 as texpack writes them, or 0 for a format that
+// cannot be uploaded from the mapping.
+uint64_t packedImageBytes(const PackedTextureHeader &header, uint32_t width,
+                          uint32_t height) {
+  if (header.format == 0) {
+    switch (header.internalFormat) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+      return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+    default:
+      return 0;
+    }
+  }
+  if (header.type != GL_UNSIGNED_BYTE) {
+    return 0;
+  }
+  uint64_t components = 0;
+  switch (header.format) {
+  case GL_RED:
+    components = 1;
+    break;
+  case GL_RG:
+    components = 2;
+    break;
+  case GL_RGB:
+    components = 3;
+    break;
+  case GL_RGBA:
+    components = 4;
+    break;
+  }
+  return (uint64_t)width * height * components;
+}
+
+} // namespace
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &path,
+                                             MappedFileAccess access) {
+  std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+  DWORD flags = access == kMappedRandom ? FILE_FLAG_RANDOM_ACCESS
+                                        : FILE_FLAG_SEQUENTIAL_SCAN;
+  HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING, flags, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  file->fileHandle = handle;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+    return nullptr;
+  }
+  file->mappingHandle =
+      CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!file->mappingHandle) {
+    return nullptr;
+  }
+  file->bytes = (const unsigned char *)MapViewOfFile(
+      (HANDLE)file->mappingHandle, FILE_MAP_READ, 0, 0, 0);
+  if (!file->bytes) {
+    return nullptr;
+  }
+  file->length = (size_t)size.QuadPart;
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  void *bytes = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps the file open
+  if (bytes == MAP_FAILED) {
+    return nullptr;
+  }
+  // Random access turns read-ahead off, so that fetching a tile does not
+  // read, and evict, its neighbours in the file.
+  madvise(bytes, (size_t)st.st_size,
+          access == kMappedRandom ? MADV_RANDOM : MADV_SEQUENTIAL);
+  file->bytes = (const unsigned char *)bytes;
+  file->length = (size_t)st.st_size;
+#endif
+  return file;
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+  if (bytes) {
+    UnmapViewOfFile(bytes);
+  }
+  if (mappingHandle) {
+    CloseHandle((HANDLE)mappingHandle);
+  }
+  if (fileHandle) {
+    CloseHandle((HANDLE)fileHandle);
+  }
+#else
+  if (bytes) {
+    munmap((void *)bytes, length);
+  }
+#endif
+}
+
+int PackedTexture::levelWidth(int level) const {
+  return std::max(1, (int)(header.width >> level));
+}
+
+int PackedTexture::levelHeight(int level) const {
+  return std::max(1, (int)(header.height >> level));
+}
+
+std::string packedTexturePath(const std::string &source) {
+  size_t slash = source.find_last_of("/\\");
+  size_t dot = source.find_last_of('.');
+  if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+    return source.substr(0, dot) + ".bhtx";
+  }
+  return source + ".bhtx";
+}
+
+bool readPackedTexture(const std::string &path, PackedTexture &texture) {
+  std::shared_ptr<MappedFile> file = MappedFile::open(path);
+  if (!file) {
+    return false;
+  }
+
+  auto fail = [&](const char *reason) {
+    std::cout << "WARNING: Ignoring packed texture " << path << ": " << reason
+              << std::endl;
+    return false;
+  };
+
+  PackedTextureHeader header;
+  if (file->size() < sizeof(header)) {
+    return fail("truncated header");
+  }
+  memcpy(&header, file->data(), sizeof(header));
+  if (memcmp(header.magic, "BHTX", 4) != 0) {
+    return fail("bad magic");
+  }
+  if (header.version != kPackedTextureVersion) {
+    return fail("unsupported version");
+  }
+  if ((header.faceCount != 1 && header.faceCount != 6) ||
+      header.levelCount == 0 || header.levelCount > 16 || header.width == 0 ||
+      header.height == 0 || header.width > 65536 || header.height > 65536) {
+    return fail("bad dimensions");
+  }
+
+  size_t imageCount = (size_t)header.faceCount * header.levelCount;
+  size_t tableEnd = sizeof(header) + imageCount * sizeof(PackedTextureImage);
+  if (file->size() < tableEnd) {
+    return fail("truncated image table");
+  }
+  std::vector<PackedTextureImage> images(imageCount);
+  memcpy(images.data(), file->data() + sizeof(header),
+         imageCount * sizeof(PackedTextureImage));
+  for (const PackedTextureImage &image : images) {
+    if (image.offset < tableEnd || image.offset > file->size() ||
+        image.size > file->size() - image.offset) {
+      return fail("image out of bounds");
+    }
+  }
+  // The uploads read as many bytes as the dimensions and format imply,
+  // whatever the table says.
+  for (uint32_t level = 0; level < header.levelCount; level++) {
+    uint64_t bytes =
+        packedImageBytes(header, std::max(header.width >> level, 1u),
+                         std::max(header.height >> level, 1u));
+    if (bytes == 0) {
+      return fail("unsupported pixel format");
+    }
+    for (uint32_t face = 0; face < header.faceCount; face++) {
+      if (images[level * header.faceCount + face].size != bytes) {
+        return fail("image size does not match its dimensions");
+      }
+    }
+  }
+
+  texture.file = file;
+  texture.header = header;
+  texture.images = std::move(images);
+  return true;
+}
+
+size_t VirtualTexture::tileCount() const {
+  int last = (int)header.levelCount - 1;
+  return levelStart[last] + 6 * (size_t)tilesPerSide(last) * tilesPerSide(last);
+}
+
+const unsigned char *VirtualTexture::tileData(size_t index) const {
+  PackedTextureImage tile;
+  memcpy(&tile,
+         file->data() + sizeof(VirtualTextureHeader) +
+             index * sizeof(PackedTextureImage),
+         sizeof(tile));
+  if (tile.size != tileBytes() || tile.offset > file->size() ||
+      tile.size > file->size() - tile.offset) {
+    return nullptr;
+  }
+  return file->data() + tile.offset;
+}
+
+std::string virtualTexturePath(const std::string &cubemapDir) {
+  return cubemapDir + ".bhvt";
+}
+
+bool readVirtualTexture(const std::string &path, VirtualTexture &texture) {
+  std::shared_ptr<MappedFile> file = MappedFile::open(path, kMappedRandom);
+  if (!file) {
+    return false;
+  }
+
+  auto fail = [&](const char *reason) {
+    std::cout << "WARNING: Ignoring virtual texture " << path << ": " << reason
+              << std::endl;
+    return false;
+  };
+
+  VirtualTextureHeader header;
+  if (file->size() < sizeof(header)) {
+    return fail("truncated header");
+  }
+  memcpy(&header, file->data(), sizeof(header));
+  if (memcmp(header.magic, "BHVT", 4) != 0) {
+    return fail("bad magic");
+  }
+  if (header.version != kVirtualTextureVersion) {
+    return fail("unsupported version");
+  }
+  if (header.tileSize == 0 || header.levelCount == 0 ||
+      header.levelCount > 20 || header.border > 8 ||
+      (uint64_t)header.tileSize << (header.levelCount - 1) !=
+          header.faceSize) {
+    return fail("bad dimensions");
+  }
+
+  texture.file = file;
+  texture.header = header;
+  texture.levelStart.assign(header.levelCount, 0);
+  for (int level = 1; level < (int)header.levelCount; level++) {
+    size_t n = (size_t)texture.tilesPerSide(level - 1);
+    texture.levelStart[level] = texture.levelStart[level - 1] + 6 * n * n;
+  }
+  if ((file->size() - sizeof(header)) / sizeof(PackedTextureImage) <
+      texture.tileCount()) {
+    texture.file = nullptr;
+    return fail("truncated tile table");
+  }
+  return true;
+}
@@ -0,0 +1,145 @@
+
+
+#ifndef TEXTURE_PACK_H
+#define TEXTURE_PACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Packed texture container (.bhtx), written offline by tools/texpack.cpp and
+// memory-mapped at runtime. Every face and mip level is stored ready for
+// glTexImage2D / glCompressedTexImage2D with GL_UNPACK_ALIGNMENT 1, so loading
+// involves no decoding. Layout, little-endian:
+//   PackedTextureHeader
+//   PackedTextureImage[levelCount * faceCount], level-major
+//   image data, each image aligned to kPackedTextureAlignment
+const uint32_t kPackedTextureVersion = 1;
+const size_t kPackedTextureAlignment = 16;
+
+struct PackedTextureHeader {
+  char magic[4];           // "BHTX"
+  uint32_t version;        // kPackedTextureVersion
+  uint32_t faceCount;      // 1, or 6 for cubemaps (+X, -X, +Y, -Y, +Z, -Z)
+  uint32_t levelCount;     // full or partial mip chain, level 0 first
+  uint32_t width;          // of level 0
+  uint32_t height;
+  uint32_t internalFormat; // GL enum, e.g. GL_SRGB8 or a compressed format
+  uint32_t format;         // pixel transfer format, 0 if compressed
+  uint32_t type;           // pixel transfer type, 0 if compressed
+  uint32_t reserved;
+};
+static_assert(sizeof(PackedTextureHeader) == 40, "unexpected header padding");
+
+struct PackedTextureImage {
+  uint64_t offset; // from the start of the file
+  uint64_t size;
+};
+
+// How a mapped file will be read, passed on to the kernel's read-ahead.
+enum MappedFileAccess {
+  kMappedSequential = 0, // front to back, once (.bhtx)
+  kMappedRandom = 1      // a tile at a time, in no particular order (.bhvt)
+};
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+  // Returns nullptr if the file cannot be opened or mapped.
+  static std::shared_ptr<MappedFile>
+  open(const std::string &path, MappedFileAccess access = kMappedSequential);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const unsigned char *data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  MappedFile() = default;
+
+  const unsigned char *bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  void *fileHandle = nullptr;
+  void *mappingHandle = nullptr;
+#endif
+};
+
+struct PackedTexture {
+  std::shared_ptr<MappedFile> file;
+  PackedTextureHeader header = {};
+  std::vector<PackedTextureImage> images;
+
+  bool compressed() const { return header.format == 0; }
+  int levelWidth(int level) const;
+  int levelHeight(int level) const;
+  const PackedTextureImage &image(int face, int level) const {
+    return images[level * header.faceCount + face];
+  }
+  const unsigned char *imageData(int face, int level) const {
+    return file->data() + image(face, level).offset;
+  }
+};
+
+// The container path for a source image or cubemap directory:
+// "assets/color_map.png" -> "assets/color_map.bhtx",
+// "assets/skybox_nebula_dark" -> "assets/skybox_nebula_dark.bhtx".
+std::string packedTexturePath(const std::string &source);
+
+// Maps and validates a container. Returns false, with a warning for anything
+// but a missing file, if it cannot be used.
+bool readPackedTexture(const std::string &path, PackedTexture &texture);
+
+// Tiled mip pyramid of a cubemap (.bhvt) for the virtual-textured sky
+// (virtual_sky.h), written by texpack --vt. Level 0 is the finest; the last
+// level holds one tile per face. Every tile carries a border of `border`
+// texels copied from its neighbours (clamped at the face edges) so that it
+// filters on its own. Layout, little-endian:
+//   VirtualTextureHeader
+//   PackedTextureImage[tile count], by level, then face, row and column
+//   tile data, sRGB RGB8 rows of tileSize + 2 * border texels
+const uint32_t kVirtualTextureVersion = 1;
+
+struct VirtualTextureHeader {
+  char magic[4];       // "BHVT"
+  uint32_t version;    // kVirtualTextureVersion
+  uint32_t faceSize;   // texels per side of a level 0 face
+  uint32_t tileSize;   // texels per side of a tile, border excluded
+  uint32_t levelCount; // faceSize == tileSize << (levelCount - 1)
+  uint32_t border;
+  uint32_t reserved[2];
+};
+static_assert(sizeof(VirtualTextureHeader) == 32, "unexpected header padding");
+
+struct VirtualTexture {
+  std::shared_ptr<MappedFile> file;
+  VirtualTextureHeader header = {};
+  std::vector<size_t> levelStart; // index of each level's first tile
+
+  int tilesPerSide(int level) const {
+    return 1 << (header.levelCount - 1 - level);
+  }
+  int tileStride() const { return (int)(header.tileSize + 2 * header.border); }
+  size_t tileBytes() const { return (size_t)tileStride() * tileStride() * 3; }
+  size_t tileCount() const;
+  size_t tileIndex(int level, int face, int x, int y) const {
+    size_t n = (size_t)tilesPerSide(level);
+    return levelStart[level] + ((size_t)face * n + y) * n + x;
+  }
+  // The tile's pixels inside the mapping, or nullptr if the table entry is
+  // corrupt. The table is checked here rather than up front, where it would
+  // fault in every page of a multi-gigapixel pyramid's table.
+  const unsigned char *tileData(size_t index) const;
+};
+
+// The pyramid path for a cubemap directory, e.g. "assets/sky.bhvt".
+std::string virtualTexturePath(const std::string &cubemapDir);
+
+// Maps a pyramid and validates its header, like readPackedTexture().
+bool readVirtualTexture(const std::string &path, VirtualTexture &texture);
+
+#endif /* TEXTURE_PACK_H */
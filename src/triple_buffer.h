@@ -0,0 +1,46 @@
+
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer, single-consumer handoff of the latest value. The
+// producer fills back() and publishes it; the consumer picks up the newest
+// published value with consume() and reads it through front(). Neither side
+// ever waits for the other: the third slot is always free for the producer,
+// and values published faster than they are consumed are dropped.
+template <typename T> class TripleBuffer {
+public:
+  // Producer side.
+  T &back() { return slots[backIndex]; }
+  void publish() {
+    uint8_t previous =
+        middle.exchange(backIndex | kFresh, std::memory_order_acq_rel);
+    backIndex = previous & kIndexMask;
+  }
+
+  // Consumer side. Returns true, and swaps the value into front(), if a value
+  // was published since the last call.
+  bool consume() {
+    if ((middle.load(std::memory_order_relaxed) & kFresh) == 0) {
+      return false;
+    }
+    uint8_t previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+    frontIndex = previous & kIndexMask;
+    return true;
+  }
+  const T &front() const { return slots[frontIndex]; }
+
+private:
+  static const uint8_t kIndexMask = 3;
+  static const uint8_t kFresh = 4; // middle holds an unconsumed value
+
+  T slots[3] = {};
+  uint8_t backIndex = 0;
+  uint8_t frontIndex = 1;
+  std::atomic<uint8_t> middle{2};
+};
+
+#endif /* TRIPLE_BUFFER_H */
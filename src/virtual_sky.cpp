@@ -0,0 +1,507 @@
+#include "virtual_sky.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdio.h>
+
+namespace {
+
+// Indirection entries are (slot x, slot y, resident level, unused); this
+// level marks tiles with nothing resident yet.
+const uint8_t kNoTile = 255;
+
+} // namespace
+
+VirtualSky::VirtualSky(const VirtualSkyCreateInfo &info, ThreadPool &pool)
+    : info(info), pool(pool), shared(std::make_shared<Shared>()) {}
+
+VirtualSky::~VirtualSky() { shutdown(); }
+
+void VirtualSky::shutdown() {
+  {
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->readsDone.wait(lock,
+                           [this] { return shared->readsInFlight == 0; });
+    shared->loaded.clear();
+  }
+  pending.clear();
+  resident.clear();
+
+  if (feedbackTexture != 0 && glIsFramebuffer(framebuffer)) {
+    // The ray march framebuffer is the caller's; only take our attachment
+    // back off it.
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                           0, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+  framebuffer = 0;
+  if (cacheTexture != 0) {
+    glDeleteTextures(1, &cacheTexture);
+    cacheTexture = 0;
+  }
+  if (indirectionTexture != 0) {
+    glDeleteTextures(1, &indirectionTexture);
+    indirectionTexture = 0;
+  }
+  if (feedbackTexture != 0) {
+    glDeleteTextures(1, &feedbackTexture);
+    feedbackTexture = 0;
+  }
+  if (feedbackSmallTexture != 0) {
+    glDeleteTextures(1, &feedbackSmallTexture);
+    feedbackSmallTexture = 0;
+  }
+  if (feedbackFramebuffer != 0) {
+    glDeleteFramebuffers(1, &feedbackFramebuffer);
+    feedbackFramebuffer = 0;
+  }
+  for (FeedbackReadback &readback : readbacks) {
+    if (readback.pbo != 0) {
+      glDeleteBuffers(1, &readback.pbo);
+      readback.pbo = 0;
+    }
+    readback.pending = false;
+  }
+}
+
+bool VirtualSky::open(const std::string &file) {
+  if (!readVirtualTexture(file, pyramid)) {
+    return false;
+  }
+  const VirtualTextureHeader &h = pyramid.header;
+  int levelCount = (int)h.levelCount;
+  int stride = pyramid.tileStride();
+
+  GLint maxTextureSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+  int tilesPerSide = std::min(std::min(info.cacheTilesPerSide, 255),
+                              maxTextureSize / stride);
+  if (tilesPerSide < 3) {
+    printf("WARNING: Sky tiles of %d texels do not fit a cache texture: %s\n",
+           stride, file.c_str());
+    return false;
+  }
+  info.cacheTilesPerSide = tilesPerSide;
+  slots.assign((size_t)tilesPerSide * tilesPerSide, Slot());
+
+  glGenTextures(1, &cacheTexture);
+  glBindTexture(GL_TEXTURE_2D, cacheTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, tilesPerSide * stride,
+               tilesPerSide * stride, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // One layer per face, one mip level per pyramid level.
+  indirection.resize(levelCount);
+  dirtyBegin.assign((size_t)levelCount * 6, INT_MAX);
+  dirtyEnd.assign((size_t)levelCount * 6, 0);
+  glGenTextures(1, &indirectionTexture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, indirectionTexture);
+  for (int level = 0; level < levelCount; level++) {
+    int n = pyramid.tilesPerSide(level);
+    indirection[level].assign((size_t)n * n * 6 * 4, 0);
+    for (size_t i = 2; i < indirection[level].size(); i += 4) {
+      indirection[level][i] = kNoTile;
+    }
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8UI, n, n, 6, 0,
+                 GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+  }
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  // The coarsest level stays resident so that every lookup has a tile.
+  for (int face = 0; face < 6; face++) {
+    Tile coord = {levelCount - 1, face, 0, 0};
+    size_t index = pyramid.tileIndex(coord.level, face, 0, 0);
+    const unsigned char *pixels = pyramid.tileData(index);
+    if (!pixels) {
+      printf("WARNING: Corrupt coarsest level in virtual sky: %s\n",
+             file.c_str());
+      glDeleteTextures(1, &cacheTexture);
+      glDeleteTextures(1, &indirectionTexture);
+      cacheTexture = indirectionTexture = 0;
+      resident.clear();
+      return false;
+    }
+    storeTile(allocateSlot(), index, coord, pixels, true);
+  }
+  uploadIndirection();
+
+  printf("Opened virtual sky %s: %u^2 texels per face (%.1f gigapixels) in "
+         "%zu tiles, cache of %d tiles (%.0f MB)\n",
+         file.c_str(), h.faceSize, 6.0 * h.faceSize * h.faceSize / 1e9,
+         pyramid.tileCount(), tilesPerSide * tilesPerSide,
+         cacheBytes() / 1048576.0);
+  return true;
+}
+
+size_t VirtualSky::cacheBytes() const {
+  size_t side = (size_t)info.cacheTilesPerSide * pyramid.tileStride();
+  return loaded() ? side * side * 3 : 0;
+}
+
+void VirtualSky::attachFeedback(GLuint target, int width, int height) {
+  if (!loaded()) {
+    return;
+  }
+  framebuffer = target;
+  feedbackWidth = width;
+  feedbackHeight = height;
+
+  glDeleteTextures(1, &feedbackTexture);
+  glGenTextures(1, &feedbackTexture);
+  glBindTexture(GL_TEXTURE_2D, feedbackTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, width, height, 0,
+               GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                         feedbackTexture, 0);
+
+  int scale = info.feedbackScale;
+  int smallWidth = std::max(1, (width - scale + 1) / scale);
+  int smallHeight = std::max(1, (height - scale + 1) / scale);
+  glDeleteTextures(1, &feedbackSmallTexture);
+  glGenTextures(1, &feedbackSmallTexture);
+  glBindTexture(GL_TEXTURE_2D, feedbackSmallTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, smallWidth, smallHeight, 0,
+               GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  if (feedbackFramebuffer == 0) {
+    glGenFramebuffers(1, &feedbackFramebuffer);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         feedbackSmallTexture, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  // Readbacks in flight have the old size; drop them.
+  for (FeedbackReadback &readback : readbacks) {
+    readback.pending = false;
+  }
+}
+
+void VirtualSky::beginFeedback() {
+  if (!loaded() || !feedbackTexture) {
+    return;
+  }
+  const GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, buffers);
+  const GLuint none[4] = {0, 0, 0, 0};
+  glClearBufferuiv(GL_COLOR, 1, none);
+}
+
+void VirtualSky::endFeedback() {
+  if (!loaded() || !feedbackTexture) {
+    return;
+  }
+  const GLenum buffer = GL_COLOR_ATTACHMENT0;
+  glDrawBuffers(1, &buffer);
+
+  // A nearest blit picks one pixel per scale x scale block; shifting the
+  // source rectangle visits every pixel of the block over scale^2 frames.
+  int scale = info.feedbackScale;
+  FeedbackReadback &readback = readbacks[frame % kFeedbackBuffers];
+  readback.width = std::max(1, (feedbackWidth - scale + 1) / scale);
+  readback.height = std::max(1, (feedbackHeight - scale + 1) / scale);
+  int srcWidth = std::min(readback.width * scale, feedbackWidth);
+  int srcHeight = std::min(readback.height * scale, feedbackHeight);
+  int x = std::min((int)(frame % scale), feedbackWidth - srcWidth);
+  int y = std::min((int)(frame / scale % scale), feedbackHeight - srcHeight);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glReadBuffer(GL_COLOR_ATTACHMENT1);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, feedbackFramebuffer);
+  glBlitFramebuffer(x, y, x + srcWidth, y + srcHeight, 0, 0, readback.width,
+                    readback.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+  // Read into a pixel-pack buffer; update() maps it kFeedbackBuffers frames
+  // later, when the copy is long done.
+  size_t bytes = (size_t)readback.width * readback.height * 4 * sizeof(uint16_t);
+  if (readback.pbo == 0) {
+    glGenBuffers(1, &readback.pbo);
+  }
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, feedbackFramebuffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+  glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+  glReadPixels(0, 0, readback.width, readback.height, GL_RGBA_INTEGER,
+               GL_UNSIGNED_SHORT, (void *)0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback.pending = true;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void VirtualSky::bind(GLuint program, int firstTextureUnit) const {
+  glUniform1i(glGetUniformLocation(program, "vtIndirection"), firstTextureUnit);
+  glActiveTexture(GL_TEXTURE0 + firstTextureUnit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, indirectionTexture);
+  glUniform1i(glGetUniformLocation(program, "vtCache"), firstTextureUnit + 1);
+  glActiveTexture(GL_TEXTURE0 + firstTextureUnit + 1);
+  glBindTexture(GL_TEXTURE_2D, cacheTexture);
+  glActiveTexture(GL_TEXTURE0);
+
+  const VirtualTextureHeader &h = pyramid.header;
+  glUniform4f(glGetUniformLocation(program, "vtParams"), (float)h.faceSize,
+              (float)h.tileSize, (float)h.border, (float)h.levelCount);
+}
+
+void VirtualSky::update() {
+  if (!loaded()) {
+    return;
+  }
+  frame++;
+
+  // Written by endFeedback() kFeedbackBuffers frames ago, and about to be
+  // written again by this frame's.
+  FeedbackReadback &readback = readbacks[frame % kFeedbackBuffers];
+  if (readback.pending) {
+    size_t count = (size_t)readback.width * readback.height;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    const void *texels = glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, count * 4 * sizeof(uint16_t), GL_MAP_READ_BIT);
+    if (texels) {
+      processFeedback((const uint16_t *)texels, count);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.pending = false;
+  }
+
+  std::deque<LoadedTile> loadedTiles;
+  {
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    size_t count = std::min(shared->loaded.size(),
+                            (size_t)info.maxTileUploadsPerFrame);
+    for (size_t i = 0; i < count; i++) {
+      loadedTiles.push_back(std::move(shared->loaded.front()));
+      shared->loaded.pop_front();
+    }
+  }
+  for (LoadedTile &tile : loadedTiles) {
+    pending.erase(tile.index);
+    if (tile.pixels.empty()) {
+      printf("WARNING: Corrupt virtual sky tile %d/%d/%d/%d\n",
+             tile.coord.level, tile.coord.face, tile.coord.x, tile.coord.y);
+      continue;
+    }
+    if (resident.count(tile.index)) {
+      continue;
+    }
+    int slot = allocateSlot();
+    if (slot < 0) {
+      continue; // every slot was seen this frame; asked for again later
+    }
+    storeTile(slot, tile.index, tile.coord, tile.pixels.data(), false);
+  }
+  uploadIndirection();
+}
+
+VirtualSky::Tile VirtualSky::parentOf(const Tile &tile) const {
+  if (tile.level + 1 >= (int)pyramid.header.levelCount) {
+    return tile;
+  }
+  return {tile.level + 1, tile.face, tile.x / 2, tile.y / 2};
+}
+
+void VirtualSky::processFeedback(const uint16_t *texels, size_t count) {
+  int levelCount = (int)pyramid.header.levelCount;
+  std::unordered_set<size_t> seen;
+  std::vector<Tile> missing;
+
+  for (size_t i = 0; i < count; i++) {
+    const uint16_t *t = texels + i * 4;
+    if (t[3] == 0) {
+      continue;
+    }
+    Tile want = {t[2] >> 3, t[2] & 7, t[0], t[1]};
+    if (want.level >= levelCount || want.face >= 6 ||
+        want.x >= pyramid.tilesPerSide(want.level) ||
+        want.y >= pyramid.tilesPerSide(want.level) ||
+        !seen.insert(pyramid.tileIndex(want.level, want.face, want.x, want.y))
+             .second) {
+      continue;
+    }
+
+    // Keep the path to the root warm and load its coarsest missing tile, so
+    // that the sky sharpens one level at a time.
+    Tile coarsestMissing = {-1, 0, 0, 0};
+    for (Tile a = want;; a = parentOf(a)) {
+      auto it = resident.find(pyramid.tileIndex(a.level, a.face, a.x, a.y));
+      if (it != resident.end()) {
+        slots[it->second].lastUsed = frame;
+      } else {
+        coarsestMissing = a;
+      }
+      if (a.level == levelCount - 1) {
+        break;
+      }
+    }
+    if (coarsestMissing.level >= 0) {
+      missing.push_back(coarsestMissing);
+    }
+  }
+
+  std::sort(missing.begin(), missing.end(),
+            [](const Tile &a, const Tile &b) { return a.level > b.level; });
+  for (const Tile &tile : missing) {
+    if (pending.size() >= (size_t)info.maxTileReadsInFlight) {
+      break;
+    }
+    request(tile);
+  }
+}
+
+void VirtualSky::request(const Tile &tile) {
+  size_t index = pyramid.tileIndex(tile.level, tile.face, tile.x, tile.y);
+  if (pending.count(index) || resident.count(index)) {
+    return;
+  }
+  pending.insert(index);
+  readTile(index, tile);
+}
+
+void VirtualSky::readTile(size_t index, const Tile &coord) {
+  // Faulting the tile in from disk happens on the pool, in the copy.
+  const unsigned char *source = pyramid.tileData(index);
+  size_t bytes = pyramid.tileBytes();
+  std::shared_ptr<MappedFile> file = pyramid.file;
+  std::shared_ptr<Shared> s = shared;
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->readsInFlight++;
+  }
+  pool.submit([s, file, source, bytes, index, coord] {
+    LoadedTile tile = {index, coord, {}};
+    if (source) {
+      tile.pixels.assign(source, source + bytes);
+    }
+
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->loaded.push_back(std::move(tile));
+    if (--s->readsInFlight == 0) {
+      s->readsDone.notify_all();
+    }
+  });
+}
+
+int VirtualSky::allocateSlot() {
+  int victim = -1;
+  for (int i = 0; i < (int)slots.size(); i++) {
+    const Slot &slot = slots[i];
+    if (slot.tile == SIZE_MAX) {
+      return i;
+    }
+    if (!slot.pinned && slot.lastUsed < frame &&
+        (victim < 0 || slot.lastUsed < slots[victim].lastUsed)) {
+      victim = i;
+    }
+  }
+  if (victim >= 0) {
+    evict(victim);
+  }
+  return victim;
+}
+
+void VirtualSky::storeTile(int slot, size_t index, const Tile &coord,
+                           const unsigned char *pixels, bool pinned) {
+  int tilesPerSide = info.cacheTilesPerSide;
+  int stride = pyramid.tileStride();
+  glBindTexture(GL_TEXTURE_2D, cacheTexture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, slot % tilesPerSide * stride,
+                  slot / tilesPerSide * stride, stride, stride, GL_RGB,
+                  GL_UNSIGNED_BYTE, pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  slots[slot].tile = index;
+  slots[slot].coord = coord;
+  slots[slot].lastUsed = frame;
+  slots[slot].pinned = pinned;
+  resident[index] = slot;
+
+  const uint8_t value[4] = {(uint8_t)(slot % tilesPerSide),
+                            (uint8_t)(slot / tilesPerSide),
+                            (uint8_t)coord.level, 0};
+  setSubtree(coord, value, true);
+}
+
+void VirtualSky::evict(int slot) {
+  // Everything that pointed at this tile falls back to what its parent
+  // points at, the nearest resident ancestor.
+  const Tile &coord = slots[slot].coord;
+  Tile parent = parentOf(coord);
+  uint8_t value[4];
+  memcpy(value, entry(parent.level, parent.face, parent.x, parent.y), 4);
+  setSubtree(coord, value, false);
+
+  resident.erase(slots[slot].tile);
+  slots[slot] = Slot();
+}
+
+uint8_t *VirtualSky::entry(int level, int face, int x, int y) {
+  size_t n = (size_t)pyramid.tilesPerSide(level);
+  return &indirection[level][(((size_t)face * n + y) * n + x) * 4];
+}
+
+// Writes value into the entries of tile and of every finer tile under it
+// that currently resolve to something coarser than tile (adding) or to tile
+// itself (evicting).
+void VirtualSky::setSubtree(const Tile &tile, const uint8_t value[4],
+                            bool adding) {
+  for (int level = tile.level; level >= 0; level--) {
+    int shift = tile.level - level;
+    int x0 = tile.x << shift, x1 = (tile.x + 1) << shift;
+    int y0 = tile.y << shift, y1 = (tile.y + 1) << shift;
+    bool changed = false;
+    for (int y = y0; y < y1; y++) {
+      for (int x = x0; x < x1; x++) {
+        uint8_t *e = entry(level, tile.face, x, y);
+        if (adding ? e[2] > tile.level : e[2] == tile.level) {
+          memcpy(e, value, 4);
+          changed = true;
+        }
+      }
+    }
+    if (!changed) {
+      // Finer levels under an unchanged level are unchanged too.
+      break;
+    }
+    size_t dirty = (size_t)level * 6 + tile.face;
+    dirtyBegin[dirty] = std::min(dirtyBegin[dirty], y0);
+    dirtyEnd[dirty] = std::max(dirtyEnd[dirty], y1);
+  }
+}
+
+void VirtualSky::uploadIndirection() {
+  glBindTexture(GL_TEXTURE_2D_ARRAY, indirectionTexture);
+  for (int level = 0; level < (int)indirection.size(); level++) {
+    int n = pyramid.tilesPerSide(level);
+    for (int face = 0; face < 6; face++) {
+      size_t dirty = (size_t)level * 6 + face;
+      if (dirtyBegin[dirty] >= dirtyEnd[dirty]) {
+        continue;
+      }
+      int y0 = dirtyBegin[dirty];
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, y0, face, n,
+                      dirtyEnd[dirty] - y0, 1, GL_RGBA_INTEGER,
+                      GL_UNSIGNED_BYTE, entry(level, face, 0, y0));
+      dirtyBegin[dirty] = INT_MAX;
+      dirtyEnd[dirty] = 0;
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
@@ -0,0 +1,154 @@
+
+
+#ifndef VIRTUAL_SKY_H
+#define VIRTUAL_SKY_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "parallel.h"
+#include "texture_pack.h"
+
+struct VirtualSkyCreateInfo {
+  // The physical cache holds cacheTilesPerSide^2 tiles; this bounds the
+  // resident texture memory whatever the size of the pyramid on disk.
+  int cacheTilesPerSide = 16;
+  // The feedback buffer is read back at 1 / feedbackScale of the render
+  // resolution, with a different pixel of each block every frame.
+  int feedbackScale = 8;
+  int maxTileReadsInFlight = 32;
+  int maxTileUploadsPerFrame = 16;
+};
+
+// Sky of a tiled cubemap pyramid (texture_pack.h) far larger than GPU memory.
+// The ray marcher writes the tile each pixel wants into a second color
+// attachment; a downsampled copy is read back asynchronously, the missing
+// tiles are read from the memory-mapped pyramid on the thread pool and
+// uploaded into a fixed-size cache texture, and an indirection texture maps
+// every tile to the finest resident tile covering it. The coarsest level is
+// loaded up front, so the sky shows immediately and sharpens as tiles arrive,
+// coarse levels first.
+class VirtualSky {
+public:
+  explicit VirtualSky(const VirtualSkyCreateInfo &info = VirtualSkyCreateInfo(),
+                      ThreadPool &pool = ThreadPool::shared());
+  ~VirtualSky();
+
+  VirtualSky(const VirtualSky &) = delete;
+  VirtualSky &operator=(const VirtualSky &) = delete;
+
+  // Maps the pyramid and loads its coarsest level. Returns false, leaving the
+  // sky unloaded, if the file is missing or unusable.
+  bool open(const std::string &file);
+  bool loaded() const { return cacheTexture != 0; }
+
+  // (Re)creates the feedback attachment (GL_COLOR_ATTACHMENT1) of the ray
+  // marcher's framebuffer. Call whenever that framebuffer is recreated.
+  void attachFeedback(GLuint framebuffer, int width, int height);
+
+  // Processes read-back feedback and finished tile reads. Call once per
+  // frame on the GL thread, before the ray marcher runs.
+  void update();
+
+  // Bracket the ray marcher's draw into the framebuffer given to
+  // attachFeedback(): begin enables and clears the feedback attachment, end
+  // disables it again and starts reading it back.
+  void beginFeedback();
+  void endFeedback();
+
+  // Binds vtIndirection and vtCache to the two texture units from
+  // firstTextureUnit and sets vtParams. Binds texture 0 when not loaded, which
+  // still keeps the sampler types off the units of the other samplers.
+  void bind(GLuint program, int firstTextureUnit) const;
+
+  size_t residentTiles() const { return resident.size(); }
+  size_t pendingTiles() const { return pending.size(); }
+  size_t cacheBytes() const;
+
+  // Waits for tile reads still running on the pool and deletes the textures,
+  // framebuffer and readback buffers; also run by the destructor.
+  void shutdown();
+
+private:
+  struct Tile {
+    int level, face, x, y;
+  };
+
+  struct Slot {
+    size_t tile = SIZE_MAX; // SIZE_MAX when free
+    Tile coord = {};
+    uint64_t lastUsed = 0;
+    bool pinned = false;
+  };
+
+  struct LoadedTile {
+    size_t index;
+    Tile coord;
+    std::vector<unsigned char> pixels; // empty if the read failed
+  };
+
+  // State shared with pool tasks.
+  struct Shared {
+    std::mutex mutex;
+    std::condition_variable readsDone;
+    std::deque<LoadedTile> loaded;
+    int readsInFlight = 0;
+  };
+
+  struct FeedbackReadback {
+    GLuint pbo = 0;
+    int width = 0;
+    int height = 0;
+    bool pending = false;
+  };
+
+  static const int kFeedbackBuffers = 3;
+
+  Tile parentOf(const Tile &tile) const;
+  void readTile(size_t index, const Tile &coord);
+  void processFeedback(const uint16_t *texels, size_t count);
+  void request(const Tile &tile);
+  int allocateSlot();
+  void storeTile(int slot, size_t index, const Tile &coord,
+                 const unsigned char *pixels, bool pinned);
+  void evict(int slot);
+  uint8_t *entry(int level, int face, int x, int y);
+  void setSubtree(const Tile &tile, const uint8_t value[4], bool adding);
+  void uploadIndirection();
+
+  VirtualSkyCreateInfo info;
+  ThreadPool &pool;
+  std::shared_ptr<Shared> shared;
+  VirtualTexture pyramid;
+
+  GLuint cacheTexture = 0;
+  GLuint indirectionTexture = 0;
+  std::vector<Slot> slots;
+  std::unordered_map<size_t, int> resident; // tile index -> slot
+  std::unordered_set<size_t> pending;        // reads queued or running
+  uint64_t frame = 0;
+
+  // CPU copy of the indirection texture, RGBA8 per tile, one vector per
+  // level, and the rows changed since the last upload per level and face.
+  std::vector<std::vector<uint8_t>> indirection;
+  std::vector<int> dirtyBegin, dirtyEnd;
+
+  GLuint framebuffer = 0;
+  GLuint feedbackTexture = 0;
+  GLuint feedbackFramebuffer = 0; // downsampled copy
+  GLuint feedbackSmallTexture = 0;
+  int feedbackWidth = 0, feedbackHeight = 0; // full resolution
+  FeedbackReadback readbacks[kFeedbackBuffers];
+};
+
+#endif /* VIRTUAL_SKY_H */
@@ -0,0 +1,310 @@
+// Measures how far the ray marcher's integration strays from the exact
+// Schwarzschild geodesics (src/geodesic.h).
+//
+//   geodesic_error [--size WxH] [--camera X,Y,Z] [--target X,Y,Z] [--fov F]
+//                  [--roll DEG] [--step S] [--iterations N]
+//                  [--tolerance T] [output prefix]
+//
+// Traces every pixel of a perspective view, set up as in blackhole_main.frag,
+// once with the double-precision reference and once with traceColor()'s
+// integration at the given step size and iteration limit, and writes per
+// pixel error maps:
+//   <prefix>_direction.ppm/.pfm  angle between the escape directions, degrees
+//   <prefix>_disk.ppm/.pfm       difference of the disk crossing radii
+// The heatmaps run from blue to red on a log scale (0.001 to 10 degrees,
+// 0.001 to 1 units); magenta marks pixels where one integrator hits the
+// horizon or the disk and the other does not, grey where neither sees a
+// value. The .pfm files hold the raw values, -1 at those mismatches.
+
+#include "geodesic.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace {
+
+const double kDegrees = 180.0 / 3.14159265358979323846;
+// Map values meaning "nothing to compare" and "the integrators disagree".
+const float kNoValue = 0.0f;
+const float kMismatch = -1.0f;
+
+struct Settings {
+  int width = 640;
+  int height = 360;
+  // The front view preset.
+  glm::vec3 camera = glm::vec3(10.0f, 1.0f, 10.0f);
+  glm::vec3 target = glm::vec3(0.0f);
+  float fov = 1.0f;
+  float rollDeg = 0.0f;
+  ShaderTraceInfo shader;
+  ReferenceTraceInfo reference;
+  std::string prefix = "geodesic_error";
+};
+
+int usage() {
+  fprintf(stderr,
+          "usage: geodesic_error [--size WxH] [--camera X,Y,Z] "
+          "[--target X,Y,Z] [--fov F]\n"
+          "                      [--roll DEG] [--step S] [--iterations N] "
+          "[--tolerance T]\n"
+          "                      [output prefix]\n");
+  return 1;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// lookAt() and the pinhole camera of blackhole_main.frag, for the pixel
+// centre (x, y) from the lower left.
+glm::vec3 pixelRay(const Settings &settings, int x, int y) {
+  float roll = glm::radians(settings.rollDeg);
+  glm::vec3 rr(std::sin(roll), std::cos(roll), 0.0f);
+  glm::vec3 ww = glm::normalize(settings.target - settings.camera);
+  glm::vec3 uu = glm::normalize(glm::cross(ww, rr));
+  glm::vec3 vv = glm::normalize(glm::cross(uu, ww));
+  glm::mat3 view(uu, vv, ww);
+
+  glm::vec2 uv =
+      glm::vec2(x + 0.5f, y + 0.5f) /
+          glm::vec2((float)settings.width, (float)settings.height) -
+      glm::vec2(0.5f);
+  uv.x *= (float)settings.width / settings.height;
+  glm::vec3 rayDir(-uv.x * settings.fov, uv.y * settings.fov, 1.0f);
+  return view * glm::normalize(rayDir);
+}
+
+float directionError(const GeodesicResult &reference,
+                     const GeodesicResult &result) {
+  bool referenceCaptured = reference.fate == kGeodesicCaptured;
+  bool resultCaptured = result.fate == kGeodesicCaptured;
+  if (referenceCaptured != resultCaptured) {
+    return kMismatch;
+  }
+  if (referenceCaptured || reference.fate != kGeodesicEscaped) {
+    return kNoValue;
+  }
+  glm::dvec3 a = reference.direction, b = result.direction;
+  double angle =
+      std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)) * kDegrees;
+  // Exactly 0 would read as nothing to compare.
+  return std::max((float)angle, 1e-9f);
+}
+
+float diskError(const GeodesicResult &reference, const GeodesicResult &result) {
+  bool referenceHit = reference.diskRadius >= 0.0;
+  bool resultHit = result.diskRadius >= 0.0;
+  if (referenceHit != resultHit) {
+    return kMismatch;
+  }
+  if (!referenceHit) {
+    return kNoValue;
+  }
+  return std::max((float)std::abs(result.diskRadius - reference.diskRadius),
+                  1e-9f);
+}
+
+glm::vec3 heatColor(float value, float lo, float hi) {
+  static const glm::vec3 kStops[] = {{0.05f, 0.05f, 0.45f},
+                                     {0.0f, 0.55f, 0.85f},
+                                     {0.2f, 0.8f, 0.2f},
+                                     {1.0f, 0.85f, 0.0f},
+                                     {1.0f, 0.0f, 0.0f}};
+  if (value == kMismatch) {
+    return glm::vec3(1.0f, 0.0f, 1.0f);
+  }
+  if (value == kNoValue) {
+    return glm::vec3(0.15f);
+  }
+  float t = (std::log10(value) - std::log10(lo)) /
+            (std::log10(hi) - std::log10(lo));
+  t = glm::clamp(t, 0.0f, 1.0f) * 4.0f;
+  int i = std::min((int)t, 3);
+  return glm::mix(kStops[i], kStops[i + 1], t - i);
+}
+
+// Maps are stored from the bottom row up, as the shader's pixels and PFM.
+bool writeHeatmap(const std::string &path, const std::vector<float> &map,
+                  int width, int height, float lo, float hi) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+  std::vector<unsigned char> row((size_t)width * 3);
+  for (int y = height - 1; y >= 0; y--) {
+    for (int x = 0; x < width; x++) {
+      glm::vec3 color = heatColor(map[(size_t)y * width + x], lo, hi);
+      for (int c = 0; c < 3; c++) {
+        row[(size_t)x * 3 + c] = (unsigned char)(color[c] * 255.0f + 0.5f);
+      }
+    }
+    fwrite(row.data(), 1, row.size(), file);
+  }
+  return fclose(file) == 0;
+}
+
+bool writePfm(const std::string &path, const std::vector<float> &map,
+              int width, int height) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  // A negative scale marks little-endian floats.
+  fprintf(file, "Pf\n%d %d\n-1.0\n", width, height);
+  fwrite(map.data(), sizeof(float), map.size(), file);
+  return fclose(file) == 0;
+}
+
+void printStatistics(const char *name, const char *unit,
+                     const std::vector<float> &map) {
+  std::vector<float> values;
+  int mismatches = 0;
+  for (float value : map) {
+    if (value == kMismatch) {
+      mismatches++;
+    } else if (value != kNoValue) {
+      values.push_back(value);
+    }
+  }
+  printf("%s: %zu pixels compared, %d mismatched\n", name, values.size(),
+         mismatches);
+  if (values.empty()) {
+    return;
+  }
+  std::sort(values.begin(), values.end());
+  double sum = 0.0;
+  for (float value : values) {
+    sum += value;
+  }
+  auto percentile = [&](double p) {
+    return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+  };
+  printf("  mean %.4g, median %.4g, p95 %.4g, p99 %.4g, max %.4g %s\n",
+         sum / values.size(), percentile(0.5), percentile(0.95),
+         percentile(0.99), values.back(), unit);
+}
+
+bool parseVec3(const char *text, glm::vec3 &value) {
+  return sscanf(text, "%f,%f,%f", &value.x, &value.y, &value.z) == 3;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Settings settings;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--size" && hasValue) {
+      if (sscanf(argv[++i], "%dx%d", &settings.width, &settings.height) != 2 ||
+          settings.width < 1 || settings.height < 1) {
+        return usage();
+      }
+    } else if (arg == "--camera" && hasValue) {
+      if (!parseVec3(argv[++i], settings.camera)) {
+        return usage();
+      }
+    } else if (arg == "--target" && hasValue) {
+      if (!parseVec3(argv[++i], settings.target)) {
+        return usage();
+      }
+    } else if (arg == "--fov" && hasValue) {
+      settings.fov = (float)atof(argv[++i]);
+    } else if (arg == "--roll" && hasValue) {
+      settings.rollDeg = (float)atof(argv[++i]);
+    } else if (arg == "--step" && hasValue) {
+      settings.shader.stepSize = (float)atof(argv[++i]);
+    } else if (arg == "--iterations" && hasValue) {
+      settings.shader.maxIterations = atoi(argv[++i]);
+    } else if (arg == "--tolerance" && hasValue) {
+      settings.reference.tolerance = atof(argv[++i]);
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      return usage();
+    } else {
+      settings.prefix = arg;
+    }
+  }
+  if (settings.shader.stepSize <= 0.0f) {
+    return usage();
+  }
+
+  const int width = settings.width, height = settings.height;
+  size_t pixelCount = (size_t)width * height;
+  std::vector<GeodesicResult> reference(pixelCount), shader(pixelCount);
+  ThreadPool &pool = ThreadPool::shared();
+
+  auto start = std::chrono::steady_clock::now();
+  pool.parallelFor(height, 1, [&](size_t begin, size_t end) {
+    for (size_t y = begin; y < end; y++) {
+      for (int x = 0; x < width; x++) {
+        glm::dvec3 dir(pixelRay(settings, x, (int)y));
+        reference[y * width + x] =
+            traceReference(glm::dvec3(settings.camera), dir,
+                           settings.reference);
+      }
+    }
+  });
+  double referenceMs = millisecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  pool.parallelFor(height, 1, [&](size_t begin, size_t end) {
+    for (size_t y = begin; y < end; y++) {
+      for (int x = 0; x < width; x++) {
+        shader[y * width + x] =
+            traceShader(settings.camera, pixelRay(settings, x, (int)y),
+                        settings.shader);
+      }
+    }
+  });
+  double shaderMs = millisecondsSince(start);
+
+  std::vector<float> directionMap(pixelCount), diskMap(pixelCount);
+  long long referenceSteps = 0, shaderSteps = 0;
+  int unresolved = 0, truncated = 0;
+  for (size_t i = 0; i < pixelCount; i++) {
+    directionMap[i] = directionError(reference[i], shader[i]);
+    diskMap[i] = diskError(reference[i], shader[i]);
+    referenceSteps += reference[i].steps;
+    shaderSteps += shader[i].steps;
+    unresolved += reference[i].fate == kGeodesicTruncated;
+    truncated += shader[i].fate == kGeodesicTruncated;
+  }
+
+  printf("%dx%d pixels from (%g, %g, %g), shader step %g\n", width, height,
+         settings.camera.x, settings.camera.y, settings.camera.z,
+         settings.shader.stepSize);
+  printf("Reference: %.0f ms, %.1f steps per ray, %d rays unresolved\n",
+         referenceMs, (double)referenceSteps / pixelCount, unresolved);
+  printf("Shader: %.0f ms, %.1f steps per ray, %d rays stopped by the "
+         "iteration limit\n",
+         shaderMs, (double)shaderSteps / pixelCount, truncated);
+  printStatistics("Escape direction error", "degrees", directionMap);
+  printStatistics("Disk radius error", "units", diskMap);
+
+  std::string directionPath = settings.prefix + "_direction";
+  std::string diskPath = settings.prefix + "_disk";
+  if (!writeHeatmap(directionPath + ".ppm", directionMap, width, height,
+                    1e-3f, 10.0f) ||
+      !writePfm(directionPath + ".pfm", directionMap, width, height) ||
+      !writeHeatmap(diskPath + ".ppm", diskMap, width, height, 1e-3f, 1.0f) ||
+      !writePfm(diskPath + ".pfm", diskMap, width, height)) {
+    fprintf(stderr, "Failed to write the error maps to %s_*\n",
+            settings.prefix.c_str());
+    return 1;
+  }
+  printf("Wrote %s_direction.ppm/.pfm and %s_disk.ppm/.pfm\n",
+         settings.prefix.c_str(), settings.prefix.c_str());
+  return 0;
+}
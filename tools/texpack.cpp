@@ -0,0 +1,829 @@
+// Offline packer for the .bhtx texture container (src/texture_pack.h).
+//
+//   texpack [--bc1] [--levels N] <image.png | cubemap dir> [output]
+//   texpack --vt [--tile N] <cubemap dir> [output]
+//   texpack --bench <image.png | cubemap dir>
+//
+// Decodes the PNG (or the six faces of a cubemap directory), builds the mip
+// chain with a gamma-correct box filter and writes every level in upload
+// layout. --bc1 stores RGB images as sRGB BC1 (DXT1), 8:1 smaller than RGB8.
+// --vt writes the tiled pyramid for the virtual-textured sky instead; the
+// faces must be N (default 128) texels times a power of two. A face too large
+// to decode whole can be given as a <face>/ directory of square PNG tiles,
+// <row>_<column>.png, which are read a row at a time.
+// --bench times loading the PNGs against mapping and reading the packed file.
+
+#include "parallel.h"
+#include "texture_pack.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <stb_image.h>
+#include <sys/stat.h>
+
+namespace {
+
+const char *const kCubemapFaces[6] = {"right",  "left",  "top",
+                                      "bottom", "front", "back"};
+
+struct Image {
+  int width = 0;
+  int height = 0;
+  int comp = 0;
+  std::vector<unsigned char> pixels;
+};
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+bool isDirectory(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFDIR);
+}
+
+std::vector<std::string> sourceFiles(const std::string &input) {
+  if (!isDirectory(input)) {
+    return {input};
+  }
+  std::vector<std::string> files;
+  for (const char *face : kCubemapFaces) {
+    files.push_back(input + "/" + face + ".png");
+  }
+  return files;
+}
+
+bool decode(const std::string &file, Image &image) {
+  unsigned char *data =
+      stbi_load(file.c_str(), &image.width, &image.height, &image.comp, 0);
+  if (!data) {
+    return false;
+  }
+  image.pixels.assign(data, data + (size_t)image.width * image.height *
+                                        image.comp);
+  stbi_image_free(data);
+  return true;
+}
+
+// sRGB <-> linear for 8-bit channels. Linear values are kept as floats so that
+// repeated downsampling does not band.
+float srgbToLinear(float c) {
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+unsigned char linearToSrgb8(float c) {
+  c = std::min(std::max(c, 0.0f), 1.0f);
+  float s = c <= 0.0031308f ? c * 12.92f
+                            : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+  return (unsigned char)(s * 255.0f + 0.5f);
+}
+
+// Halves two rows of srcWidth texels into one with a 2x2 box filter, in linear
+// space for the color channels of sRGB images (alpha and one-channel images
+// are linear already).
+void downsampleRow(const unsigned char *row0, const unsigned char *row1,
+                   int srcWidth, int comp, const float *toLinear,
+                   unsigned char *out) {
+  int colorChannels = comp == 1 ? 0 : 3;
+  int dstWidth = std::max(1, srcWidth / 2);
+  for (int x = 0; x < dstWidth; x++) {
+    int x0 = std::min(2 * x, srcWidth - 1);
+    int x1 = std::min(2 * x + 1, srcWidth - 1);
+    const unsigned char *p[4] = {&row0[(size_t)x0 * comp],
+                                 &row0[(size_t)x1 * comp],
+                                 &row1[(size_t)x0 * comp],
+                                 &row1[(size_t)x1 * comp]};
+    for (int c = 0; c < comp; c++) {
+      if (c < colorChannels) {
+        float sum = toLinear[p[0][c]] + toLinear[p[1][c]] +
+                    toLinear[p[2][c]] + toLinear[p[3][c]];
+        out[(size_t)x * comp + c] = linearToSrgb8(0.25f * sum);
+      } else {
+        int sum = p[0][c] + p[1][c] + p[2][c] + p[3][c];
+        out[(size_t)x * comp + c] = (unsigned char)((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+// Halves an image with downsampleRow().
+Image downsample(const Image &src, const float *toLinear) {
+  Image dst;
+  dst.width = std::max(1, src.width / 2);
+  dst.height = std::max(1, src.height / 2);
+  dst.comp = src.comp;
+  dst.pixels.resize((size_t)dst.width * dst.height * dst.comp);
+
+  size_t srcRow = (size_t)src.width * src.comp;
+  ThreadPool::shared().parallelFor(
+      dst.height, 16, [&](size_t begin, size_t end) {
+        for (int y = (int)begin; y < (int)end; y++) {
+          int y0 = std::min(2 * y, src.height - 1);
+          int y1 = std::min(2 * y + 1, src.height - 1);
+          downsampleRow(&src.pixels[y0 * srcRow], &src.pixels[y1 * srcRow],
+                        src.width, src.comp, toLinear,
+                        &dst.pixels[(size_t)y * dst.width * dst.comp]);
+        }
+      });
+  return dst;
+}
+
+uint16_t packRgb565(const float *c) {
+  int r = (int)(std::min(std::max(c[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+  int g = (int)(std::min(std::max(c[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+  int b = (int)(std::min(std::max(c[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpackRgb565(uint16_t v, float *c) {
+  c[0] = (float)((v >> 11) & 31) * 255.0f / 31.0f;
+  c[1] = (float)((v >> 5) & 63) * 255.0f / 63.0f;
+  c[2] = (float)(v & 31) * 255.0f / 31.0f;
+}
+
+// Encodes one 4x4 block of RGB texels into 8 bytes of BC1. The endpoints are
+// the extremes of the texels projected on their principal axis, which is
+// close to optimal for the smooth gradients of the sky.
+void encodeBc1Block(const float (*texels)[3], unsigned char *out) {
+  float mean[3] = {0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < 3; c++) {
+      mean[c] += texels[i][c] / 16.0f;
+    }
+  }
+  float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; i++) {
+    float d[3] = {texels[i][0] - mean[0], texels[i][1] - mean[1],
+                  texels[i][2] - mean[2]};
+    cov[0] += d[0] * d[0];
+    cov[1] += d[0] * d[1];
+    cov[2] += d[0] * d[2];
+    cov[3] += d[1] * d[1];
+    cov[4] += d[1] * d[2];
+    cov[5] += d[2] * d[2];
+  }
+  // Power iteration for the principal axis.
+  float axis[3] = {1.0f, 1.0f, 1.0f};
+  for (int iter = 0; iter < 8; iter++) {
+    float a[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                  cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                  cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+    float len = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    if (len < 1e-6f) {
+      break;
+    }
+    for (int c = 0; c < 3; c++) {
+      axis[c] = a[c] / len;
+    }
+  }
+
+  float lo = 1e30f, hi = -1e30f;
+  for (int i = 0; i < 16; i++) {
+    float t = (texels[i][0] - mean[0]) * axis[0] +
+              (texels[i][1] - mean[1]) * axis[1] +
+              (texels[i][2] - mean[2]) * axis[2];
+    lo = std::min(lo, t);
+    hi = std::max(hi, t);
+  }
+  float e0[3], e1[3];
+  for (int c = 0; c < 3; c++) {
+    e0[c] = mean[c] + axis[c] * hi;
+    e1[c] = mean[c] + axis[c] * lo;
+  }
+  uint16_t c0 = packRgb565(e0);
+  uint16_t c1 = packRgb565(e1);
+  // c0 > c1 selects the four-color mode.
+  if (c0 < c1) {
+    std::swap(c0, c1);
+  }
+
+  uint32_t indices = 0;
+  if (c0 != c1) {
+    float palette[4][3];
+    unpackRgb565(c0, palette[0]);
+    unpackRgb565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+      palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    for (int i = 0; i < 16; i++) {
+      int best = 0;
+      float bestError = 1e30f;
+      for (int p = 0; p < 4; p++) {
+        float error = 0.0f;
+        for (int c = 0; c < 3; c++) {
+          float d = texels[i][c] - palette[p][c];
+          error += d * d;
+        }
+        if (error < bestError) {
+          bestError = error;
+          best = p;
+        }
+      }
+      indices |= (uint32_t)best << (2 * i);
+    }
+  }
+
+  out[0] = (unsigned char)(c0 & 0xff);
+  out[1] = (unsigned char)(c0 >> 8);
+  out[2] = (unsigned char)(c1 & 0xff);
+  out[3] = (unsigned char)(c1 >> 8);
+  for (int b = 0; b < 4; b++) {
+    out[4 + b] = (unsigned char)(indices >> (8 * b));
+  }
+}
+
+std::vector<unsigned char> encodeBc1(const Image &image) {
+  int blocksX = (image.width + 3) / 4;
+  int blocksY = (image.height + 3) / 4;
+  std::vector<unsigned char> blocks((size_t)blocksX * blocksY * 8);
+  ThreadPool::shared().parallelFor(
+      blocksY, 8, [&](size_t begin, size_t end) {
+        float texels[16][3];
+        for (int by = (int)begin; by < (int)end; by++) {
+          for (int bx = 0; bx < blocksX; bx++) {
+            // Edge blocks of small levels repeat the last row and column.
+            for (int i = 0; i < 16; i++) {
+              int x = std::min(bx * 4 + i % 4, image.width - 1);
+              int y = std::min(by * 4 + i / 4, image.height - 1);
+              const unsigned char *p =
+                  &image.pixels[((size_t)y * image.width + x) * image.comp];
+              for (int c = 0; c < 3; c++) {
+                texels[i][c] = (float)p[c];
+              }
+            }
+            encodeBc1Block(texels,
+                           &blocks[((size_t)by * blocksX + bx) * 8]);
+          }
+        }
+      });
+  return blocks;
+}
+
+int usage() {
+  fprintf(stderr,
+          "usage: texpack [--bc1] [--levels N] <image.png | cubemap dir> "
+          "[output]\n"
+          "       texpack --vt [--tile N] <cubemap dir> [output]\n"
+          "       texpack --bench <image.png | cubemap dir>\n");
+  return 1;
+}
+
+// Drops alpha or replicates gray so that every face is RGB.
+void convertToRgb(Image &image) {
+  if (image.comp == 3) {
+    return;
+  }
+  std::vector<unsigned char> rgb((size_t)image.width * image.height * 3);
+  for (size_t i = 0; i < (size_t)image.width * image.height; i++) {
+    for (int c = 0; c < 3; c++) {
+      rgb[i * 3 + c] = image.pixels[i * image.comp + (image.comp < 3 ? 0 : c)];
+    }
+  }
+  image.pixels = std::move(rgb);
+  image.comp = 3;
+}
+
+bool seekTo(FILE *file, uint64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+  return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+// An RGB face level read a band of rows at a time, so that only a few bands
+// are ever in memory. Bands are kept first in, first out, which suits rows
+// that are read roughly in order.
+struct BandedRows {
+  int width = 0;
+  int bandHeight = 0;
+  size_t maxBands = 2;
+  // Fills pixels with the band's bandHeight rows, reusing an evicted band's
+  // memory where it can; returns false on failure.
+  std::function<bool(int band, std::vector<unsigned char> &pixels)> load;
+  std::deque<std::pair<int, std::vector<unsigned char>>> bands;
+
+  // Returns nullptr if the row's band could not be loaded.
+  const unsigned char *row(int y) {
+    int band = y / bandHeight;
+    auto it = std::find_if(bands.begin(), bands.end(),
+                           [&](const auto &b) { return b.first == band; });
+    if (it == bands.end()) {
+      std::vector<unsigned char> pixels;
+      if (bands.size() >= maxBands) {
+        pixels = std::move(bands.front().second);
+        bands.pop_front();
+      }
+      if (!load(band, pixels)) {
+        return nullptr;
+      }
+      bands.emplace_back(band, std::move(pixels));
+      it = bands.end() - 1;
+    }
+    return &it->second[(size_t)(y - band * bandHeight) * width * 3];
+  }
+};
+
+// The source images of a face: <face>.png, or, for faces too large to decode
+// whole, a <face>/ directory of equal square tiles named <row>_<column>.png
+// from the top left.
+bool faceSources(const std::string &input, const char *face,
+                 std::vector<std::string> &files, int &columns,
+                 int &tileSize) {
+  files.clear();
+  std::string grid = input + "/" + face;
+  if (isDirectory(grid)) {
+    auto tile = [&](int row, int column) {
+      return grid + "/" + std::to_string(row) + "_" + std::to_string(column) +
+             ".png";
+    };
+    struct stat st;
+    columns = 0;
+    while (stat(tile(0, columns).c_str(), &st) == 0) {
+      columns++;
+    }
+    for (int row = 0; row < columns; row++) {
+      for (int column = 0; column < columns; column++) {
+        files.push_back(tile(row, column));
+      }
+    }
+  } else {
+    files.push_back(grid + ".png");
+    columns = 1;
+  }
+  int height, comp;
+  return columns > 0 &&
+         stbi_info(files[0].c_str(), &tileSize, &height, &comp) &&
+         height == tileSize;
+}
+
+// Level 0 of each face is read from its sources a row of source tiles at a
+// time; every further level is made from the previous one's tiles, read back
+// from the output a row of tiles at a time. Peak memory is therefore a few
+// rows of source tiles (one whole face for a single PNG) plus a few rows of
+// output tiles, however large the faces are.
+int packVirtual(const std::string &input, std::string output, int tileSize) {
+  if (!isDirectory(input)) {
+    fprintf(stderr, "ERROR: --vt needs a cubemap directory: %s\n",
+            input.c_str());
+    return 1;
+  }
+  if (output.empty()) {
+    output = virtualTexturePath(input);
+  }
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  FILE *file = fopen(output.c_str(), "w+b");
+  if (!file) {
+    fprintf(stderr, "ERROR: Cannot write %s\n", output.c_str());
+    return 1;
+  }
+
+  const int border = 1;
+  const int stride = tileSize + 2 * border;
+  VirtualTextureHeader header = {};
+  memcpy(header.magic, "BHVT", 4);
+  header.version = kVirtualTextureVersion;
+  header.tileSize = (uint32_t)tileSize;
+  header.border = border;
+
+  float toLinear[256];
+  for (int i = 0; i < 256; i++) {
+    toLinear[i] = srgbToLinear((float)i / 255.0f);
+  }
+
+  std::vector<size_t> levelStart;
+  std::vector<PackedTextureImage> table;
+  std::vector<unsigned char> tile((size_t)stride * stride * 3);
+  std::vector<unsigned char> strip;
+  uint64_t offset = 0;
+  bool ok = true;
+  for (int face = 0; face < 6 && ok; face++) {
+    std::vector<std::string> files;
+    int columns = 0, sourceSize = 0;
+    if (!faceSources(input, kCubemapFaces[face], files, columns,
+                     sourceSize)) {
+      fprintf(stderr, "ERROR: Failed to load %s\n", files.empty()
+                                                        ? input.c_str()
+                                                        : files[0].c_str());
+      fclose(file);
+      return 1;
+    }
+    int faceSize = columns * sourceSize;
+
+    if (face == 0) {
+      int levels = 1;
+      while ((int64_t)tileSize << (levels - 1) < faceSize) {
+        levels++;
+      }
+      if ((int64_t)tileSize << (levels - 1) != faceSize) {
+        fprintf(stderr,
+                "ERROR: %s/%s is %dx%d; faces must be %d texels times a "
+                "power of two\n",
+                input.c_str(), kCubemapFaces[face], faceSize, faceSize,
+                tileSize);
+        fclose(file);
+        return 1;
+      }
+      header.faceSize = (uint32_t)faceSize;
+      header.levelCount = (uint32_t)levels;
+      levelStart.assign(levels, 0);
+      for (int level = 1; level < levels; level++) {
+        size_t n = (size_t)1 << (levels - level);
+        levelStart[level] = levelStart[level - 1] + 6 * n * n;
+      }
+      table.resize(levelStart[levels - 1] + 6);
+      offset = sizeof(header) + table.size() * sizeof(PackedTextureImage);
+    } else if (faceSize != (int)header.faceSize) {
+      fprintf(stderr, "ERROR: %s/%s does not match the other faces\n",
+              input.c_str(), kCubemapFaces[face]);
+      fclose(file);
+      return 1;
+    }
+
+    BandedRows source;
+    source.width = faceSize;
+    source.bandHeight = sourceSize;
+    source.maxBands = (size_t)(stride / sourceSize + 2);
+    source.load = [&](int band, std::vector<unsigned char> &pixels) {
+      std::vector<Image> images(columns);
+      std::vector<char> decoded(columns, 0);
+      ThreadPool::shared().parallelFor(
+          columns, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+              decoded[i] = decode(files[band * columns + i], images[i]);
+              if (decoded[i]) {
+                convertToRgb(images[i]);
+              }
+            }
+          });
+      for (int i = 0; i < columns; i++) {
+        const std::string &name = files[band * columns + i];
+        if (!decoded[i]) {
+          fprintf(stderr, "ERROR: Failed to load %s\n", name.c_str());
+          return false;
+        }
+        if (images[i].width != sourceSize || images[i].height != sourceSize) {
+          fprintf(stderr, "ERROR: %s does not match the other tiles\n",
+                  name.c_str());
+          return false;
+        }
+        if (columns == 1) {
+          pixels = std::move(images[i].pixels); // the whole face, as is
+          break;
+        }
+        pixels.resize((size_t)sourceSize * faceSize * 3); // once per band
+        size_t rowBytes = (size_t)sourceSize * 3;
+        for (int y = 0; y < sourceSize; y++) {
+          memcpy(&pixels[((size_t)y * faceSize + (size_t)i * sourceSize) * 3],
+                 &images[i].pixels[y * rowBytes], rowBytes);
+        }
+      }
+      return true;
+    };
+
+    for (int level = 0; level < (int)header.levelCount && ok; level++) {
+      int width = (int)header.faceSize >> level;
+      int n = width / tileSize;
+
+      // The previous level, read back from the interiors of its tiles.
+      BandedRows previous;
+      previous.width = 2 * width;
+      previous.bandHeight = tileSize;
+      previous.maxBands = 4;
+      previous.load = [&](int band, std::vector<unsigned char> &pixels) {
+        pixels.resize((size_t)tileSize * previous.width * 3);
+        int tiles = 2 * n;
+        for (int tx = 0; tx < tiles; tx++) {
+          const PackedTextureImage &entry =
+              table[levelStart[level - 1] +
+                    ((size_t)face * tiles + band) * tiles + tx];
+          if (!seekTo(file, entry.offset) ||
+              fread(tile.data(), 1, tile.size(), file) != tile.size()) {
+            fprintf(stderr, "ERROR: Failed reading back %s\n",
+                    output.c_str());
+            return false;
+          }
+          for (int y = 0; y < tileSize; y++) {
+            memcpy(&pixels[((size_t)y * previous.width +
+                            (size_t)tx * tileSize) * 3],
+                   &tile[((size_t)(y + border) * stride + border) * 3],
+                   (size_t)tileSize * 3);
+          }
+        }
+        return true;
+      };
+
+      strip.resize((size_t)stride * width * 3);
+      for (int ty = 0; ty < n && ok; ty++) {
+        // The tile row and its border rows, clamped at the face edges.
+        std::vector<const unsigned char *> rows(2 * stride);
+        bool loaded = true;
+        for (int i = 0; i < stride && loaded; i++) {
+          int y = std::min(std::max(ty * tileSize + i - border, 0), width - 1);
+          if (level == 0) {
+            rows[2 * i] = source.row(y);
+            loaded = rows[2 * i] != nullptr;
+          } else {
+            rows[2 * i] = previous.row(2 * y);
+            rows[2 * i + 1] = previous.row(2 * y + 1);
+            loaded = rows[2 * i] != nullptr && rows[2 * i + 1] != nullptr;
+          }
+        }
+        if (!loaded) {
+          fclose(file);
+          return 1;
+        }
+        ThreadPool::shared().parallelFor(
+            stride, 4, [&](size_t begin, size_t end) {
+              for (size_t i = begin; i < end; i++) {
+                unsigned char *out = &strip[i * width * 3];
+                if (level == 0) {
+                  memcpy(out, rows[2 * i], (size_t)width * 3);
+                } else {
+                  downsampleRow(rows[2 * i], rows[2 * i + 1], 2 * width, 3,
+                                toLinear, out);
+                }
+              }
+            });
+
+        ok = seekTo(file, offset);
+        for (int tx = 0; tx < n && ok; tx++) {
+          // Border texels come from the neighbouring tiles, clamped at the
+          // face edges.
+          for (int y = 0; y < stride; y++) {
+            for (int x = 0; x < stride; x++) {
+              int sx = std::min(std::max(tx * tileSize + x - border, 0),
+                                width - 1);
+              memcpy(&tile[((size_t)y * stride + x) * 3],
+                     &strip[((size_t)y * width + sx) * 3], 3);
+            }
+          }
+          PackedTextureImage &entry =
+              table[levelStart[level] + ((size_t)face * n + ty) * n + tx];
+          entry.offset = offset;
+          entry.size = tile.size();
+          offset += tile.size();
+          ok = fwrite(tile.data(), 1, tile.size(), file) == tile.size();
+        }
+      }
+    }
+    if (ok) {
+      printf("  face %d done\n", face);
+    }
+  }
+
+  ok = ok && seekTo(file, 0) &&
+       fwrite(&header, sizeof(header), 1, file) == 1 &&
+       fwrite(table.data(), sizeof(PackedTextureImage), table.size(), file) ==
+           table.size();
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "ERROR: Failed writing %s\n", output.c_str());
+    return 1;
+  }
+
+  printf("Packed %s -> %s: 6 faces of %ux%u, %u levels of %d texel tiles, "
+         "%zu tiles, %.1f MB in %.0f ms\n",
+         input.c_str(), output.c_str(), header.faceSize, header.faceSize,
+         header.levelCount, tileSize, table.size(),
+         (double)offset / (1 << 20), millisecondsSince(start));
+  return 0;
+}
+
+int pack(const std::string &input, std::string output, bool bc1,
+         int maxLevels) {
+  std::vector<std::string> files = sourceFiles(input);
+  if (output.empty()) {
+    output = packedTexturePath(input);
+  }
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::vector<Image> faces(files.size());
+  std::vector<char> decoded(files.size(), 0);
+  ThreadPool::shared().parallelFor(
+      files.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          decoded[i] = decode(files[i], faces[i]);
+        }
+      });
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!decoded[i]) {
+      fprintf(stderr, "ERROR: Failed to load %s\n", files[i].c_str());
+      return 1;
+    }
+    if (faces[i].width != faces[0].width ||
+        faces[i].height != faces[0].height || faces[i].comp != faces[0].comp) {
+      fprintf(stderr, "ERROR: %s does not match the other faces\n",
+              files[i].c_str());
+      return 1;
+    }
+  }
+
+  PackedTextureHeader header = {};
+  memcpy(header.magic, "BHTX", 4);
+  header.version = kPackedTextureVersion;
+  header.faceCount = (uint32_t)faces.size();
+  header.width = (uint32_t)faces[0].width;
+  header.height = (uint32_t)faces[0].height;
+  switch (faces[0].comp) {
+  case 1:
+    header.internalFormat = GL_R8;
+    header.format = GL_RED;
+    break;
+  case 3:
+    header.internalFormat = GL_SRGB8;
+    header.format = GL_RGB;
+    break;
+  case 4:
+    header.internalFormat = GL_SRGB8_ALPHA8;
+    header.format = GL_RGBA;
+    break;
+  default:
+    fprintf(stderr, "ERROR: Unsupported image with %d components: %s\n",
+            faces[0].comp, files[0].c_str());
+    return 1;
+  }
+  header.type = GL_UNSIGNED_BYTE;
+  if (bc1) {
+    if (faces[0].comp != 3) {
+      fprintf(stderr, "ERROR: --bc1 needs an RGB image: %s\n",
+              files[0].c_str());
+      return 1;
+    }
+    header.internalFormat = GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+    header.format = 0;
+    header.type = 0;
+  }
+
+  int fullChain =
+      1 + (int)std::floor(std::log2((double)std::max(header.width,
+                                                     header.height)));
+  header.levelCount = (uint32_t)std::min(fullChain, maxLevels);
+
+  float toLinear[256];
+  for (int i = 0; i < 256; i++) {
+    toLinear[i] = srgbToLinear((float)i / 255.0f);
+  }
+
+  // Level-major: all faces of level 0, then all faces of level 1, ...
+  std::vector<std::vector<unsigned char>> images;
+  for (uint32_t level = 0; level < header.levelCount; level++) {
+    for (Image &face : faces) {
+      if (level > 0) {
+        face = downsample(face, toLinear);
+      }
+      images.push_back(bc1 ? encodeBc1(face) : face.pixels);
+    }
+  }
+
+  std::vector<PackedTextureImage> table(images.size());
+  uint64_t offset = sizeof(header) + table.size() * sizeof(PackedTextureImage);
+  for (size_t i = 0; i < images.size(); i++) {
+    offset = (offset + kPackedTextureAlignment - 1) &
+             ~(uint64_t)(kPackedTextureAlignment - 1);
+    table[i].offset = offset;
+    table[i].size = images[i].size();
+    offset += images[i].size();
+  }
+
+  FILE *file = fopen(output.c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "ERROR: Cannot write %s\n", output.c_str());
+    return 1;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(table.data(), sizeof(PackedTextureImage), table.size(),
+                   file) == table.size();
+  static const unsigned char kPadding[kPackedTextureAlignment] = {};
+  for (size_t i = 0; ok && i < images.size(); i++) {
+    size_t padding = (size_t)table[i].offset - (size_t)ftell(file);
+    ok = fwrite(kPadding, 1, padding, file) == padding &&
+         fwrite(images[i].data(), 1, images[i].size(), file) ==
+             images[i].size();
+  }
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "ERROR: Failed writing %s\n", output.c_str());
+    return 1;
+  }
+
+  printf("Packed %s -> %s: %ux%u, %u face(s), %u levels, %s, %.1f MB in "
+         "%.0f ms\n",
+         input.c_str(), output.c_str(), header.width, header.height,
+         header.faceCount, header.levelCount, bc1 ? "BC1" : "uncompressed",
+         (double)offset / (1 << 20), millisecondsSince(start));
+  return 0;
+}
+
+// Compares what each path costs before the data can be handed to GL: decoding
+// the PNGs versus mapping the container and reading every byte of it (the
+// pages are cold on the first run, warm afterwards). Single-threaded, like
+// one of AssetLoader's pool tasks.
+int bench(const std::string &input) {
+  const int kRuns = 3;
+  std::vector<std::string> files = sourceFiles(input);
+  std::string packedPath = packedTexturePath(input);
+
+  for (int run = 0; run < kRuns; run++) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    size_t pngBytes = 0;
+    for (const std::string &f : files) {
+      int width, height, comp;
+      unsigned char *data = stbi_load(f.c_str(), &width, &height, &comp, 0);
+      if (!data) {
+        fprintf(stderr, "ERROR: Failed to load %s\n", f.c_str());
+        return 1;
+      }
+      pngBytes += (size_t)width * height * comp;
+      stbi_image_free(data);
+    }
+    double pngMs = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    PackedTexture packed;
+    if (!readPackedTexture(packedPath, packed)) {
+      fprintf(stderr, "ERROR: No usable %s, run texpack first\n",
+              packedPath.c_str());
+      return 1;
+    }
+    uint64_t checksum = 0;
+    for (const PackedTextureImage &image : packed.images) {
+      const unsigned char *data = packed.file->data() + image.offset;
+      for (uint64_t i = 0; i < image.size; i += 4096) {
+        checksum += data[i];
+      }
+    }
+    double packedMs = millisecondsSince(start);
+
+    printf("run %d: png %.1f ms (%.1f MB level 0), packed %.1f ms (%.1f MB "
+           "all levels) [%llu]\n",
+           run, pngMs, (double)pngBytes / (1 << 20), packedMs,
+           (double)packed.file->size() / (1 << 20),
+           (unsigned long long)checksum);
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  bool bc1 = false;
+  bool benchmark = false;
+  bool virtualTexture = false;
+  int maxLevels = 16;
+  int tileSize = 128;
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--bc1") {
+      bc1 = true;
+    } else if (arg == "--bench") {
+      benchmark = true;
+    } else if (arg == "--vt") {
+      virtualTexture = true;
+    } else if (arg == "--levels" && i + 1 < argc) {
+      maxLevels = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--tile" && i + 1 < argc) {
+      tileSize = std::max(1, atoi(argv[++i]));
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      return usage();
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.empty() || positional.size() > 2 ||
+      (benchmark && positional.size() != 1)) {
+    return usage();
+  }
+
+  // "dir/" packs to "dir.bhtx", not "dir/.bhtx".
+  std::string input = positional[0];
+  while (input.size() > 1 && (input.back() == '/' || input.back() == '\\')) {
+    input.pop_back();
+  }
+  if (benchmark) {
+    return bench(input);
+  }
+  std::string output = positional.size() > 1 ? positional[1] : "";
+  if (virtualTexture) {
+    return packVirtual(input, output, tileSize);
+  }
+  return pack(input, output, bc1, maxLevels);
+}